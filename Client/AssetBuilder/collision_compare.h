@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "../GameCode/world.h"
+
+
+// a fixed set of random box traces, so different trees and backends get the same work
+struct TraceBenchmark
+{
+	std::vector<glm::vec3> starts;
+	std::vector<glm::vec3> ends;
+	glm::vec3 mins;
+	glm::vec3 maxs;
+};
+
+TraceBenchmark CreateTraceBenchmark(BoundingBox bounds, int numTraces)
+{
+	TraceBenchmark benchmark;
+	benchmark.mins = glm::vec3(-8, -8, -8);
+	benchmark.maxs = glm::vec3(8, 8, 8);
+
+	if (IsBoundingBoxEmpty(bounds))
+	{
+		return benchmark;
+	}
+
+	// pad so some traces start and end outside of all the geometry
+	glm::vec3 padding = (bounds.max - bounds.min) * 0.1f + glm::vec3(16);
+	bounds.min -= padding;
+	bounds.max += padding;
+
+	// fixed seed so every run gets the same traces
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> dist01(0, 1);
+
+	benchmark.starts.resize(numTraces);
+	benchmark.ends.resize(numTraces);
+	for (int i = 0; i < numTraces; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			benchmark.starts[i][j] = bounds.min[j] + dist01(rng) * (bounds.max[j] - bounds.min[j]);
+			benchmark.ends[i][j] = bounds.min[j] + dist01(rng) * (bounds.max[j] - bounds.min[j]);
+		}
+	}
+	return benchmark;
+}
+
+
+double GetTracesPerSecond(int numTraces, std::chrono::high_resolution_clock::time_point startTime)
+{
+	auto endTime = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration<double>(endTime - startTime).count();
+	return seconds > 0 ? numTraces / seconds : 0;
+}
+
+
+// results gets one TraceResult per trace, returns traces per second
+float MeasureWorldTraceThroughput(World* world, TraceBenchmark* benchmark, std::vector<TraceResult>& results)
+{
+	int numTraces = benchmark->starts.size();
+	results.resize(numTraces);
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < numTraces; i++)
+	{
+		results[i] = WorldBoxTrace(world, benchmark->starts[i], benchmark->ends[i], benchmark->mins, benchmark->maxs);
+	}
+	return GetTracesPerSecond(numTraces, startTime);
+}
+
+
+// how far apart two traces can stop and still match. Its a distance and not a fraction,
+// which would let long traces be off by more than short ones
+const float TRACE_MATCH_DISTANCE = 0.01f;
+
+bool TraceResultsMatch(TraceResult& a, TraceResult& b)
+{
+	return glm::distance(a.endPos, b.endPos) <= TRACE_MATCH_DISTANCE &&
+		a.outputStartsOut == b.outputStartsOut && a.outputAllSolid == b.outputAllSolid;
+}
+
+
+// runs the same traces through every backend, and counts results that differ from the bsp
+void CompareCollisionBackends(World* world, int numTraces)
+{
+	CollisionBackend savedBackend = world->collisionBackend;
+	TraceBenchmark benchmark = CreateTraceBenchmark(*GetBSPModelBounds(&world->collisionModel, world->collisionModel.root), numTraces);
+
+	// so bsp_hulls actually goes through a hull
+	if (world->numHulls > 0)
+	{
+		benchmark.mins = world->hulls[0].size.mins;
+		benchmark.maxs = world->hulls[0].size.maxs;
+	}
+
+	std::vector<TraceResult> results[NUM_COLLISION_BACKENDS];
+	float tracesPerSecond[NUM_COLLISION_BACKENDS];
+	for (int i = 0; i < NUM_COLLISION_BACKENDS; i++)
+	{
+		world->collisionBackend = (CollisionBackend)i;
+		tracesPerSecond[i] = MeasureWorldTraceThroughput(world, &benchmark, results[i]);
+	}
+	world->collisionBackend = savedBackend;
+
+	printf("%-10s %8s %12s %10s %10s\n", "backend", "nodes", "traces/s", "hits", "mismatch");
+	for (int i = 0; i < NUM_COLLISION_BACKENDS; i++)
+	{
+		int numNodes = world->brushTree.nodes.size();
+		if (i == COLLISION_BACKEND_BSP)
+		{
+			numNodes = world->collisionModel.numNodes + world->collisionModel.numLeaves;
+		}
+		else if (i == COLLISION_BACKEND_BSP_HULLS)
+		{
+			numNodes = 0;
+			for (int j = 0; j < world->numHulls; j++)
+			{
+				numNodes += world->hulls[j].model.numNodes + world->hulls[j].model.numLeaves;
+			}
+		}
+
+		int numHits = 0, numMismatches = 0;
+		for (int j = 0; j < results[i].size(); j++)
+		{
+			numHits += results[i][j].timeFraction < 1;
+			numMismatches += !TraceResultsMatch(results[i][j], results[COLLISION_BACKEND_BSP][j]);
+		}
+
+		printf("%-10s %8d %12.0f %10d %10d\n", collisionBackendNames[i], numNodes, tracesPerSecond[i], numHits, numMismatches);
+	}
+}
+
+
+// what the benchmark traces cost in each backend, only counted in builds with TRACE_STATS
+void PrintCollisionBackendTraceStats(World* world, int numTraces)
+{
+#ifdef TRACE_STATS
+	CollisionBackend savedBackend = world->collisionBackend;
+	TraceBenchmark benchmark = CreateTraceBenchmark(*GetBSPModelBounds(&world->collisionModel, world->collisionModel.root), numTraces);
+	if (world->numHulls > 0)
+	{
+		benchmark.mins = world->hulls[0].size.mins;
+		benchmark.maxs = world->hulls[0].size.maxs;
+	}
+
+	static char buffer[2048];
+	EndTraceStatsFrame();
+	for (int i = 0; i < NUM_COLLISION_BACKENDS; i++)
+	{
+		world->collisionBackend = (CollisionBackend)i;
+		for (int j = 0; j < benchmark.starts.size(); j++)
+		{
+			WorldBoxTrace(world, benchmark.starts[j], benchmark.ends[j], benchmark.mins, benchmark.maxs);
+		}
+
+		TraceStatsFrame stats = EndTraceStatsFrame();
+		FormatTraceStatsFrame(&stats, buffer, sizeof(buffer));
+		printf("%s: %s\n", collisionBackendNames[i], buffer);
+	}
+	world->collisionBackend = savedBackend;
+#else
+	(void)world;
+	(void)numTraces;
+	printf("built without TRACE_STATS, nothing was counted\n");
+#endif
+}
+
+
+// exact, unlike TraceResultsMatch
+bool TraceResultsIdentical(TraceResult& a, TraceResult& b)
+{
+	return a.timeFraction == b.timeFraction && a.endPos == b.endPos &&
+		a.outputStartsOut == b.outputStartsOut && a.outputAllSolid == b.outputAllSolid &&
+		a.plane.normal == b.plane.normal && a.plane.distance == b.plane.distance && a.entity == b.entity;
+}
+
+
+// Like the pellets of a shot or line of sight checks from one eye, groups of traces
+// that start at the same point and end close to each other
+TraceBenchmark CreateCoherentTraceBenchmark(BoundingBox bounds, int numTraces, int groupSize, float spread)
+{
+	TraceBenchmark benchmark = CreateTraceBenchmark(bounds, numTraces);
+
+	std::mt19937 rng(4321);
+	std::uniform_real_distribution<float> distSpread(-spread, spread);
+	for (int i = 0; i < benchmark.starts.size(); i++)
+	{
+		int leader = i - i % groupSize;
+		benchmark.starts[i] = benchmark.starts[leader];
+		if (i != leader)
+		{
+			benchmark.ends[i] = benchmark.ends[leader] + glm::vec3(distSpread(rng), distSpread(rng), distSpread(rng));
+		}
+	}
+	return benchmark;
+}
+
+
+// BoxTrace one at a time against BoxTraceBatch, on random and on coherent traces
+void CompareTraceBatch(BSPCollisionModel* model, int numTraces)
+{
+	BoundingBox bounds = *GetBSPModelBounds(model, model->root);
+
+	const int NUM_SETS = 3;
+	const char* setNames[NUM_SETS] = { "random", "pellets", "sight" };
+	TraceBenchmark sets[NUM_SETS];
+	sets[0] = CreateTraceBenchmark(bounds, numTraces);
+	sets[1] = CreateCoherentTraceBenchmark(bounds, numTraces, 16, 32);
+	sets[2] = CreateCoherentTraceBenchmark(bounds, numTraces, 16, 32);
+	sets[2].mins = glm::vec3(0);
+	sets[2].maxs = glm::vec3(0);
+
+	printf("%-10s %12s %12s %10s %10s\n", "traces", "scalar/s", "batch/s", "hits", "differ");
+	for (int i = 0; i < NUM_SETS; i++)
+	{
+		TraceBenchmark* set = &sets[i];
+		int count = set->starts.size();
+		std::vector<glm::vec3> mins(count, set->mins);
+		std::vector<glm::vec3> maxs(count, set->maxs);
+
+		std::vector<TraceResult> scalarResults(count);
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (int j = 0; j < count; j++)
+		{
+			scalarResults[j] = BoxTrace(set->starts[j], set->ends[j], mins[j], maxs[j], model);
+		}
+		double scalarTracesPerSecond = GetTracesPerSecond(count, startTime);
+
+		std::vector<TraceResult> batchResults(count);
+		startTime = std::chrono::high_resolution_clock::now();
+		BoxTraceBatch(set->starts.data(), set->ends.data(), mins.data(), maxs.data(), count, model, batchResults.data());
+		double batchTracesPerSecond = GetTracesPerSecond(count, startTime);
+
+		int numHits = 0, numDifferent = 0;
+		for (int j = 0; j < count; j++)
+		{
+			numHits += scalarResults[j].timeFraction < 1;
+			numDifferent += !TraceResultsIdentical(scalarResults[j], batchResults[j]);
+		}
+
+		printf("%-10s %12.0f %12.0f %10d %10d\n", setNames[i], scalarTracesPerSecond, batchTracesPerSecond, numHits, numDifferent);
+	}
+}
+
+
+// WorldBoxTrace one at a time against WorldBoxTraceBatch in each backend. The boxes cycle 
+// through the hull sizes and one size without a hull, so batches mix models
+void CompareWorldTraceBatch(World* world, int numTraces)
+{
+	CollisionBackend savedBackend = world->collisionBackend;
+	TraceBenchmark benchmark = CreateTraceBenchmark(*GetBSPModelBounds(&world->collisionModel, world->collisionModel.root), numTraces);
+
+	int count = benchmark.starts.size();
+	std::vector<glm::vec3> mins(count, benchmark.mins);
+	std::vector<glm::vec3> maxs(count, benchmark.maxs);
+	for (int i = 0; i < count; i++)
+	{
+		int size = i % (world->numHulls + 1);
+		if (size < world->numHulls)
+		{
+			mins[i] = world->hulls[size].size.mins;
+			maxs[i] = world->hulls[size].size.maxs;
+		}
+	}
+
+	printf("%-10s %12s %12s %10s %10s\n", "world", "scalar/s", "batch/s", "hits", "differ");
+	for (int i = 0; i < NUM_COLLISION_BACKENDS; i++)
+	{
+		world->collisionBackend = (CollisionBackend)i;
+
+		std::vector<TraceResult> scalarResults(count);
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (int j = 0; j < count; j++)
+		{
+			scalarResults[j] = WorldBoxTrace(world, benchmark.starts[j], benchmark.ends[j], mins[j], maxs[j]);
+		}
+		double scalarTracesPerSecond = GetTracesPerSecond(count, startTime);
+
+		std::vector<TraceResult> batchResults(count);
+		startTime = std::chrono::high_resolution_clock::now();
+		WorldBoxTraceBatch(world, benchmark.starts.data(), benchmark.ends.data(), mins.data(), maxs.data(), count, batchResults.data());
+		double batchTracesPerSecond = GetTracesPerSecond(count, startTime);
+
+		int numHits = 0, numDifferent = 0;
+		for (int j = 0; j < count; j++)
+		{
+			numHits += scalarResults[j].timeFraction < 1;
+			numDifferent += !TraceResultsIdentical(scalarResults[j], batchResults[j]);
+		}
+
+		printf("%-10s %12.0f %12.0f %10d %10d\n", collisionBackendNames[i], scalarTracesPerSecond, batchTracesPerSecond, numHits, numDifferent);
+	}
+	world->collisionBackend = savedBackend;
+}
+
+
+// BoxContents and PointContents against a zero length BoxTrace starting solid, and against
+// testing every brush of the model
+void CompareContentsQueries(BSPCollisionModel* model, int numQueries)
+{
+	BoundingBox bounds = *GetBSPModelBounds(model, model->root);
+	TraceBenchmark set = CreateTraceBenchmark(bounds, numQueries);
+
+	const int NUM_SETS = 2;
+	const char* setNames[NUM_SETS] = { "box", "point" };
+	glm::vec3 setMins[NUM_SETS] = { set.mins, glm::vec3(0) };
+	glm::vec3 setMaxs[NUM_SETS] = { set.maxs, glm::vec3(0) };
+
+	printf("%-10s %12s %12s %10s %10s %10s\n", "contents", "trace/s", "query/s", "solid", "differ", "brushes");
+	for (int i = 0; i < NUM_SETS; i++)
+	{
+		int count = set.starts.size();
+		glm::vec3 mins = setMins[i];
+		glm::vec3 maxs = setMaxs[i];
+
+		std::vector<bool> traceSolid(count);
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (int j = 0; j < count; j++)
+		{
+			traceSolid[j] = !BoxTrace(set.starts[j], set.starts[j], mins, maxs, model).outputStartsOut;
+		}
+		double tracesPerSecond = GetTracesPerSecond(count, startTime);
+
+		std::vector<int> contents(count);
+		startTime = std::chrono::high_resolution_clock::now();
+		for (int j = 0; j < count; j++)
+		{
+			contents[j] = i == 0 ? BoxContents(model, set.starts[j], mins, maxs) : PointContents(model, set.starts[j]);
+		}
+		double queriesPerSecond = GetTracesPerSecond(count, startTime);
+
+		// the brush lists against every brush
+		int numSolid = 0, numDifferent = 0, numDifferentBrushes = 0;
+		std::vector<int> brushes;
+		for (int j = 0; j < count; j++)
+		{
+			numSolid += contents[j] != 0;
+			numDifferent += (contents[j] != 0) != traceSolid[j];
+
+			brushes.clear();
+			BoxContents(model, set.starts[j], mins, maxs, &brushes);
+
+			int numTouching = 0;
+			for (int k = 0; k < model->numBrushes; k++)
+			{
+				if (model->brushes[k].contents != 0 && BoxTouchesBrush(model, &model->brushes[k], set.starts[j], mins, maxs))
+				{
+					numTouching++;
+					numDifferentBrushes += std::find(brushes.begin(), brushes.end(), k) == brushes.end();
+				}
+			}
+			numDifferentBrushes += brushes.size() != numTouching;
+		}
+
+		printf("%-10s %12.0f %12.0f %10d %10d %10d\n", setNames[i], tracesPerSecond, queriesPerSecond, numSolid, numDifferent, numDifferentBrushes);
+	}
+}
@@ -1,5 +1,1469 @@
-int main(int argc, char *argv[])
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../GameCode/world.h"
+#include "../GameCode/entity_move.h"
+#include "collision_compare.h"
+#include "split_cost_compare.h"
+#include "round_trace_compare.h"
+
+
+bool ParseLevelId(const char* name, LevelId* level)
+{
+	for (int i = 0; i < NUM_LEVELS; i++)
+	{
+		if (strcmp(name, levelNames[i]) == 0)
+		{
+			*level = (LevelId)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void PrintUsage()
+{
+	std::cout << "usage:" << std::endl;
+	std::cout << "	AssetBuilder -compare_split_cost <level> [numTraces] [-traces file]" << std::endl;
+	std::cout << "	AssetBuilder -bsp_report <level|all> [-sah] [-iterations n] [-out file.json]" << std::endl;
+	std::cout << "	AssetBuilder -compare_collision <level> [numTraces]" << std::endl;
+	std::cout << "	AssetBuilder -trace_stats <level> [numTraces]" << std::endl;
+	std::cout << "	AssetBuilder -compile_bsp <level|all> [-sah] [-out_dir dir] [-hull minX minY minZ maxX maxY maxZ]..." << std::endl;
+	std::cout << "	AssetBuilder -move_entities <level> [numMovers] [numTicks] [maxThreads]" << std::endl;
+	std::cout << "	AssetBuilder -trace_harness <level> [numTraces] [-traces file] [-threads n]" << std::endl;
+	std::cout << "	AssetBuilder -edit_bsp <level> [numEdits] [numTraces]" << std::endl;
+	std::cout << "levels:";
+	for (int i = 0; i < NUM_LEVELS; i++)
+	{
+		std::cout << " " << levelNames[i];
+	}
+	std::cout << std::endl;
+}
+
+
+// World is too big for the stack
+std::vector<Brush> LoadLevelBrushes(LevelId level)
+{
+	World* world = new World();
+	std::vector<Brush> brushes;
+
+	// the level builders print their brushes, keep stdout clean for the report
+	std::streambuf* coutBuffer = std::cout.rdbuf(NULL);
+	CreateLevel(world, level, brushes);
+	std::cout.rdbuf(coutBuffer);
+
+	delete world;
+	return brushes;
+}
+
+
+// compiled world with every collision backend built
+World* LoadLevelWorld(LevelId level)
+{
+	World* world = new World();
+	std::vector<Brush> brushes;
+
+	std::streambuf* coutBuffer = std::cout.rdbuf(NULL);
+	CreateLevel(world, level, brushes);
+
+	BSPBuildSettings settings;
+	settings.verbose = false;
+	std::vector<std::vector<BspPolygon>> visibleFaces;
+	BSPNode* root = CompileBSP(brushes, settings, &world->tree, &visibleFaces, NULL);
+	world->collisionModel = GetBSPCollisionModel(&world->tree);
+	ApplyVisibleFacesToEntities(world, brushes, visibleFaces);
+	InitWorldBrushEditing(world, root, brushes);
+	CompileWorldHulls(world);
+	std::cout.rdbuf(coutBuffer);
+
+	return world;
+}
+
+
+int CompareCollisionCommand(int argc, char *argv[])
 {
+	LevelId level;
+	if (argc < 3 || !ParseLevelId(argv[2], &level))
+	{
+		PrintUsage();
+		return(1);
+	}
+
+	int numTraces = argc > 3 ? atoi(argv[3]) : 20000;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	World* world = LoadLevelWorld(level);
+	auto endTime = std::chrono::high_resolution_clock::now();
+	std::cout << "compile " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms, " 
+		<< world->brushes.size() << " brushes" << std::endl;
+
+	startTime = std::chrono::high_resolution_clock::now();
+	BuildWorldBrushTree(world);
+	endTime = std::chrono::high_resolution_clock::now();
+	std::cout << "aabb tree build " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms, height " 
+		<< GetAABBTreeHeight(&world->brushTree) << std::endl;
+
+	CompareCollisionBackends(world, numTraces);
+
+	std::cout << std::endl;
+	CompareTraceBatch(&world->collisionModel, numTraces);
 
+	std::cout << std::endl;
+	CompareWorldTraceBatch(world, numTraces);
+
+	std::cout << std::endl;
+	CompareContentsQueries(&world->collisionModel, numTraces);
+
+	std::cout << std::endl;
+	CompareRoundTraces(world, numTraces);
+
+	FreeBSPTree(world->bspRoot);
+	delete world;
 	return(0);
 }
+
+
+// histograms of what the traces cost, needs a build with TRACE_STATS
+int TraceStatsCommand(int argc, char *argv[])
+{
+	LevelId level;
+	if (argc < 3 || !ParseLevelId(argv[2], &level))
+	{
+		PrintUsage();
+		return(1);
+	}
+
+	int numTraces = argc > 3 ? atoi(argv[3]) : 20000;
+
+	World* world = LoadLevelWorld(level);
+	BuildWorldBrushTree(world);
+	PrintCollisionBackendTraceStats(world, numTraces);
+
+	FreeBSPTree(world->bspRoot);
+	delete world;
+	return(0);
+}
+
+
+int CompareSplitCostCommand(int argc, char *argv[])
+{
+	LevelId level;
+	if (argc < 3 || !ParseLevelId(argv[2], &level))
+	{
+		PrintUsage();
+		return(1);
+	}
+
+	int numTraces = 20000;
+	const char* tracesFile = NULL;
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-traces") == 0 && i + 1 < argc)
+		{
+			tracesFile = argv[++i];
+		}
+		else if (argv[i][0] != '-')
+		{
+			numTraces = atoi(argv[i]);
+		}
+		else
+		{
+			PrintUsage();
+			return(1);
+		}
+	}
+
+	std::vector<Brush> brushes = LoadLevelBrushes(level);
+
+	// without a recording, players walking around a default compile of the level stand in for one
+	TraceCorpus corpus;
+	if (tracesFile)
+	{
+		if (!ReadTraceCorpus(tracesFile, &corpus))
+		{
+			std::cout << "could not read " << tracesFile << std::endl;
+			return(1);
+		}
+	}
+	else
+	{
+		BSPBuildSettings settings;
+		settings.verbose = false;
+		std::vector<Brush> brushesCopy = brushes;
+		FlatBSPTree tree;
+		BSPNode* root = BuildBSPTree(brushesCopy, 0, settings);
+		FlattenBSPTree(root, brushesCopy, &tree);
+		FreeBSPTree(root);
+
+		BSPCollisionModel model = GetBSPCollisionModel(&tree);
+		corpus = CreatePlayerTraceCorpus(&model, brushes, numTraces);
+	}
+
+	CompareSplitCostModels(brushes, numTraces, &corpus);
+	return(0);
+}
+
+
+int BSPReportCommand(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return(1);
+	}
+
+	std::vector<LevelId> levels;
+	if (strcmp(argv[2], "all") == 0)
+	{
+		for (int i = 0; i < NUM_LEVELS; i++)
+		{
+			levels.push_back((LevelId)i);
+		}
+	}
+	else
+	{
+		LevelId level;
+		if (!ParseLevelId(argv[2], &level))
+		{
+			std::cout << "unknown level " << argv[2] << std::endl;
+			PrintUsage();
+			return(1);
+		}
+		levels.push_back(level);
+	}
+
+	BSPBuildSettings settings;
+	int numIterations = 1;
+	const char* outFile = NULL;
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-sah") == 0)
+		{
+			settings.splitCostModel = SPLIT_COST_SAH;
+		}
+		else if (strcmp(argv[i], "-iterations") == 0 && i + 1 < argc)
+		{
+			numIterations = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+		{
+			outFile = argv[++i];
+		}
+		else
+		{
+			PrintUsage();
+			return(1);
+		}
+	}
+
+	std::vector<BSPBuildReport> reports(levels.size());
+	for (int i = 0; i < levels.size(); i++)
+	{
+		std::vector<Brush> brushes = LoadLevelBrushes(levels[i]);
+		BenchmarkBSPCompile(levelNames[levels[i]], brushes, settings, numIterations, &reports[i]);
+	}
+
+	std::ofstream file;
+	if (outFile)
+	{
+		file.open(outFile);
+		if (!file.is_open())
+		{
+			std::cout << "could not open " << outFile << std::endl;
+			return(1);
+		}
+	}
+	std::ostream& out = outFile ? file : std::cout;
+
+	out << "[" << std::endl;
+	for (int i = 0; i < reports.size(); i++)
+	{
+		WriteBSPReportJson(out, &reports[i], "	");
+		out << (i + 1 < reports.size() ? "," : "") << std::endl;
+	}
+	out << "]" << std::endl;
+	return(0);
+}
+
+
+// the whole file in memory, the same bytes the game gets from mapping it
+std::vector<char> ReadWholeFile(const char* filename)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		return std::vector<char>();
+	}
+
+	std::vector<char> contents((size_t)file.tellg());
+	file.seekg(0);
+	file.read(contents.data(), contents.size());
+	return contents;
+}
+
+
+// traces through the compiled tree and the loaded file have to agree exactly.
+// Hulls are traced with points, like WorldBoxTrace does
+int CountBSPFileMismatches(BSPCollisionModel* compiled, BSPCollisionModel* loaded, int numTraces, bool isHull)
+{
+	TraceBenchmark benchmark = CreateTraceBenchmark(*GetBSPModelBounds(compiled, compiled->root), numTraces);
+	if (isHull)
+	{
+		benchmark.mins = glm::vec3(0);
+		benchmark.maxs = glm::vec3(0);
+	}
+
+	int numMismatches = 0;
+	for (int i = 0; i < benchmark.starts.size(); i++)
+	{
+		TraceResult a = BoxTrace(benchmark.starts[i], benchmark.ends[i], benchmark.mins, benchmark.maxs, compiled);
+		TraceResult b = BoxTrace(benchmark.starts[i], benchmark.ends[i], benchmark.mins, benchmark.maxs, loaded);
+		numMismatches += a.timeFraction != b.timeFraction || a.outputStartsOut != b.outputStartsOut ||
+			a.outputAllSolid != b.outputAllSolid || a.plane != b.plane;
+	}
+	return numMismatches;
+}
+
+
+// writes the file, maps it back and checks it traces the same as model. polygons is NULL for hulls
+bool WriteAndCheckBSPFile(std::string filename, BSPCollisionModel* model, BSPFileStamp stamp, BSPHullSize hullSize, 
+	BSPFilePolygons* polygons)
+{
+	if (!WriteBSPFile(filename.c_str(), model, stamp, hullSize, polygons))
+	{
+		std::cout << "could not write " << filename << std::endl;
+		return false;
+	}
+
+	std::vector<char> contents = ReadWholeFile(filename.c_str());
+	BSPCollisionModel loaded;
+	BSPHullSize loadedHullSize;
+	BSPFilePolygons loadedPolygons;
+	if (!LoadBSPFile(contents.data(), contents.size(), stamp, &loaded, &loadedHullSize, polygons ? &loadedPolygons : NULL) ||
+		!IsHullSize(loadedHullSize, hullSize.mins, hullSize.maxs))
+	{
+		std::cout << "could not load back " << filename << std::endl;
+		return false;
+	}
+
+	if (polygons && (loadedPolygons.splitPolygons.size() != polygons->splitPolygons.size() ||
+		loadedPolygons.visibleFaces.size() != polygons->visibleFaces.size()))
+	{
+		std::cout << "polygons of " << filename << " did not load back" << std::endl;
+		return false;
+	}
+
+	// the game must not take the file for other brushes
+	BSPFileStamp otherStamp = stamp;
+	otherStamp.brushHash++;
+	BSPCollisionModel rejected;
+	if (LoadBSPFile(contents.data(), contents.size(), otherStamp, &rejected))
+	{
+		std::cout << filename << " loaded for brushes it wasnt compiled from" << std::endl;
+		return false;
+	}
+
+	int numTraces = 20000;
+	int numMismatches = CountBSPFileMismatches(model, &loaded, numTraces, polygons == NULL);
+	printf("%s: %d bytes, %d nodes, %d leaves, %d brushes, %d brush sides, %d / %d traces differ\n",
+		filename.c_str(), (int)contents.size(), loaded.numNodes, loaded.numLeaves, loaded.numBrushes,
+		loaded.numBrushSides, numMismatches, numTraces);
+
+	return numMismatches == 0;
+}
+
+
+int CompileBSPCommand(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return(1);
+	}
+
+	std::vector<LevelId> levels;
+	if (strcmp(argv[2], "all") == 0)
+	{
+		for (int i = 0; i < NUM_LEVELS; i++)
+		{
+			levels.push_back((LevelId)i);
+		}
+	}
+	else
+	{
+		LevelId level;
+		if (!ParseLevelId(argv[2], &level))
+		{
+			std::cout << "unknown level " << argv[2] << std::endl;
+			PrintUsage();
+			return(1);
+		}
+		levels.push_back(level);
+	}
+
+	BSPBuildSettings settings;
+	settings.verbose = false;
+	std::string outDir = ".";
+	std::vector<BSPHullSize> hullSizes(standardHullSizes, standardHullSizes + NUM_STANDARD_HULLS);
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-sah") == 0)
+		{
+			settings.splitCostModel = SPLIT_COST_SAH;
+		}
+		else if (strcmp(argv[i], "-out_dir") == 0 && i + 1 < argc)
+		{
+			outDir = argv[++i];
+		}
+		else if (strcmp(argv[i], "-hull") == 0 && i + 6 < argc)
+		{
+			BSPHullSize size;
+			for (int j = 0; j < 3; j++)
+			{
+				size.mins[j] = atof(argv[i + 1 + j]);
+				size.maxs[j] = atof(argv[i + 4 + j]);
+			}
+			hullSizes.push_back(size);
+			i += 6;
+		}
+		else
+		{
+			PrintUsage();
+			return(1);
+		}
+	}
+
+	if (hullSizes.size() > MAX_BSP_HULLS)
+	{
+		std::cout << "at most " << MAX_BSP_HULLS << " hulls" << std::endl;
+		return(1);
+	}
+
+	for (int i = 0; i < levels.size(); i++)
+	{
+		std::vector<Brush> brushes = LoadLevelBrushes(levels[i]);
+		std::string levelPath = outDir + "/" + levelNames[levels[i]];
+		BSPFileStamp stamp = GetBSPFileStamp(levels[i], brushes);
+
+		FlatBSPTree tree;
+		std::vector<std::vector<BspPolygon>> visibleFaces;
+		std::vector<Brush> brushesCopy = brushes;
+		FreeBSPTree(CompileBSP(brushesCopy, settings, &tree, &visibleFaces, NULL));
+		BSPCollisionModel compiled = GetBSPCollisionModel(&tree);
+		BSPFilePolygons polygons = GetBSPFilePolygons(&tree, visibleFaces);
+		if (!WriteAndCheckBSPFile(levelPath + ".bsp", &compiled, stamp, BSPHullSize(), &polygons))
+		{
+			return(1);
+		}
+
+		for (int j = 0; j < hullSizes.size(); j++)
+		{
+			BSPHull* hull = new BSPHull();
+			CompileBSPHull(brushes, hullSizes[j], settings, hull);
+			bool ok = WriteAndCheckBSPFile(levelPath + ".hull" + std::to_string(j) + ".bsp", &hull->model, stamp, hullSizes[j], NULL);
+			FreeBSPHullTree(hull);
+			delete hull;
+			if (!ok)
+			{
+				return(1);
+			}
+		}
+	}
+	return(0);
+}
+
+
+// std::thread version of the game's work queue, so the tool runs the same jobs the game does
+struct PlatformWorkQueue
+{
+	struct Job
+	{
+		PlatformWorkQueueCallback callback;
+		void* data;
+	};
+
+	std::mutex mutex;
+	std::condition_variable jobAdded;
+	std::condition_variable jobCompleted;
+
+	std::vector<Job> jobs;
+	int nextJob;
+	int numCompletedJobs;
+	bool quit;
+
+	std::vector<std::thread> threads;
+};
+
+
+// runs the next job, waits for one when wait is set. False when there was nothing to run
+bool DoNextWorkQueueJob(PlatformWorkQueue* queue, bool wait)
+{
+	std::unique_lock<std::mutex> lock(queue->mutex);
+	if (wait)
+	{
+		queue->jobAdded.wait(lock, [queue] { return queue->quit || queue->nextJob < queue->jobs.size(); });
+	}
+	if (queue->nextJob == queue->jobs.size())
+	{
+		return false;
+	}
+
+	PlatformWorkQueue::Job job = queue->jobs[queue->nextJob++];
+	lock.unlock();
+
+	job.callback(queue, job.data);
+
+	lock.lock();
+	queue->numCompletedJobs++;
+	queue->jobCompleted.notify_all();
+	return true;
+}
+
+
+void AddWorkQueueEntry(PlatformWorkQueue* queue, PlatformWorkQueueCallback callback, void* data)
+{
+	std::lock_guard<std::mutex> lock(queue->mutex);
+
+	PlatformWorkQueue::Job job = { callback, data };
+	queue->jobs.push_back(job);
+	queue->jobAdded.notify_one();
+}
+
+
+void CompleteAllWork(PlatformWorkQueue* queue)
+{
+	while (DoNextWorkQueueJob(queue, false))
+	{
+	}
+
+	std::unique_lock<std::mutex> lock(queue->mutex);
+	queue->jobCompleted.wait(lock, [queue] { return queue->numCompletedJobs == queue->jobs.size(); });
+	queue->jobs.clear();
+	queue->nextJob = 0;
+	queue->numCompletedJobs = 0;
+}
+
+
+// the main thread works the queue too in CompleteAllWork, so numThreads - 1 workers
+void StartWorkQueue(PlatformWorkQueue* queue, int numThreads)
+{
+	queue->nextJob = 0;
+	queue->numCompletedJobs = 0;
+	queue->quit = false;
+	for (int i = 0; i < numThreads - 1; i++)
+	{
+		// only runs out of jobs to wait for once the queue is stopped
+		queue->threads.push_back(std::thread([queue]
+		{
+			while (DoNextWorkQueueJob(queue, true))
+			{
+			}
+		}));
+	}
+}
+
+
+void StopWorkQueue(PlatformWorkQueue* queue)
+{
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->quit = true;
+		queue->jobAdded.notify_all();
+	}
+
+	for (int i = 0; i < queue->threads.size(); i++)
+	{
+		queue->threads[i].join();
+	}
+	queue->threads.clear();
+}
+
+
+bool IsSameMoverState(EntityMover& a, EntityMover& b)
+{
+	return a.entity.pos == b.entity.pos && a.entity.velocity == b.entity.velocity &&
+		a.entity.groundEntity == b.entity.groundEntity && a.entity.groundPlane == b.entity.groundPlane &&
+		a.randomState == b.randomState && a.wishDirection == b.wishDirection;
+}
+
+
+bool IsSameTraceCorpus(TraceCorpus& a, TraceCorpus& b)
+{
+	return a.traces.size() == b.traces.size() &&
+		(a.traces.size() == 0 || memcmp(a.traces.data(), b.traces.data(), a.traces.size() * sizeof(RecordedTrace)) == 0);
+}
+
+
+// Moves the same movers single threaded and then on the queue with more and more threads.
+// Every threaded run has to end up exactly where the single threaded one did, and record
+// the same traces in the same order
+int MoveEntitiesCommand(int argc, char *argv[])
+{
+	LevelId level;
+	if (argc < 3 || !ParseLevelId(argv[2], &level))
+	{
+		PrintUsage();
+		return(1);
+	}
+
+	int numMovers = argc > 3 ? atoi(argv[3]) : 512;
+	int numTicks = argc > 4 ? atoi(argv[4]) : 200;
+	int maxThreads = argc > 5 ? atoi(argv[5]) : std::max(1, (int)std::thread::hardware_concurrency());
+
+	World* world = LoadLevelWorld(level);
+	world->collisionBackend = COLLISION_BACKEND_BSP_HULLS;
+
+	std::vector<EntityMover> spawned;
+	SpawnEntityMovers(world, spawned, numMovers, 1);
+	numMovers = spawned.size();
+	printf("%d movers, %d ticks, %d hardware threads\n", numMovers, numTicks, (int)std::thread::hardware_concurrency());
+
+	PlatformAPI platform = {};
+	platform.addWorkQueueEntry = AddWorkQueueEntry;
+	platform.completeAllWork = CompleteAllWork;
+
+	// the first run pays for the cold caches, dont let that count against the reference
+	std::vector<EntityMover> warmUp = spawned;
+	for (int i = 0; i < numTicks; i++)
+	{
+		MoveEntities(world, warmUp, &platform, NULL);
+	}
+
+	std::vector<EntityMover> reference = spawned;
+	TraceCorpus referenceTraces;
+	world->traceRecording = &referenceTraces;
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < numTicks; i++)
+	{
+		MoveEntities(world, reference, &platform, NULL);
+	}
+	auto endTime = std::chrono::high_resolution_clock::now();
+	double referenceMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	printf("no queue: %.1f ms, %.0f moves/s, %d traces\n", referenceMs, numMovers * numTicks / (referenceMs / 1000), (int)referenceTraces.traces.size());
+
+	std::vector<int> threadCounts;
+	for (int i = 1; i < maxThreads; i *= 2)
+	{
+		threadCounts.push_back(i);
+	}
+	threadCounts.push_back(maxThreads);
+
+	bool allSame = true;
+	for (int j = 0; j < threadCounts.size(); j++)
+	{
+		int numThreads = threadCounts[j];
+		PlatformWorkQueue* queue = new PlatformWorkQueue();
+		StartWorkQueue(queue, numThreads);
+
+		std::vector<EntityMover> movers = spawned;
+		TraceCorpus traces;
+		world->traceRecording = &traces;
+
+		startTime = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < numTicks; i++)
+		{
+			MoveEntities(world, movers, &platform, queue);
+		}
+		endTime = std::chrono::high_resolution_clock::now();
+		double ms = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+		StopWorkQueue(queue);
+		delete queue;
+
+		int numDiffer = 0;
+		for (int i = 0; i < numMovers; i++)
+		{
+			numDiffer += !IsSameMoverState(movers[i], reference[i]);
+		}
+		bool sameTraces = IsSameTraceCorpus(traces, referenceTraces);
+		allSame = allSame && numDiffer == 0 && sameTraces;
+
+		printf("%d threads: %.1f ms, %.0f moves/s, %.2fx, %d / %d movers differ, traces %s\n", numThreads, ms,
+			numMovers * numTicks / (ms / 1000), referenceMs / ms, numDiffer, numMovers, sameTraces ? "same" : "differ");
+	}
+	world->traceRecording = NULL;
+
+	FreeBSPTree(world->bspRoot);
+	delete world;
+	return allSame ? 0 : 1;
+}
+
+
+/*
+	BoxTrace harness, no client needed. Runs sets of segment and box traces, random ones and
+	recorded ones, through the bsp and through each clip hull, and checks each against
+	sweeping the box through every brush of the level one by one. Then times the bsp traces
+	on one thread and on all of them.
+
+	The brute force shares no code with the traces. It goes straight to the polygons of
+	world->brushes, in double: the brush grown by the box is cut by the planes of its
+	polygons, the 6 axial planes and the planes between each edge and each axis, all moved out
+	to where the box touches the brush. Whichever of those arent faces of the grown brush dont
+	cut anything off, so it takes all of them instead of working out which are. Like the
+	traces it stops DIST_EPSILON short of what it hits.
+
+	The bsp can still come out different in two ways that arent bugs.
+
+	A trace stops looking at brushes once it is stopped right at its start, so whether it
+	says it started out depends on which brush it found first. The brute force keeps going
+	through every brush. Those are counted as "at start", as long as they agree on all solid:
+	a stopped trace still looks for a brush it is in at both ends, so the bsp has no excuse
+	for missing one.
+
+	And where a trace only grazes a brush, the plane a node splits on and the DIST_EPSILON
+	nudges decide which side a point sitting on a face ends up on. So a result that still
+	doesnt match is only counted as a mismatch if it is also off from the brute force with
+	the box a little bigger and a little smaller
+
+			 ___________
+			|  _______  |		bigger box, hits first
+			| |		  | |
+			| | brush | |		the box itself
+			| |_______| |
+			|___________|		smaller box, hits last
+
+	A point trace cant get smaller, so the smaller box is an inside out one, mins above maxs.
+	Pushing each plane out by an inside out box pulls it in, which is the brush getting
+	smaller instead.
+*/
+const float TRACE_HARNESS_GRAZE_MARGIN = 2 * DIST_EPSILON;
+
+const int TRACE_HARNESS_JOB_SIZE = 256;
+const int TRACE_HARNESS_MAX_PRINTED_MISMATCHES = 4;
+
+// a set of traces and the model they go through. A hull has the boxes grown into it
+// already, so the traces go through it as points
+struct TraceHarnessSet
+{
+	std::string name;
+	BSPCollisionModel* model;
+	bool isHull;
+	TraceCorpus corpus;
+};
+
+struct TraceHarnessJob
+{
+	TraceHarnessSet* set;
+	RecordedTrace* traces;
+	TraceResult* results;
+	int numTraces;
+};
+
+
+TraceResult TraceHarnessTrace(TraceHarnessSet* set, RecordedTrace& trace)
+{
+	if (set->isHull)
+	{
+		return BoxTrace(trace.start, trace.end, glm::vec3(0), glm::vec3(0), set->model);
+	}
+	return BoxTrace(trace.start, trace.end, trace.mins, trace.maxs, set->model);
+}
+
+
+void DoTraceHarnessJob(PlatformWorkQueue* queue, void* data)
+{
+	TraceHarnessJob* job = (TraceHarnessJob*)data;
+	for (int i = 0; i < job->numTraces; i++)
+	{
+		job->results[i] = TraceHarnessTrace(job->set, job->traces[i]);
+	}
+}
+
+
+TraceCorpus GetBenchmarkTraces(TraceBenchmark* benchmark)
+{
+	TraceCorpus corpus;
+	for (int i = 0; i < benchmark->starts.size(); i++)
+	{
+		RecordedTrace trace = { benchmark->starts[i], benchmark->ends[i], benchmark->mins, benchmark->maxs };
+		corpus.traces.push_back(trace);
+	}
+	return corpus;
+}
+
+
+struct BruteForcePlane
+{
+	glm::dvec3 normal;
+	double distance;
+};
+
+
+void AddBruteForcePlane(std::vector<BruteForcePlane>& planes, Brush& brush, glm::dvec3 normal)
+{
+	double length = glm::length(normal);
+	if (length < 1e-9)
+	{
+		return;
+	}
+	normal /= length;
+
+	for (int i = 0; i < planes.size(); i++)
+	{
+		if (glm::dot(planes[i].normal, normal) > 1 - 1e-12)
+		{
+			return;
+		}
+	}
+
+	BruteForcePlane plane;
+	plane.normal = normal;
+	plane.distance = -DBL_MAX;
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		for (int j = 0; j < brush.polygons[i].vertices.size(); j++)
+		{
+			plane.distance = std::max(plane.distance, glm::dot(normal, glm::dvec3(brush.polygons[i].vertices[j])));
+		}
+	}
+	planes.push_back(plane);
+}
+
+
+// every plane the brush grown by a box could have, through the point of the brush furthest
+// out along it. Removed brushes have none
+std::vector<BruteForcePlane> GetBruteForceBrushPlanes(Brush& brush)
+{
+	std::vector<BruteForcePlane> planes;
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		AddBruteForcePlane(planes, brush, glm::dvec3(brush.polygons[i].plane.normal));
+
+		std::vector<glm::vec3>& vertices = brush.polygons[i].vertices;
+		for (int j = 0; j < vertices.size(); j++)
+		{
+			glm::dvec3 edge = glm::dvec3(vertices[(j + 1) % vertices.size()]) - glm::dvec3(vertices[j]);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				glm::dvec3 axisVector = glm::dvec3(0);
+				axisVector[axis] = 1;
+				AddBruteForcePlane(planes, brush, axisVector);
+				AddBruteForcePlane(planes, brush, -axisVector);
+				AddBruteForcePlane(planes, brush, glm::cross(edge, axisVector));
+				AddBruteForcePlane(planes, brush, -glm::cross(edge, axisVector));
+			}
+		}
+	}
+	return planes;
+}
+
+
+// quake's CM_ClipBoxToBrush against the planes of one brush
+void BruteForceClipBox(std::vector<BruteForcePlane>& planes, RecordedTrace& trace, TraceResult* result)
+{
+	if (planes.size() == 0)
+	{
+		return;
+	}
+
+	double enterFraction = -1;
+	double leaveFraction = 1;
+	bool startsOut = false;
+	bool endsOut = false;
+	BruteForcePlane* clipPlane = NULL;
+
+	for (int i = 0; i < planes.size(); i++)
+	{
+		BruteForcePlane& plane = planes[i];
+
+		// the corner of the box that gets to the plane first
+		glm::dvec3 offset;
+		for (int j = 0; j < 3; j++)
+		{
+			offset[j] = plane.normal[j] < 0 ? trace.maxs[j] : trace.mins[j];
+		}
+		double distance = plane.distance - glm::dot(offset, plane.normal);
+		double startDist = glm::dot(glm::dvec3(trace.start), plane.normal) - distance;
+		double endDist = glm::dot(glm::dvec3(trace.end), plane.normal) - distance;
+
+		startsOut = startsOut || startDist > 0;
+		endsOut = endsOut || endDist > 0;
+		if (startDist > 0 && endDist > 0)
+		{
+			return;
+		}
+		if (startDist <= 0 && endDist <= 0)
+		{
+			continue;
+		}
+
+		if (startDist > endDist)
+		{
+			double fraction = (startDist - DIST_EPSILON) / (startDist - endDist);
+			if (fraction > enterFraction)
+			{
+				enterFraction = fraction;
+				clipPlane = &plane;
+			}
+		}
+		else
+		{
+			leaveFraction = std::min(leaveFraction, (startDist + DIST_EPSILON) / (startDist - endDist));
+		}
+	}
+
+	if (!startsOut)
+	{
+		result->outputStartsOut = false;
+		result->outputAllSolid = result->outputAllSolid || !endsOut;
+		return;
+	}
+
+	if (enterFraction < leaveFraction && enterFraction > -1 && enterFraction < result->timeFraction)
+	{
+		result->timeFraction = (float)std::max(0.0, enterFraction);
+		result->plane.normal = glm::vec3(clipPlane->normal);
+		result->plane.distance = (float)clipPlane->distance;
+	}
+}
+
+
+// every brush, no tree, no bounds and no stopping early
+TraceResult BruteForceBoxTrace(RecordedTrace& trace, std::vector<std::vector<BruteForcePlane>>& brushPlanes)
+{
+	TraceResult result = {};
+	result.timeFraction = 1;
+	result.outputStartsOut = true;
+	result.outputAllSolid = false;
+
+	for (int i = 0; i < brushPlanes.size(); i++)
+	{
+		BruteForceClipBox(brushPlanes[i], trace, &result);
+	}
+
+	result.endPos = trace.start + result.timeFraction * (trace.end - trace.start);
+	return result;
+}
+
+
+bool IsBetween(float value, float a, float b)
+{
+	return std::min(a, b) <= value && value <= std::max(a, b);
+}
+
+
+// true if result is somewhere between what the brute force gets with the box a margin bigger and smaller
+bool IsGrazingTraceResult(TraceResult& result, RecordedTrace& trace, std::vector<std::vector<BruteForcePlane>>& brushPlanes)
+{
+	glm::vec3 margin = glm::vec3(TRACE_HARNESS_GRAZE_MARGIN);
+
+	RecordedTrace biggerTrace = { trace.start, trace.end, trace.mins - margin, trace.maxs + margin };
+	RecordedTrace smallerTrace = { trace.start, trace.end, trace.mins + margin, trace.maxs - margin };
+	TraceResult bigger = BruteForceBoxTrace(biggerTrace, brushPlanes);
+	TraceResult smaller = BruteForceBoxTrace(smallerTrace, brushPlanes);
+
+	// TRACE_MATCH_DISTANCE along this trace
+	float length = glm::distance(trace.start, trace.end);
+	float fractionEpsilon = length > 0 ? TRACE_MATCH_DISTANCE / length : 1;
+
+	return IsBetween(result.timeFraction, bigger.timeFraction - fractionEpsilon, smaller.timeFraction + fractionEpsilon) &&
+		(result.outputStartsOut == bigger.outputStartsOut || result.outputStartsOut == smaller.outputStartsOut) &&
+		(result.outputAllSolid == bigger.outputAllSolid || result.outputAllSolid == smaller.outputAllSolid);
+}
+
+
+void PrintTraceHarnessMismatch(const char* name, int index, RecordedTrace& trace, TraceResult& result, TraceResult& bruteResult)
+{
+	printf("	%s %d: start (%g %g %g) end (%g %g %g) box (%g %g %g) (%g %g %g)\n", name, index, 
+		trace.start.x, trace.start.y, trace.start.z, trace.end.x, trace.end.y, trace.end.z,
+		trace.mins.x, trace.mins.y, trace.mins.z, trace.maxs.x, trace.maxs.y, trace.maxs.z);
+	printf("		bsp %f startsOut %d allSolid %d, brute force %f startsOut %d allSolid %d\n",
+		result.timeFraction, result.outputStartsOut, result.outputAllSolid,
+		bruteResult.timeFraction, bruteResult.outputStartsOut, bruteResult.outputAllSolid);
+}
+
+
+struct TraceHarnessCounts
+{
+	int numHits;
+	int numAtStart;
+	int numGrazing;
+	int numMismatches;
+};
+
+
+// sorts out the results that dont match the brute force's, prints the first few that are mismatches
+TraceHarnessCounts CountTraceHarnessMismatches(TraceHarnessSet* set, std::vector<TraceResult>& results, 
+	std::vector<TraceResult>& bruteResults, std::vector<std::vector<BruteForcePlane>>& brushPlanes)
+{
+	std::vector<RecordedTrace>& traces = set->corpus.traces;
+
+	TraceHarnessCounts counts = {};
+	for (int i = 0; i < traces.size(); i++)
+	{
+		counts.numHits += results[i].timeFraction < 1;
+		if (TraceResultsMatch(results[i], bruteResults[i]))
+		{
+			continue;
+		}
+
+		if (results[i].timeFraction == 0 && bruteResults[i].timeFraction == 0 && results[i].outputAllSolid == bruteResults[i].outputAllSolid)
+		{
+			counts.numAtStart++;
+			continue;
+		}
+
+		if (IsGrazingTraceResult(results[i], traces[i], brushPlanes))
+		{
+			counts.numGrazing++;
+			continue;
+		}
+
+		if (counts.numMismatches < TRACE_HARNESS_MAX_PRINTED_MISMATCHES)
+		{
+			PrintTraceHarnessMismatch(set->name.c_str(), i, traces[i], results[i], bruteResults[i]);
+		}
+		counts.numMismatches++;
+	}
+	return counts;
+}
+
+
+// one thread and no timing, for checking a model over and over
+TraceHarnessCounts CheckTraceHarnessSet(TraceHarnessSet* set, std::vector<std::vector<BruteForcePlane>>& brushPlanes)
+{
+	std::vector<RecordedTrace>& traces = set->corpus.traces;
+
+	std::vector<TraceResult> bruteResults(traces.size());
+	std::vector<TraceResult> results(traces.size());
+	for (int i = 0; i < traces.size(); i++)
+	{
+		bruteResults[i] = BruteForceBoxTrace(traces[i], brushPlanes);
+		results[i] = TraceHarnessTrace(set, traces[i]);
+	}
+	return CountTraceHarnessMismatches(set, results, bruteResults, brushPlanes);
+}
+
+
+// returns the number of mismatches with the brute force, and of threaded results that came out different
+int RunTraceHarnessSet(TraceHarnessSet* set, std::vector<std::vector<BruteForcePlane>>& brushPlanes, PlatformWorkQueue* queue)
+{
+	const char* name = set->name.c_str();
+	std::vector<RecordedTrace>& traces = set->corpus.traces;
+	int numTraces = traces.size();
+	if (numTraces == 0)
+	{
+		printf("%-10s no traces\n", name);
+		return 0;
+	}
+
+	std::vector<TraceResult> bruteResults(numTraces);
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < numTraces; i++)
+	{
+		bruteResults[i] = BruteForceBoxTrace(traces[i], brushPlanes);
+	}
+	double bruteTracesPerSecond = GetTracesPerSecond(numTraces, startTime);
+
+	std::vector<TraceResult> results(numTraces);
+	startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < numTraces; i++)
+	{
+		results[i] = TraceHarnessTrace(set, traces[i]);
+	}
+	double tracesPerSecond = GetTracesPerSecond(numTraces, startTime);
+
+	// all jobs go in before any are queued, the queue holds pointers into this
+	std::vector<TraceResult> threadedResults(numTraces);
+	std::vector<TraceHarnessJob> jobs;
+	for (int first = 0; first < numTraces; first += TRACE_HARNESS_JOB_SIZE)
+	{
+		TraceHarnessJob job;
+		job.set = set;
+		job.traces = &traces[first];
+		job.results = &threadedResults[first];
+		job.numTraces = std::min(TRACE_HARNESS_JOB_SIZE, numTraces - first);
+		jobs.push_back(job);
+	}
+
+	startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < jobs.size(); i++)
+	{
+		AddWorkQueueEntry(queue, DoTraceHarnessJob, &jobs[i]);
+	}
+	CompleteAllWork(queue);
+	double threadedTracesPerSecond = GetTracesPerSecond(numTraces, startTime);
+
+	int numThreadedDifferent = 0;
+	for (int i = 0; i < numTraces; i++)
+	{
+		numThreadedDifferent += !TraceResultsIdentical(results[i], threadedResults[i]);
+	}
+
+	TraceHarnessCounts counts = CountTraceHarnessMismatches(set, results, bruteResults, brushPlanes);
+	printf("%-10s %8d %8d %8d %8d %8d %12.0f %12.0f %12.0f %8.2fx %8d\n", name, numTraces, counts.numHits, counts.numAtStart, 
+		counts.numGrazing, counts.numMismatches, bruteTracesPerSecond, tracesPerSecond, threadedTracesPerSecond, 
+		threadedTracesPerSecond / tracesPerSecond, numThreadedDifferent);
+	return counts.numMismatches + numThreadedDifferent;
+}
+
+
+int TraceHarnessCommand(int argc, char *argv[])
+{
+	LevelId level;
+	if (argc < 3 || !ParseLevelId(argv[2], &level))
+	{
+		PrintUsage();
+		return(1);
+	}
+
+	int numTraces = 20000;
+	int numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	const char* tracesFile = NULL;
+	for (int i = 3; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-traces") == 0 && i + 1 < argc)
+		{
+			tracesFile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+		{
+			numThreads = std::max(1, atoi(argv[++i]));
+		}
+		else if (argv[i][0] != '-')
+		{
+			numTraces = atoi(argv[i]);
+		}
+		else
+		{
+			PrintUsage();
+			return(1);
+		}
+	}
+
+	World* world = LoadLevelWorld(level);
+	BSPCollisionModel* model = &world->collisionModel;
+
+	TraceCorpus recorded;
+	if (tracesFile)
+	{
+		if (!ReadTraceCorpus(tracesFile, &recorded))
+		{
+			std::cout << "could not read " << tracesFile << std::endl;
+			FreeBSPTree(world->bspRoot);
+			delete world;
+			return(1);
+		}
+	}
+	else
+	{
+		// without a recording, players walking around the level stand in for one
+		recorded = CreatePlayerTraceCorpus(model, world->brushes, numTraces);
+	}
+
+	std::vector<TraceHarnessSet> sets;
+	TraceBenchmark benchmark = CreateTraceBenchmark(*GetBSPModelBounds(model, model->root), numTraces);
+	TraceCorpus boxes = GetBenchmarkTraces(&benchmark);
+
+	benchmark.mins = glm::vec3(0);
+	benchmark.maxs = glm::vec3(0);
+	sets.push_back({ "segments", model, false, GetBenchmarkTraces(&benchmark) });
+	sets.push_back({ "boxes", model, false, boxes });
+	sets.push_back({ "recorded", model, false, recorded });
+
+	// the same traces with the box of each hull, through the hull
+	for (int i = 0; i < world->numHulls; i++)
+	{
+		BSPHull* hull = &world->hulls[i];
+		benchmark.mins = hull->size.mins;
+		benchmark.maxs = hull->size.maxs;
+		sets.push_back({ "hull " + std::to_string(i), &hull->model, true, GetBenchmarkTraces(&benchmark) });
+
+		TraceHarnessSet hullRecorded = { "hull " + std::to_string(i) + " rec", &hull->model, true, TraceCorpus() };
+		for (int j = 0; j < recorded.traces.size(); j++)
+		{
+			if (IsHullSize(hull->size, recorded.traces[j].mins, recorded.traces[j].maxs))
+			{
+				hullRecorded.corpus.traces.push_back(recorded.traces[j]);
+			}
+		}
+		sets.push_back(hullRecorded);
+	}
+
+	std::vector<std::vector<BruteForcePlane>> brushPlanes;
+	for (int i = 0; i < world->brushes.size(); i++)
+	{
+		brushPlanes.push_back(GetBruteForceBrushPlanes(world->brushes[i]));
+	}
+
+	PlatformWorkQueue* queue = new PlatformWorkQueue();
+	StartWorkQueue(queue, numThreads);
+
+	printf("%d brushes, %d threads\n", model->numBrushes, numThreads);
+	printf("%-10s %8s %8s %8s %8s %8s %12s %12s %12s %9s %8s\n", "traces", "count", "hits", "at start", "grazing", "mismatch", 
+		"brute/s", "1 thread/s", "threads/s", "speedup", "differ");
+
+	int numFailed = 0;
+	for (int i = 0; i < sets.size(); i++)
+	{
+		numFailed += RunTraceHarnessSet(&sets[i], brushPlanes, queue);
+	}
+
+	StopWorkQueue(queue);
+	delete queue;
+
+	FreeBSPTree(world->bspRoot);
+	delete world;
+	return numFailed == 0 ? 0 : 1;
+}
+
+
+/*
+	Brush edits without a client. Makes random adds, removes and moves through the same
+	AddWorldBrush, RemoveWorldBrush and MoveWorldBrush the game uses, and after each one checks
+	what got patched against world->brushes:
+
+	-	the tree and every hull, with the trace harness's brute force
+	-	that the PVS is still conservative: two points in the open with nothing between them
+		have to be in leaves that can see each other
+
+	Full rebuilds go on a queue like the game's low priority one, and the edits keep coming
+	while they run. Halfway through one is started by hand, so swapping a rebuild in with
+	edits patched on top of it gets checked even when nothing triggered one.
+*/
+const float EDIT_BSP_MAX_OFFSET = 64.0f;
+
+enum BrushEdit
+{
+	BRUSH_EDIT_ADD,
+	BRUSH_EDIT_REMOVE,
+	BRUSH_EDIT_MOVE,
+	NUM_BRUSH_EDITS
+};
+
+const char* brushEditNames[NUM_BRUSH_EDITS] = { "add", "remove", "move" };
+
+
+// -1 if every brush was removed
+int GetRandomLiveBrush(World* world, std::mt19937& rng)
+{
+	std::vector<int> live;
+	for (int i = 0; i < world->brushes.size(); i++)
+	{
+		if (world->brushes[i].polygons.size() > 0)
+		{
+			live.push_back(i);
+		}
+	}
+	return live.size() > 0 ? live[rng() % live.size()] : -1;
+}
+
+
+// returns the brush it edited
+int MakeRandomBrushEdit(World* world, BrushEdit edit, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> distOffset(-EDIT_BSP_MAX_OFFSET, EDIT_BSP_MAX_OFFSET);
+	glm::vec3 offset = glm::vec3(distOffset(rng), distOffset(rng), distOffset(rng));
+
+	int brushIndex = GetRandomLiveBrush(world, rng);
+	if (brushIndex == -1)
+	{
+		return -1;
+	}
+
+	switch (edit)
+	{
+		case BRUSH_EDIT_ADD:
+		{
+			// a copy of one that is there, nudged somewhere else. It has no entity to show it
+			Brush brush = world->brushes[brushIndex];
+			brush.entityIndex = -1;
+			TranslateBrush(brush, offset);
+			return AddWorldBrush(world, brush);
+		}
+		case BRUSH_EDIT_REMOVE:
+			RemoveWorldBrush(world, brushIndex);
+			return brushIndex;
+		case BRUSH_EDIT_MOVE:
+			MoveWorldBrush(world, brushIndex, offset);
+			return brushIndex;
+		default:
+			assert(false);
+			return -1;
+	}
+}
+
+
+// the pairs that see each other in world->brushes, and how many of those the PVS culls
+void CheckPVSSightLines(World* world, TraceCorpus* pairs, std::vector<std::vector<BruteForcePlane>>& brushPlanes,
+	int* numSightLines, int* numCulled)
+{
+	BSPCollisionModel* model = &world->collisionModel;
+	BoundingBox bounds = *GetBSPModelBounds(model, model->root);
+
+	*numSightLines = 0;
+	*numCulled = 0;
+	for (int i = 0; i < pairs->traces.size(); i++)
+	{
+		// vis only knows about the inside of the world's bounds
+		RecordedTrace& pair = pairs->traces[i];
+		BoundingBox pairBounds = { glm::min(pair.start, pair.end), glm::max(pair.start, pair.end) };
+		if (!ContainsBoundingBox(bounds, pairBounds))
+		{
+			continue;
+		}
+
+		TraceResult sight = BruteForceBoxTrace(pair, brushPlanes);
+		if (!sight.outputStartsOut || sight.timeFraction < 1)
+		{
+			continue;
+		}
+
+		(*numSightLines)++;
+		*numCulled += !IsLeafPotentiallyVisible(model, PointInLeaf(model, pair.start), PointInLeaf(model, pair.end));
+	}
+}
+
+
+int EditBSPCommand(int argc, char *argv[])
+{
+	LevelId level;
+	if (argc < 3 || !ParseLevelId(argv[2], &level))
+	{
+		PrintUsage();
+		return(1);
+	}
+
+	int numEdits = argc > 3 ? atoi(argv[3]) : 40;
+	int numTraces = argc > 4 ? atoi(argv[4]) : 2000;
+
+	World* world = LoadLevelWorld(level);
+	BSPCollisionModel* model = &world->collisionModel;
+
+	// one worker for the rebuilds, the main thread keeps editing
+	PlatformWorkQueue* queue = new PlatformWorkQueue();
+	StartWorkQueue(queue, 2);
+	world->rebuildQueue = queue;
+	world->addWorkQueueEntry = AddWorkQueueEntry;
+
+	// the traces stay where the level was before the edits
+	std::vector<TraceHarnessSet> sets;
+	TraceBenchmark benchmark = CreateTraceBenchmark(*GetBSPModelBounds(model, model->root), numTraces);
+	sets.push_back({ "boxes", model, false, GetBenchmarkTraces(&benchmark) });
+	sets.push_back({ "recorded", model, false, CreatePlayerTraceCorpus(model, world->brushes, numTraces) });
+	for (int i = 0; i < world->numHulls; i++)
+	{
+		BSPHull* hull = &world->hulls[i];
+		benchmark.mins = hull->size.mins;
+		benchmark.maxs = hull->size.maxs;
+		sets.push_back({ "hull " + std::to_string(i), &hull->model, true, GetBenchmarkTraces(&benchmark) });
+	}
+
+	benchmark.mins = glm::vec3(0);
+	benchmark.maxs = glm::vec3(0);
+	TraceCorpus sightPairs = GetBenchmarkTraces(&benchmark);
+
+	printf("%d brushes, %d edits, %d traces a set\n", (int)world->brushes.size(), numEdits, numTraces);
+	printf("%-6s %-8s %6s %8s %10s %10s %8s %8s %10s\n", "edit", "op", "brush", "leaves", "rebuilding", "pvs", 
+		"sight", "culled", "mismatch");
+
+	std::mt19937 rng(1234);
+	int numFailed = 0;
+	for (int i = 0; i <= numEdits; i++)
+	{
+		// the last one is after the last rebuild is in
+		BrushEdit edit = (BrushEdit)(rng() % NUM_BRUSH_EDITS);
+		int brushIndex = -1;
+		if (i < numEdits)
+		{
+			brushIndex = MakeRandomBrushEdit(world, edit, rng);
+			if (i == numEdits / 2)
+			{
+				StartWorldRebuild(world);
+			}
+		}
+		else
+		{
+			CompleteAllWork(queue);
+		}
+		UpdateWorldRebuild(world);
+
+		std::vector<std::vector<BruteForcePlane>> brushPlanes;
+		for (int j = 0; j < world->brushes.size(); j++)
+		{
+			brushPlanes.push_back(GetBruteForceBrushPlanes(world->brushes[j]));
+		}
+
+		int numMismatches = 0;
+		for (int j = 0; j < sets.size(); j++)
+		{
+			numMismatches += CheckTraceHarnessSet(&sets[j], brushPlanes).numMismatches;
+		}
+
+		int numSightLines, numCulled;
+		CheckPVSSightLines(world, &sightPairs, brushPlanes, &numSightLines, &numCulled);
+		numFailed += numMismatches + numCulled;
+
+		printf("%-6d %-8s %6d %8d %10s %10.2f %8d %8d %10d\n", i, i < numEdits ? brushEditNames[edit] : "final", brushIndex, 
+			world->tree.numLiveLeaves, world->rebuildJob ? "yes" : "no", GetPVSDensity(&world->tree), numSightLines, numCulled, 
+			numMismatches);
+	}
+
+	CompleteAllWork(queue);
+	UpdateWorldRebuild(world);
+	world->rebuildQueue = NULL;
+	StopWorkQueue(queue);
+	delete queue;
+
+	FreeBSPTree(world->bspRoot);
+	delete world;
+	return numFailed == 0 ? 0 : 1;
+}
+
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return(1);
+	}
+
+	NULL_PLANE = Plane();
+	NULL_PLANE.normal = glm::vec3(0);
+
+	if (strcmp(argv[1], "-compare_split_cost") == 0)
+	{
+		return CompareSplitCostCommand(argc, argv);
+	}
+	else if (strcmp(argv[1], "-bsp_report") == 0)
+	{
+		return BSPReportCommand(argc, argv);
+	}
+	else if (strcmp(argv[1], "-compare_collision") == 0)
+	{
+		return CompareCollisionCommand(argc, argv);
+	}
+	else if (strcmp(argv[1], "-trace_stats") == 0)
+	{
+		return TraceStatsCommand(argc, argv);
+	}
+	else if (strcmp(argv[1], "-compile_bsp") == 0)
+	{
+		return CompileBSPCommand(argc, argv);
+	}
+	else if (strcmp(argv[1], "-move_entities") == 0)
+	{
+		return MoveEntitiesCommand(argc, argv);
+	}
+	else if (strcmp(argv[1], "-trace_harness") == 0)
+	{
+		return TraceHarnessCommand(argc, argv);
+	}
+	else if (strcmp(argv[1], "-edit_bsp") == 0)
+	{
+		return EditBSPCommand(argc, argv);
+	}
+
+	PrintUsage();
+	return(1);
+}
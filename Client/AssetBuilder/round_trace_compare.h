@@ -0,0 +1,380 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+
+#include "collision_compare.h"
+
+
+/*
+	Round traces checked against what they mean rather than against another backend, in
+	double and straight from the polygons of world->brushes.
+
+	The capsule touches a brush when its axis, the segment from halfHeight below to halfHeight
+	above the center, is within radius of it. Distance from a segment to a convex brush is 0
+	if the segment goes into the brush, otherwise the closest of
+		- an end of the segment to the inside of a polygon
+		- the segment to an edge of a polygon
+	Sweeping the capsule slides that segment along a line, so its distance to a brush is convex
+	in the fraction. The first fraction it gets down to radius is found by searching for the
+	smallest distance, and then bisecting between start and there.
+*/
+
+// closest points of two segments, Real Time Collision Detection 5.1.9
+double GetSegmentDistance(glm::dvec3 p1, glm::dvec3 q1, glm::dvec3 p2, glm::dvec3 q2)
+{
+	glm::dvec3 d1 = q1 - p1;
+	glm::dvec3 d2 = q2 - p2;
+	glm::dvec3 r = p1 - p2;
+	double a = glm::dot(d1, d1);
+	double e = glm::dot(d2, d2);
+	double f = glm::dot(d2, r);
+
+	double s = 0;
+	double t = 0;
+	if (a == 0 && e != 0)
+	{
+		t = glm::clamp(f / e, 0.0, 1.0);
+	}
+	else if (a != 0)
+	{
+		double c = glm::dot(d1, r);
+		if (e == 0)
+		{
+			s = glm::clamp(-c / a, 0.0, 1.0);
+		}
+		else
+		{
+			double b = glm::dot(d1, d2);
+			double denominator = a * e - b * b;
+			s = denominator > 0 ? glm::clamp((b * f - c * e) / denominator, 0.0, 1.0) : 0;
+			t = (b * s + f) / e;
+			if (t < 0)
+			{
+				t = 0;
+				s = glm::clamp(-c / a, 0.0, 1.0);
+			}
+			else if (t > 1)
+			{
+				t = 1;
+				s = glm::clamp((b - c) / a, 0.0, 1.0);
+			}
+		}
+	}
+	return glm::length(p1 + s * d1 - (p2 + t * d2));
+}
+
+
+// whether point is over the inside of the polygon, seen along its normal. The winding isnt
+// trusted, the point only has to be on the same side of every edge
+bool IsOverPolygon(BspPolygon& polygon, glm::dvec3 point)
+{
+	glm::dvec3 normal = glm::dvec3(polygon.plane.normal);
+	bool left = false;
+	bool right = false;
+	for (int i = 0; i < polygon.vertices.size(); i++)
+	{
+		glm::dvec3 a = glm::dvec3(polygon.vertices[i]);
+		glm::dvec3 b = glm::dvec3(polygon.vertices[(i + 1) % polygon.vertices.size()]);
+		double side = glm::dot(glm::cross(b - a, point - a), normal);
+		left = left || side > 0;
+		right = right || side < 0;
+	}
+	return !(left && right);
+}
+
+
+double GetSegmentPolygonDistance(glm::dvec3 p, glm::dvec3 q, BspPolygon& polygon)
+{
+	glm::dvec3 normal = glm::dvec3(polygon.plane.normal);
+	double pDist = glm::dot(normal, p) - polygon.plane.distance;
+	double qDist = glm::dot(normal, q) - polygon.plane.distance;
+
+	// goes through it
+	if ((pDist < 0) != (qDist < 0) && pDist != qDist && IsOverPolygon(polygon, p + (pDist / (pDist - qDist)) * (q - p)))
+	{
+		return 0;
+	}
+
+	double distance = DBL_MAX;
+	if (IsOverPolygon(polygon, p))
+	{
+		distance = fabs(pDist);
+	}
+	if (IsOverPolygon(polygon, q))
+	{
+		distance = std::min(distance, fabs(qDist));
+	}
+
+	for (int i = 0; i < polygon.vertices.size(); i++)
+	{
+		glm::dvec3 a = glm::dvec3(polygon.vertices[i]);
+		glm::dvec3 b = glm::dvec3(polygon.vertices[(i + 1) % polygon.vertices.size()]);
+		distance = std::min(distance, GetSegmentDistance(p, q, a, b));
+	}
+	return distance;
+}
+
+
+// the polygon normals point out of the brush
+bool SegmentEntersBrush(glm::dvec3 p, glm::dvec3 q, Brush& brush)
+{
+	double minT = 0;
+	double maxT = 1;
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		glm::dvec3 normal = glm::dvec3(brush.polygons[i].plane.normal);
+		double pDist = glm::dot(normal, p) - brush.polygons[i].plane.distance;
+		double qDist = glm::dot(normal, q) - brush.polygons[i].plane.distance;
+		if (pDist > 0 && qDist > 0)
+		{
+			return false;
+		}
+
+		if (pDist > 0)
+		{
+			minT = std::max(minT, pDist / (pDist - qDist));
+		}
+		else if (qDist > 0)
+		{
+			maxT = std::min(maxT, pDist / (pDist - qDist));
+		}
+	}
+	return minT <= maxT;
+}
+
+
+// distance from the axis of the capsule centered at center to the brush
+double GetCapsuleBrushDistance(glm::dvec3 center, double halfHeight, Brush& brush)
+{
+	glm::dvec3 p = center - glm::dvec3(0, halfHeight, 0);
+	glm::dvec3 q = center + glm::dvec3(0, halfHeight, 0);
+	if (SegmentEntersBrush(p, q, brush))
+	{
+		return 0;
+	}
+
+	double distance = DBL_MAX;
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		distance = std::min(distance, GetSegmentPolygonDistance(p, q, brush.polygons[i]));
+	}
+	return distance;
+}
+
+
+struct ExactRoundTrace
+{
+	double fraction;		// first touch, 1 if nothing is touched
+	bool startsOut;
+	bool allSolid;
+	int brushIndex;			// the brush touched first, -1 for none
+};
+
+
+const int EXACT_ROUND_TRACE_ITERATIONS = 64;
+
+// tolerance is how far into a brush still counts as just touching it. Only brushes the trace
+// goes further into than that are hits
+ExactRoundTrace GetExactRoundTrace(std::vector<Brush>& brushes, glm::vec3 start, glm::vec3 end, float radius, float halfHeight, double tolerance)
+{
+	ExactRoundTrace trace;
+	trace.fraction = 1;
+	trace.startsOut = true;
+	trace.allSolid = false;
+	trace.brushIndex = -1;
+
+	glm::dvec3 dStart = glm::dvec3(start);
+	glm::dvec3 delta = glm::dvec3(end) - dStart;
+	double reach = radius - tolerance;
+
+	glm::vec3 extents = glm::vec3(radius, radius + halfHeight, radius) + glm::vec3(1);
+	BoundingBox swept = EmptyBoundingBox();
+	AddPointToBoundingBox(swept, start - extents);
+	AddPointToBoundingBox(swept, start + extents);
+	AddPointToBoundingBox(swept, end - extents);
+	AddPointToBoundingBox(swept, end + extents);
+
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		Brush& brush = brushes[i];
+		if (brush.polygons.size() == 0 || !BoundingBoxesOverlap(swept, brush.GetBoundingBox()))
+		{
+			continue;
+		}
+
+		if (GetCapsuleBrushDistance(dStart, halfHeight, brush) < reach)
+		{
+			trace.startsOut = false;
+			trace.allSolid = trace.allSolid || GetCapsuleBrushDistance(dStart + delta, halfHeight, brush) < reach;
+			continue;
+		}
+
+		// the smallest distance along the trace
+		double low = 0;
+		double high = 1;
+		for (int j = 0; j < EXACT_ROUND_TRACE_ITERATIONS; j++)
+		{
+			double a = low + (high - low) / 3;
+			double b = high - (high - low) / 3;
+			if (GetCapsuleBrushDistance(dStart + a * delta, halfHeight, brush) < GetCapsuleBrushDistance(dStart + b * delta, halfHeight, brush))
+			{
+				high = b;
+			}
+			else
+			{
+				low = a;
+			}
+		}
+
+		double closest = (low + high) / 2;
+		if (closest >= trace.fraction || GetCapsuleBrushDistance(dStart + closest * delta, halfHeight, brush) >= reach)
+		{
+			continue;
+		}
+
+		// and where it first gets to radius on the way there
+		low = 0;
+		high = closest;
+		for (int j = 0; j < EXACT_ROUND_TRACE_ITERATIONS; j++)
+		{
+			double middle = (low + high) / 2;
+			if (GetCapsuleBrushDistance(dStart + middle * delta, halfHeight, brush) <= radius)
+			{
+				high = middle;
+			}
+			else
+			{
+				low = middle;
+			}
+		}
+
+		if (high < trace.fraction)
+		{
+			trace.fraction = high;
+			trace.brushIndex = i;
+		}
+	}
+	return trace;
+}
+
+
+// any side of the brush that isnt axial
+bool IsBrushSlanted(Brush& brush)
+{
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		if (!IsAxialPlane(brush.polygons[i].plane))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/*
+	SphereTrace and CapsuleTrace against GetExactRoundTrace. Half the traces are aimed at the
+	corners of brushes, so the rounded parts get hit as well as the faces. Counted as wrong:
+		late	went on past where the exact trace touched
+		early	stopped short with nothing within radius + DIST_EPSILON of the capsule
+		solid	starting or staying in solid disagrees
+	all measured as distances. Float slop of ROUND_TRACE_TOLERANCE, plus a little more the
+	longer the trace, is let through. A trace stopped dead at 0 stops looking at brushes, like
+	quake's, so it may never get to the one it started in. Those only have to be touching one.
+	slanted is how many hits the exact trace had on a brush with a side that isnt axial.
+*/
+const double ROUND_TRACE_TOLERANCE = 0.01;
+const double ROUND_TRACE_LENGTH_TOLERANCE = 1e-5;
+
+void CompareRoundTraces(World* world, int numTraces)
+{
+	BoundingBox bounds = *GetBSPModelBounds(&world->collisionModel, world->collisionModel.root);
+	TraceBenchmark benchmark = CreateTraceBenchmark(bounds, numTraces);
+
+	std::vector<glm::vec3> corners;
+	for (int i = 0; i < world->brushes.size(); i++)
+	{
+		for (int j = 0; j < world->brushes[i].polygons.size(); j++)
+		{
+			std::vector<glm::vec3>& vertices = world->brushes[i].polygons[j].vertices;
+			corners.insert(corners.end(), vertices.begin(), vertices.end());
+		}
+	}
+
+	std::mt19937 rng(5678);
+	std::uniform_real_distribution<float> distNear(-12, 12);
+	for (int i = 0; i < benchmark.ends.size() && corners.size() > 0; i += 2)
+	{
+		glm::vec3 corner = corners[rng() % corners.size()];
+		benchmark.ends[i] = corner + glm::vec3(distNear(rng), distNear(rng), distNear(rng));
+	}
+
+	const int NUM_SETS = 2;
+	const char* setNames[NUM_SETS] = { "sphere", "capsule" };
+	float setRadius[NUM_SETS] = { 8, 6 };
+	float setHalfHeight[NUM_SETS] = { 0, 12 };
+
+	printf("%-10s %12s %10s %10s %10s %10s %10s\n", "round", "traces/s", "hits", "slanted", "late", "early", "solid");
+	for (int i = 0; i < NUM_SETS; i++)
+	{
+		float radius = setRadius[i];
+		float halfHeight = setHalfHeight[i];
+		int count = benchmark.starts.size();
+
+		std::vector<TraceResult> results(count);
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (int j = 0; j < count; j++)
+		{
+			results[j] = CapsuleTrace(benchmark.starts[j], benchmark.ends[j], radius, halfHeight, &world->collisionModel);
+		}
+		double tracesPerSecond = GetTracesPerSecond(count, startTime);
+
+		int numHits = 0, numSlanted = 0, numLate = 0, numEarly = 0, numSolid = 0;
+		for (int j = 0; j < count; j++)
+		{
+			TraceResult& result = results[j];
+			glm::vec3 start = benchmark.starts[j];
+			glm::vec3 end = benchmark.ends[j];
+			double length = glm::length(glm::dvec3(end) - glm::dvec3(start));
+			double tolerance = ROUND_TRACE_TOLERANCE + ROUND_TRACE_LENGTH_TOLERANCE * length;
+
+			// inside by more than the tolerance has to be solid, solid cant be further out than it
+			ExactRoundTrace inside = GetExactRoundTrace(world->brushes, start, end, radius, halfHeight, tolerance);
+			ExactRoundTrace touching = GetExactRoundTrace(world->brushes, start, end, radius, halfHeight, -tolerance);
+			bool stoppedDead = result.timeFraction == 0 && result.outputStartsOut;
+			if (!stoppedDead && ((!inside.startsOut && result.outputStartsOut) || (!result.outputStartsOut && touching.startsOut) ||
+				(inside.allSolid && !result.outputAllSolid) || (result.outputAllSolid && !touching.allSolid)))
+			{
+				numSolid++;
+				continue;
+			}
+			if (!result.outputStartsOut)
+			{
+				continue;
+			}
+
+			numHits += result.timeFraction < 1;
+			numSlanted += inside.fraction < 1 && IsBrushSlanted(world->brushes[inside.brushIndex]);
+			if ((result.timeFraction - inside.fraction) * length > tolerance)
+			{
+				numLate++;
+			}
+			else if (result.timeFraction < 1)
+			{
+				glm::dvec3 center = glm::dvec3(start) + (double)result.timeFraction * (glm::dvec3(end) - glm::dvec3(start));
+				double distance = DBL_MAX;
+				for (int k = 0; k < world->brushes.size(); k++)
+				{
+					if (world->brushes[k].polygons.size() > 0)
+					{
+						distance = std::min(distance, GetCapsuleBrushDistance(center, halfHeight, world->brushes[k]));
+					}
+				}
+				numEarly += distance > radius + DIST_EPSILON + tolerance;
+			}
+		}
+
+		printf("%-10s %12.0f %10d %10d %10d %10d %10d\n", setNames[i], tracesPerSecond, numHits, numSlanted, numLate, numEarly, numSolid);
+	}
+}
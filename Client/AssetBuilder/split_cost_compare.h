@@ -0,0 +1,273 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include "collision_compare.h"
+
+
+// returns traces per second
+float MeasureTraceThroughput(BSPCollisionModel* model, int numTraces)
+{
+	TraceBenchmark benchmark = CreateTraceBenchmark(*GetBSPModelBounds(model, model->root), numTraces);
+	numTraces = benchmark.starts.size();
+
+	int numHits = 0;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < numTraces; i++)
+	{
+		TraceResult result = BoxTrace(benchmark.starts[i], benchmark.ends[i], benchmark.mins, benchmark.maxs, model);
+		numHits += result.timeFraction < 1;
+	}
+	float tracesPerSecond = GetTracesPerSecond(numTraces, startTime);
+
+	std::cout << "	" << numHits << " / " << numTraces << " traces hit" << std::endl;
+	return tracesPerSecond;
+}
+
+
+/*
+	Stand in for a recorded corpus. Players dropped on top of random brushes walk around, 
+	turning a bit every step and a lot when they run into something, issuing the same traces 
+	the game does each frame: the CatagorizePosition down trace and the move. 
+	model is only used to move the players around, any tree of the level will do.
+*/
+TraceCorpus CreatePlayerTraceCorpus(BSPCollisionModel* model, std::vector<Brush>& brushes, int numTraces)
+{
+	const int MAX_WALK_STEPS = 200;
+	const float MOVE_DISTANCE = 40.0f * 0.1f;
+	const float GROUND_TRACE_DISTANCE = 0.25f;
+
+	TraceCorpus corpus;
+
+	std::vector<int> liveBrushes;
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		if (brushes[i].polygons.size() > 0)
+		{
+			liveBrushes.push_back(i);
+		}
+	}
+
+	BoundingBox* worldBounds = GetBSPModelBounds(model, model->root);
+	if (liveBrushes.size() == 0 || IsBoundingBoxEmpty(*worldBounds))
+	{
+		return corpus;
+	}
+
+	glm::vec3 mins = glm::vec3(-10, -10, -10);
+	glm::vec3 maxs = glm::vec3(10, 10, 10);
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> dist01(0, 1);
+
+	while (corpus.traces.size() < numTraces)
+	{
+		BoundingBox bb = brushes[liveBrushes[rng() % liveBrushes.size()]].GetBoundingBox();
+		glm::vec3 pos = glm::vec3(bb.min.x + dist01(rng) * (bb.max.x - bb.min.x), bb.max.y - mins.y + 0.03125f,
+			bb.min.z + dist01(rng) * (bb.max.z - bb.min.z));
+		float angle = dist01(rng) * 2 * glm::pi<float>();
+
+		for (int step = 0; step < MAX_WALK_STEPS && corpus.traces.size() < numTraces; step++)
+		{
+			glm::vec3 groundEnd = pos - glm::vec3(0, GROUND_TRACE_DISTANCE, 0);
+			RecordTrace(&corpus, pos, groundEnd, mins, maxs);
+			TraceResult ground = BoxTrace(pos, groundEnd, mins, maxs, model);
+			if (ground.outputAllSolid)
+			{
+				break;
+			}
+
+			// walk if theres ground, otherwise fall
+			angle += (dist01(rng) - 0.5f) * 0.5f;
+			glm::vec3 move = glm::vec3(cos(angle), 0, sin(angle)) * MOVE_DISTANCE;
+			if (ground.timeFraction == 1)
+			{
+				move = glm::vec3(0, -MOVE_DISTANCE, 0);
+			}
+
+			glm::vec3 end = pos + move;
+			RecordTrace(&corpus, pos, end, mins, maxs);
+			TraceResult result = BoxTrace(pos, end, mins, maxs, model);
+			if (result.outputAllSolid)
+			{
+				break;
+			}
+
+			pos = pos + result.timeFraction * move;
+			if (result.timeFraction < 1)
+			{
+				angle += glm::pi<float>() * (0.5f + dist01(rng));
+			}
+
+			// fell off the level
+			if (pos.y < worldBounds->min.y)
+			{
+				break;
+			}
+		}
+	}
+
+	// every step records two traces
+	corpus.traces.resize(numTraces);
+	return corpus;
+}
+
+
+/*
+	What a trace costs in a tree, counted the way the split cost models estimate it: every node 
+	whose bounds the swept box touches is visited, every brush in a touched leaf is tested.
+	The real traversal is a bit cheaper, it only goes down both sides when the trace crosses 
+	the plane.
+*/
+void CountTraceCost_r(BSPCollisionModel* model, int child, RecordedTrace& trace, int* numNodes, int* numBrushes)
+{
+	if (!TraceTouchesBoundingBox(trace, *GetBSPModelBounds(model, child)))
+	{
+		return;
+	}
+
+	if (IsFlatBSPLeaf(child))
+	{
+		*numBrushes += model->leaves[FlatBSPLeafIndex(child)].numLeafBrushes;
+		return;
+	}
+
+	(*numNodes)++;
+	FlatBSPNode* node = &model->nodes[child];
+	CountTraceCost_r(model, node->children[0], trace, numNodes, numBrushes);
+	CountTraceCost_r(model, node->children[1], trace, numNodes, numBrushes);
+}
+
+
+struct TraceCorpusCost
+{
+	float tracesPerSecond;
+	float nodesPerTrace;
+	float brushesPerTrace;
+
+	// nodesPerTrace and brushesPerTrace weighted like the SAH, steadier than timing
+	float estimatedCost;
+};
+
+TraceCorpusCost MeasureTraceCorpusCost(BSPCollisionModel* model, TraceCorpus* corpus)
+{
+	// a corpus goes by in a few milliseconds, best of a few passes
+	const int NUM_TIMED_PASSES = 5;
+
+	TraceCorpusCost cost = {};
+	int numTraces = corpus->traces.size();
+	if (numTraces == 0)
+	{
+		return cost;
+	}
+
+	for (int pass = 0; pass < NUM_TIMED_PASSES; pass++)
+	{
+		auto startTime = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < numTraces; i++)
+		{
+			RecordedTrace& trace = corpus->traces[i];
+			BoxTrace(trace.start, trace.end, trace.mins, trace.maxs, model);
+		}
+		cost.tracesPerSecond = std::max<float>(cost.tracesPerSecond, GetTracesPerSecond(numTraces, startTime));
+	}
+
+	int numNodes = 0, numBrushes = 0;
+	for (int i = 0; i < numTraces; i++)
+	{
+		CountTraceCost_r(model, model->root, corpus->traces[i], &numNodes, &numBrushes);
+	}
+	cost.nodesPerTrace = numNodes / (float)numTraces;
+	cost.brushesPerTrace = numBrushes / (float)numTraces;
+	cost.estimatedCost = SAH_TRAVERSAL_COST_AXIAL * cost.nodesPerTrace + SAH_BRUSH_TEST_COST * cost.brushesPerTrace;
+	return cost;
+}
+
+
+/*
+	builds the tree with every split cost model and prints tree quality and 
+	trace throughput side by side.
+
+	With a corpus the profile model is built too. It trains on the first half of the corpus, 
+	and every model is measured on the second half, so the profile model doesnt get to 
+	see the traces its scored on. The profile tree is kept only if its held out estCost beats
+	balance.
+*/
+void CompareSplitCostModels(std::vector<Brush> brushes, int numTraces, TraceCorpus* corpus = NULL)
+{
+	SplitCostModel models[] = { SPLIT_COST_BALANCE, SPLIT_COST_SAH, SPLIT_COST_PROFILE };
+	const int maxModels = sizeof(models) / sizeof(models[0]);
+
+	// profile is last
+	int numModels = corpus ? maxModels : maxModels - 1;
+
+	TraceCorpus trainingCorpus, testCorpus;
+	if (corpus)
+	{
+		int half = corpus->traces.size() / 2;
+		trainingCorpus.traces.assign(corpus->traces.begin(), corpus->traces.begin() + half);
+		testCorpus.traces.assign(corpus->traces.begin() + half, corpus->traces.end());
+	}
+
+	BSPTreeStats stats[maxModels];
+	float tracesPerSecond[maxModels];
+	TraceCorpusCost corpusCost[maxModels];
+	double buildMs[maxModels];
+
+	for (int i = 0; i < numModels; i++)
+	{
+		BSPBuildSettings settings;
+		settings.splitCostModel = models[i];
+		settings.traceCorpus = &trainingCorpus;
+		settings.verbose = false;
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		BSPNode* root = BuildBSPTree(brushes, 0, settings);
+		FlatBSPTree tree = {};
+		FlattenBSPTree(root, brushes, &tree);
+		FreeBSPTree(root);
+		auto endTime = std::chrono::high_resolution_clock::now();
+
+		buildMs[i] = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+		stats[i] = GetFlatBSPTreeStats(&tree);
+		BSPCollisionModel model = GetBSPCollisionModel(&tree);
+		tracesPerSecond[i] = MeasureTraceThroughput(&model, numTraces);
+		if (corpus)
+		{
+			corpusCost[i] = MeasureTraceCorpusCost(&model, &testCorpus);
+		}
+	}
+
+	printf("%-10s %8s %8s %8s %8s %10s %10s %10s %10s %12s\n", "model", "nodes", "leaves", "solid", "maxDepth", 
+		"avgDepth", "leafRefs", "estCost", "build ms", "traces/s");
+	for (int i = 0; i < numModels; i++)
+	{
+		printf("%-10s %8d %8d %8d %8d %10.2f %10d %10.2f %10.2f %12.0f\n", GetSplitCostModelName(models[i]), 
+			stats[i].numNodes, stats[i].numLeaves, stats[i].numSolidLeaves, stats[i].maxDepth, 
+			stats[i].averageLeafDepth, stats[i].numLeafBrushes, stats[i].estimatedTraceCost, buildMs[i], tracesPerSecond[i]);
+	}
+
+	if (corpus)
+	{
+		// speedups are against balance, the default
+		printf("\n%d corpus traces, trained on %d, measured on %d\n", (int)corpus->traces.size(), 
+			(int)trainingCorpus.traces.size(), (int)testCorpus.traces.size());
+		printf("%-10s %12s %12s %12s %10s %10s %10s\n", "model", "traces/s", "nodes/trace", "brush/trace", "estCost", 
+			"speedup", "estSpeedup");
+		for (int i = 0; i < numModels; i++)
+		{
+			float speedup = corpusCost[0].tracesPerSecond > 0 ? corpusCost[i].tracesPerSecond / corpusCost[0].tracesPerSecond : 0;
+			float estimatedSpeedup = corpusCost[i].estimatedCost > 0 ? corpusCost[0].estimatedCost / corpusCost[i].estimatedCost : 0;
+			printf("%-10s %12.0f %12.2f %12.2f %10.2f %9.2fx %9.2fx\n", GetSplitCostModelName(models[i]), corpusCost[i].tracesPerSecond, 
+				corpusCost[i].nodesPerTrace, corpusCost[i].brushesPerTrace, corpusCost[i].estimatedCost, speedup, estimatedSpeedup);
+		}
+
+		// the profile tree is only worth using if it beats balance on the traces it didnt train on
+		int profile = numModels - 1;
+		bool keepProfile = corpusCost[profile].estimatedCost < corpusCost[0].estimatedCost;
+		printf("\nprofile %s, held out estCost %.2f vs balance %.2f\n", keepProfile ? "kept" : "dropped", 
+			corpusCost[profile].estimatedCost, corpusCost[0].estimatedCost);
+	}
+}
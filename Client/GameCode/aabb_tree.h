@@ -0,0 +1,410 @@
+#pragma once
+
+#include "bsp_tree.h"
+
+/*
+	Dynamic AABB tree, a 3d port of box2d's b2DynamicTree.
+
+	Leaves are proxies with a fattened box around the thing they hold, so small moves
+	dont touch the tree at all. Inserting walks down picking the child that grows the
+	least in surface area, then refits boxes and rebalances (AVL style rotations) on
+	the way back up.
+
+	Nodes live in one array and are recycled through a free list, so proxy ids stay
+	valid until the proxy is destroyed.
+*/
+
+const int AABB_NULL_NODE = -1;
+
+struct AABBTreeNode
+{
+	BoundingBox box;
+
+	// parent when the node is in the tree, next free node when its on the free list
+	int parent;
+	int children[2];
+
+	// leaf = 0, free node = -1
+	int height;
+
+	int userData;
+
+	bool IsLeaf()
+	{
+		return children[0] == AABB_NULL_NODE;
+	}
+};
+
+struct AABBTree
+{
+	int root;
+	std::vector<AABBTreeNode> nodes;
+	int freeList;
+
+	// how much leaf boxes are fattened by
+	float margin;
+};
+
+
+void InitAABBTree(AABBTree* tree, float margin = 2.0f)
+{
+	tree->root = AABB_NULL_NODE;
+	tree->nodes.clear();
+	tree->freeList = AABB_NULL_NODE;
+	tree->margin = margin;
+}
+
+
+int AllocateAABBNode(AABBTree* tree)
+{
+	int nodeId;
+	if (tree->freeList == AABB_NULL_NODE)
+	{
+		nodeId = tree->nodes.size();
+		tree->nodes.push_back(AABBTreeNode());
+	}
+	else
+	{
+		nodeId = tree->freeList;
+		tree->freeList = tree->nodes[nodeId].parent;
+	}
+
+	AABBTreeNode* node = &tree->nodes[nodeId];
+	node->parent = AABB_NULL_NODE;
+	node->children[0] = AABB_NULL_NODE;
+	node->children[1] = AABB_NULL_NODE;
+	node->height = 0;
+	node->userData = -1;
+	return nodeId;
+}
+
+
+void FreeAABBNode(AABBTree* tree, int nodeId)
+{
+	tree->nodes[nodeId].parent = tree->freeList;
+	tree->nodes[nodeId].height = -1;
+	tree->freeList = nodeId;
+}
+
+
+/*
+	Rotates iA up if its unbalanced. Returns the new root of the subtree.
+
+			A			   C
+		   / \			  / \
+		  B   C	  ->	 A   F
+			 / \		/ \
+			F   G	   B   G
+*/
+int BalanceAABBTree(AABBTree* tree, int iA)
+{
+	std::vector<AABBTreeNode>& nodes = tree->nodes;
+
+	AABBTreeNode* A = &nodes[iA];
+	if (A->IsLeaf() || A->height < 2)
+	{
+		return iA;
+	}
+
+	int iB = A->children[0];
+	int iC = A->children[1];
+	AABBTreeNode* B = &nodes[iB];
+	AABBTreeNode* C = &nodes[iC];
+
+	int balance = C->height - B->height;
+
+	// rotate C up
+	if (balance > 1)
+	{
+		int iF = C->children[0];
+		int iG = C->children[1];
+		AABBTreeNode* F = &nodes[iF];
+		AABBTreeNode* G = &nodes[iG];
+
+		C->children[0] = iA;
+		C->parent = A->parent;
+		A->parent = iC;
+
+		if (C->parent != AABB_NULL_NODE)
+		{
+			AABBTreeNode* parent = &nodes[C->parent];
+			parent->children[parent->children[0] == iA ? 0 : 1] = iC;
+		}
+		else
+		{
+			tree->root = iC;
+		}
+
+		// the taller of F and G stays under C
+		if (F->height > G->height)
+		{
+			C->children[1] = iF;
+			A->children[1] = iG;
+			G->parent = iA;
+			A->box = UnionBoundingBox(B->box, G->box);
+			C->box = UnionBoundingBox(A->box, F->box);
+
+			A->height = 1 + std::max(B->height, G->height);
+			C->height = 1 + std::max(A->height, F->height);
+		}
+		else
+		{
+			C->children[1] = iG;
+			A->children[1] = iF;
+			F->parent = iA;
+			A->box = UnionBoundingBox(B->box, F->box);
+			C->box = UnionBoundingBox(A->box, G->box);
+
+			A->height = 1 + std::max(B->height, F->height);
+			C->height = 1 + std::max(A->height, G->height);
+		}
+
+		return iC;
+	}
+
+	// rotate B up
+	if (balance < -1)
+	{
+		int iD = B->children[0];
+		int iE = B->children[1];
+		AABBTreeNode* D = &nodes[iD];
+		AABBTreeNode* E = &nodes[iE];
+
+		B->children[0] = iA;
+		B->parent = A->parent;
+		A->parent = iB;
+
+		if (B->parent != AABB_NULL_NODE)
+		{
+			AABBTreeNode* parent = &nodes[B->parent];
+			parent->children[parent->children[0] == iA ? 0 : 1] = iB;
+		}
+		else
+		{
+			tree->root = iB;
+		}
+
+		if (D->height > E->height)
+		{
+			B->children[1] = iD;
+			A->children[0] = iE;
+			E->parent = iA;
+			A->box = UnionBoundingBox(C->box, E->box);
+			B->box = UnionBoundingBox(A->box, D->box);
+
+			A->height = 1 + std::max(C->height, E->height);
+			B->height = 1 + std::max(A->height, D->height);
+		}
+		else
+		{
+			B->children[1] = iE;
+			A->children[0] = iD;
+			D->parent = iA;
+			A->box = UnionBoundingBox(C->box, D->box);
+			B->box = UnionBoundingBox(A->box, E->box);
+
+			A->height = 1 + std::max(C->height, D->height);
+			B->height = 1 + std::max(A->height, E->height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+
+// cost of making the new leaf a sibling of child, see InsertAABBLeaf
+float GetAABBDescendCost(AABBTree* tree, int child, BoundingBox& leafBox, float inheritanceCost)
+{
+	AABBTreeNode* node = &tree->nodes[child];
+	float area = GetBoundingBoxSurfaceArea(UnionBoundingBox(leafBox, node->box));
+	if (node->IsLeaf())
+	{
+		return area + inheritanceCost;
+	}
+	return area - GetBoundingBoxSurfaceArea(node->box) + inheritanceCost;
+}
+
+
+void InsertAABBLeaf(AABBTree* tree, int leaf)
+{
+	if (tree->root == AABB_NULL_NODE)
+	{
+		tree->root = leaf;
+		tree->nodes[leaf].parent = AABB_NULL_NODE;
+		return;
+	}
+
+	// find the best sibling by surface area
+	BoundingBox leafBox = tree->nodes[leaf].box;
+	int index = tree->root;
+	while (!tree->nodes[index].IsLeaf())
+	{
+		AABBTreeNode* node = &tree->nodes[index];
+		float area = GetBoundingBoxSurfaceArea(node->box);
+		float combinedArea = GetBoundingBoxSurfaceArea(UnionBoundingBox(node->box, leafBox));
+
+		// cost of creating a new parent for this node and the new leaf
+		float cost = 2 * combinedArea;
+
+		// minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2 * (combinedArea - area);
+
+		float cost0 = GetAABBDescendCost(tree, node->children[0], leafBox, inheritanceCost);
+		float cost1 = GetAABBDescendCost(tree, node->children[1], leafBox, inheritanceCost);
+
+		if (cost < cost0 && cost < cost1)
+		{
+			break;
+		}
+
+		index = cost0 < cost1 ? node->children[0] : node->children[1];
+	}
+
+	int sibling = index;
+
+	// new parent for the sibling and the leaf
+	int oldParent = tree->nodes[sibling].parent;
+	int newParent = AllocateAABBNode(tree);
+	tree->nodes[newParent].parent = oldParent;
+	tree->nodes[newParent].box = UnionBoundingBox(leafBox, tree->nodes[sibling].box);
+	tree->nodes[newParent].height = tree->nodes[sibling].height + 1;
+	tree->nodes[newParent].children[0] = sibling;
+	tree->nodes[newParent].children[1] = leaf;
+	tree->nodes[sibling].parent = newParent;
+	tree->nodes[leaf].parent = newParent;
+
+	if (oldParent != AABB_NULL_NODE)
+	{
+		AABBTreeNode* parent = &tree->nodes[oldParent];
+		parent->children[parent->children[0] == sibling ? 0 : 1] = newParent;
+	}
+	else
+	{
+		tree->root = newParent;
+	}
+
+	// refit the boxes and heights on the way back up
+	index = tree->nodes[leaf].parent;
+	while (index != AABB_NULL_NODE)
+	{
+		index = BalanceAABBTree(tree, index);
+
+		AABBTreeNode* node = &tree->nodes[index];
+		AABBTreeNode* child0 = &tree->nodes[node->children[0]];
+		AABBTreeNode* child1 = &tree->nodes[node->children[1]];
+
+		node->height = 1 + std::max(child0->height, child1->height);
+		node->box = UnionBoundingBox(child0->box, child1->box);
+
+		index = node->parent;
+	}
+}
+
+
+void RemoveAABBLeaf(AABBTree* tree, int leaf)
+{
+	if (leaf == tree->root)
+	{
+		tree->root = AABB_NULL_NODE;
+		return;
+	}
+
+	int parent = tree->nodes[leaf].parent;
+	int grandParent = tree->nodes[parent].parent;
+	int sibling = tree->nodes[parent].children[0] == leaf ? tree->nodes[parent].children[1] : tree->nodes[parent].children[0];
+
+	if (grandParent == AABB_NULL_NODE)
+	{
+		tree->root = sibling;
+		tree->nodes[sibling].parent = AABB_NULL_NODE;
+		FreeAABBNode(tree, parent);
+		return;
+	}
+
+	// the sibling takes the parent's place
+	AABBTreeNode* grandParentNode = &tree->nodes[grandParent];
+	grandParentNode->children[grandParentNode->children[0] == parent ? 0 : 1] = sibling;
+	tree->nodes[sibling].parent = grandParent;
+	FreeAABBNode(tree, parent);
+
+	int index = grandParent;
+	while (index != AABB_NULL_NODE)
+	{
+		index = BalanceAABBTree(tree, index);
+
+		AABBTreeNode* node = &tree->nodes[index];
+		AABBTreeNode* child0 = &tree->nodes[node->children[0]];
+		AABBTreeNode* child1 = &tree->nodes[node->children[1]];
+
+		node->box = UnionBoundingBox(child0->box, child1->box);
+		node->height = 1 + std::max(child0->height, child1->height);
+
+		index = node->parent;
+	}
+}
+
+
+BoundingBox FattenBoundingBox(BoundingBox box, float margin)
+{
+	box.min -= glm::vec3(margin);
+	box.max += glm::vec3(margin);
+	return box;
+}
+
+
+// returns the proxy id
+int CreateAABBProxy(AABBTree* tree, BoundingBox box, int userData)
+{
+	int proxyId = AllocateAABBNode(tree);
+	tree->nodes[proxyId].box = FattenBoundingBox(box, tree->margin);
+	tree->nodes[proxyId].userData = userData;
+	tree->nodes[proxyId].height = 0;
+
+	InsertAABBLeaf(tree, proxyId);
+	return proxyId;
+}
+
+
+void DestroyAABBProxy(AABBTree* tree, int proxyId)
+{
+	assert(tree->nodes[proxyId].IsLeaf());
+	RemoveAABBLeaf(tree, proxyId);
+	FreeAABBNode(tree, proxyId);
+}
+
+
+bool ContainsBoundingBox(const BoundingBox& outer, const BoundingBox& inner)
+{
+	return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+		inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+}
+
+
+// returns true if the proxy had to be reinserted
+bool MoveAABBProxy(AABBTree* tree, int proxyId, BoundingBox box)
+{
+	assert(tree->nodes[proxyId].IsLeaf());
+
+	// still inside the fat box, nothing to do
+	if (ContainsBoundingBox(tree->nodes[proxyId].box, box))
+	{
+		return false;
+	}
+
+	RemoveAABBLeaf(tree, proxyId);
+	tree->nodes[proxyId].box = FattenBoundingBox(box, tree->margin);
+	InsertAABBLeaf(tree, proxyId);
+	return true;
+}
+
+
+int GetAABBTreeHeight(AABBTree* tree)
+{
+	if (tree->root == AABB_NULL_NODE)
+	{
+		return 0;
+	}
+	return tree->nodes[tree->root].height;
+}
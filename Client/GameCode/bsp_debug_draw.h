@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+
+#include "../PlatformShared/platform_shared.h"
+#include "render_command_util.h"
+#include "bsp_tree.h"
+
+/*
+	BSP overlay, baked into one vertex array whenever the tree is flattened, since the tree
+	never changes between builds. Drawing is then just copying ranges of it into the frame.
+	A precompiled level bakes it from the split polygons stored in its file.
+
+	Items are baked in the same preorder the tree is walked in, so the subtree of a node is
+	the contiguous run of items [nodeFirstItem, nodeEndItem).
+
+				0				items:	0  1  3  4  2  5  6
+			   / \
+			  1   2				subtree of 1 is items 1, 3, 4
+			 / \ / \
+			3  4 5  6
+*/
+
+enum BSPDebugDrawFlags
+{
+	BSP_DEBUG_DRAW_SPLIT_POLYGONS = 1 << 0,
+	BSP_DEBUG_DRAW_SOLID_LEAVES = 1 << 1,
+	BSP_DEBUG_DRAW_EMPTY_LEAVES = 1 << 2,
+};
+
+// a split polygon and its outline, or the bounds of a leaf
+struct BSPDebugDrawItem
+{
+	int type;		// one of BSPDebugDrawFlags
+	int depth;
+	int firstVertex;
+	int numVertices;
+};
+
+struct BSPDebugDraw
+{
+	std::vector<TexturedVertex> vertices;
+	std::vector<BSPDebugDrawItem> items;
+
+	// indexed like FlatBSPTree::nodes
+	std::vector<int> nodeFirstItem;
+	std::vector<int> nodeEndItem;
+};
+
+struct BSPDebugDrawFilter
+{
+	int flags;
+
+	// inclusive, the root is depth 0
+	int minDepth;
+	int maxDepth;
+
+	// node index, -1 for the whole tree
+	int subtree;
+};
+
+
+BSPDebugDrawFilter DefaultBSPDebugDrawFilter()
+{
+	BSPDebugDrawFilter filter;
+	filter.flags = BSP_DEBUG_DRAW_SPLIT_POLYGONS;
+	filter.minDepth = 0;
+	filter.maxDepth = INT_MAX;
+	filter.subtree = -1;
+	return filter;
+}
+
+
+// the most vertices one item can take, a plane plus 4 outline lines of 6 quads each
+const int BSP_DEBUG_DRAW_MAX_ITEM_VERTICES = 4 + 4 * 6 * 4;
+
+// Points commands at the end of draw->vertices with room for one more item. PushQuad_Core
+// wants a bitmap slot per quad as well, those are thrown away, the bitmap is picked at draw time
+void ReserveBSPDebugDrawItem(BSPDebugDraw* draw, GameRenderCommands* commands, std::vector<LoadedBitmap*>& bitmaps)
+{
+	draw->vertices.resize(commands->numVertex + BSP_DEBUG_DRAW_MAX_ITEM_VERTICES);
+	bitmaps.resize(commands->numBitmaps + BSP_DEBUG_DRAW_MAX_ITEM_VERTICES / 4);
+
+	commands->masterVertexArray = draw->vertices.data();
+	commands->maxNumVertex = draw->vertices.size();
+	commands->masterBitmapArray = bitmaps.data();
+	commands->maxNumBitmaps = bitmaps.size();
+}
+
+
+void AddBSPDebugDrawItem(BSPDebugDraw* draw, GameRenderCommands* commands, int type, int depth, int firstVertex)
+{
+	BSPDebugDrawItem item;
+	item.type = type;
+	item.depth = depth;
+	item.firstVertex = firstVertex;
+	item.numVertices = commands->numVertex - firstVertex;
+	draw->items.push_back(item);
+}
+
+
+void BuildBSPDebugDraw_r(BSPDebugDraw* draw, BSPCollisionModel* model, std::vector<BspPolygon*>& splitPolygons, int child, int depth,
+	GameRenderCommands* commands, RenderGroup* group, std::vector<LoadedBitmap*>& bitmaps)
+{
+	ReserveBSPDebugDrawItem(draw, commands, bitmaps);
+	int firstVertex = commands->numVertex;
+
+	if (IsFlatBSPLeaf(child))
+	{
+		int leafIndex = FlatBSPLeafIndex(child);
+		BoundingBox bb = model->leafBounds[leafIndex];
+		if (IsBoundingBoxEmpty(bb))
+		{
+			return;
+		}
+
+		bool isSolid = model->leaves[leafIndex].numLeafBrushes > 0;
+		glm::vec4 color = isSolid ? glm::vec4(1, 0, 0, 0.05) : glm::vec4(0, 1, 1, 0.05);
+
+		RenderCmdUtil::PushCube(commands, group, NULL, color, bb.min, bb.max);
+		AddBSPDebugDrawItem(draw, commands, isSolid ? BSP_DEBUG_DRAW_SOLID_LEAVES : BSP_DEBUG_DRAW_EMPTY_LEAVES, depth, firstVertex);
+		return;
+	}
+
+	draw->nodeFirstItem[child] = draw->items.size();
+
+	BspPolygon* splitPolygon = splitPolygons[child];
+	RenderCmdUtil::PushPlane(commands, group, NULL, glm::vec4(0, 1, 0, 0.01), splitPolygon->vertices, true);
+	RenderCmdUtil::PushPlaneOutline(commands, group, NULL, glm::vec4(0, 1, 0, 1), splitPolygon->vertices);
+	AddBSPDebugDrawItem(draw, commands, BSP_DEBUG_DRAW_SPLIT_POLYGONS, depth, firstVertex);
+
+	FlatBSPNode* node = &model->nodes[child];
+	BuildBSPDebugDraw_r(draw, model, splitPolygons, node->children[0], depth + 1, commands, group, bitmaps);
+	BuildBSPDebugDraw_r(draw, model, splitPolygons, node->children[1], depth + 1, commands, group, bitmaps);
+
+	draw->nodeEndItem[child] = draw->items.size();
+}
+
+
+// splitPolygons is indexed like model->nodes, empty when there are none to draw
+void BuildBSPDebugDraw(BSPDebugDraw* draw, BSPCollisionModel* model, std::vector<BspPolygon*>& splitPolygons)
+{
+	*draw = BSPDebugDraw();
+	if (model->numLeaves == 0 || splitPolygons.size() != model->numNodes)
+	{
+		return;
+	}
+
+	draw->nodeFirstItem.resize(model->numNodes);
+	draw->nodeEndItem.resize(model->numNodes);
+
+	// the Push functions write into this instead of a frame
+	GameRenderCommands commands = {};
+	RenderGroupEntryTexturedQuads quads = {};
+	RenderGroup group = {};
+	group.quads = &quads;
+	std::vector<LoadedBitmap*> bitmaps;
+
+	BuildBSPDebugDraw_r(draw, model, splitPolygons, model->root, 0, &commands, &group, bitmaps);
+	draw->vertices.resize(commands.numVertex);
+}
+
+
+// empty when the tree has no debug info
+void BuildBSPDebugDraw(BSPDebugDraw* draw, FlatBSPTree* tree)
+{
+	if (tree->debugNodes.size() != tree->nodes.size())
+	{
+		*draw = BSPDebugDraw();
+		return;
+	}
+
+	std::vector<BspPolygon*> splitPolygons;
+	for (int i = 0; i < tree->debugNodes.size(); i++)
+	{
+		splitPolygons.push_back(&tree->debugNodes[i].splitPolygon);
+	}
+
+	BSPCollisionModel model = GetBSPCollisionModel(tree);
+	BuildBSPDebugDraw(draw, &model, splitPolygons);
+}
+
+
+// copies vertices [firstVertex, firstVertex + numVertices) into the frame
+void PushBSPDebugDrawVertices(GameRenderCommands* commands, RenderGroup* group, LoadedBitmap* bitmap,
+	BSPDebugDraw* draw, int firstVertex, int numVertices)
+{
+	int numQuads = numVertices / 4;
+	if (numVertices == 0 || !commands->HasSpaceForVertex(numVertices) ||
+		commands->numBitmaps + numQuads > commands->maxNumBitmaps)
+	{
+		return;
+	}
+
+	std::copy(&draw->vertices[firstVertex], &draw->vertices[firstVertex] + numVertices, &commands->masterVertexArray[commands->numVertex]);
+	for (int i = 0; i < numQuads; i++)
+	{
+		commands->masterBitmapArray[commands->numBitmaps + i] = bitmap;
+	}
+
+	commands->numVertex += numVertices;
+	commands->numBitmaps += numQuads;
+	group->quads->numQuads += numQuads;
+}
+
+
+// items that pass the filter and sit next to each other go out as one copy
+void PushBSPDebugDraw(GameRenderCommands* commands, RenderGroup* group, LoadedBitmap* bitmap,
+	BSPDebugDraw* draw, BSPDebugDrawFilter filter)
+{
+	int firstItem = 0;
+	int endItem = draw->items.size();
+	if (filter.subtree >= 0 && filter.subtree < draw->nodeFirstItem.size())
+	{
+		firstItem = draw->nodeFirstItem[filter.subtree];
+		endItem = draw->nodeEndItem[filter.subtree];
+	}
+
+	int runFirstVertex = 0;
+	int runNumVertices = 0;
+	for (int i = firstItem; i < endItem; i++)
+	{
+		BSPDebugDrawItem* item = &draw->items[i];
+		if ((item->type & filter.flags) == 0 || item->depth < filter.minDepth || item->depth > filter.maxDepth)
+		{
+			continue;
+		}
+
+		if (runFirstVertex + runNumVertices != item->firstVertex)
+		{
+			PushBSPDebugDrawVertices(commands, group, bitmap, draw, runFirstVertex, runNumVertices);
+			runFirstVertex = item->firstVertex;
+			runNumVertices = 0;
+		}
+		runNumVertices += item->numVertices;
+	}
+	PushBSPDebugDrawVertices(commands, group, bitmap, draw, runFirstVertex, runNumVertices);
+}
@@ -0,0 +1,607 @@
+#pragma once
+
+#include <cstring>
+
+#include "bsp_tree.h"
+#include "bsp_vis.h"
+
+/*
+	Editing single brushes in an already built BSPNode tree, without rebuilding all of it.
+
+	Insert:	push the brush down the tree, splitting it where it straddles a node. Every
+			leaf a piece lands in gets rebuilt from its old brushes plus the piece, so
+			only those subtrees are touched.
+
+	Remove:	take the brush's pieces out of the leaves it overlaps. A node whose children
+			both end up as empty leaves collapses back into a single empty leaf.
+
+	Move:	remove, translate, insert.
+
+	Patch:	the flat tree only gets redone where an edit went. Edits mark the BSPNodes they
+			pass through dirty, PatchFlatBSPTree goes down only those, rewrites leaves that
+			changed in place and appends the subtrees that are new. What they replaced is
+			dropped but stays in the arrays until the next full build.
+
+				  0					  0			node 0 and leaf 1 are kept,
+				 / \				 / \		leaf 2 is dropped, the subtree
+				1   2				1   3		that replaced it is appended
+								   / \
+								  4   5
+
+	Removal leaves behind split planes from the removed brush, and inserts dont get to
+	pick planes with the whole level in view, so the tree slowly gets worse than a full
+	build. The PVS only ever grows, see PatchBSPVisibility, and after a dozen edits on a
+	small level every leaf can see every other. BSPEditState remembers the quality of the
+	last full build, and the caller rebuilds when we drift too far from it. See
+	NeedsFullRebuild.
+*/
+
+struct BSPEditState
+{
+	BSPBuildSettings settings;
+
+	// quality right after the last full build
+	float baselineNodesPerBrush;
+	float baselineDuplicationFactor;
+	float baselinePVSDensity;
+
+	int numEditsSinceRebuild;
+	int numLiveBrushes;
+};
+
+
+void UpdateBSPNodeBounds(BSPNode* node)
+{
+	if (node->IsLeafNode())
+	{
+		BoundingBox bb = GetBrushesBoundingBox(node->brushes);
+		node->bboxMin = bb.min;
+		node->bboxMax = bb.max;
+	}
+	else
+	{
+		node->bboxMin = glm::min(node->children[0]->bboxMin, node->children[1]->bboxMin);
+		node->bboxMax = glm::max(node->children[0]->bboxMax, node->children[1]->bboxMax);
+	}
+}
+
+
+BSPNode* InsertBrushIntoBSPTree_r(BSPNode* node, Brush brush, int depth, BSPBuildSettings settings)
+{
+	if (node->IsLeafNode())
+	{
+		std::vector<Brush> brushes = node->brushes;
+		brushes.push_back(brush);
+		delete node;
+		return BuildBSPTree_r(brushes, depth, settings);
+	}
+
+	node->dirty = true;
+
+	// faces on a plane that is already in the tree above shouldnt be picked again
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		if (ClassifyPolygonToPlane(&brush.polygons[i], node->splitPlane) == SplittingPlaneResult::POLYGON_COPLANNAR)
+		{
+			brush.used[i] = true;
+		}
+	}
+
+	SplittingPlaneResult result = ClassifyBrushToPlane(brush, node->splitPlane);
+	if (result == SplittingPlaneResult::BRUSH_FRONT)
+	{
+		node->children[0] = InsertBrushIntoBSPTree_r(node->children[0], brush, depth + 1, settings);
+	}
+	else if (result == SplittingPlaneResult::BRUSH_BACK)
+	{
+		node->children[1] = InsertBrushIntoBSPTree_r(node->children[1], brush, depth + 1, settings);
+	}
+	else
+	{
+		Brush frontBrush, backBrush;
+		SplitBrush(brush, node->splitPlane, frontBrush, backBrush);
+
+		if (frontBrush.polygons.size() > 0)
+		{
+			node->children[0] = InsertBrushIntoBSPTree_r(node->children[0], frontBrush, depth + 1, settings);
+		}
+		if (backBrush.polygons.size() > 0)
+		{
+			node->children[1] = InsertBrushIntoBSPTree_r(node->children[1], backBrush, depth + 1, settings);
+		}
+	}
+
+	UpdateBSPNodeBounds(node);
+	return node;
+}
+
+
+// brush.brushIndex has to be set, thats how RemoveBrushFromBSPTree finds the pieces again
+BSPNode* InsertBrushIntoBSPTree(BSPNode* root, Brush brush, BSPBuildSettings settings)
+{
+	assert(brush.brushIndex != -1);
+	return InsertBrushIntoBSPTree_r(root, brush, 0, settings);
+}
+
+
+// returns whether anything under node changed
+bool RemoveBrushFromBSPTree_r(BSPNode* node, int brushIndex, BoundingBox& brushBounds)
+{
+	BoundingBox nodeBounds = { node->bboxMin, node->bboxMax };
+	if (!BoundingBoxesOverlap(nodeBounds, brushBounds))
+	{
+		return false;
+	}
+
+	if (node->IsLeafNode())
+	{
+		bool changed = false;
+		std::vector<Brush>& brushes = node->brushes;
+		for (int i = brushes.size() - 1; i >= 0; i--)
+		{
+			if (brushes[i].brushIndex == brushIndex)
+			{
+				brushes.erase(brushes.begin() + i);
+				changed = true;
+			}
+		}
+
+		node->dirty |= changed;
+		UpdateBSPNodeBounds(node);
+		return changed;
+	}
+
+	bool frontChanged = RemoveBrushFromBSPTree_r(node->children[0], brushIndex, brushBounds);
+	bool backChanged = RemoveBrushFromBSPTree_r(node->children[1], brushIndex, brushBounds);
+	if (!frontChanged && !backChanged)
+	{
+		return false;
+	}
+	node->dirty = true;
+
+	// nothing left to separate
+	if (node->children[0]->IsLeafNode() && node->children[0]->IsEmpty() &&
+		node->children[1]->IsLeafNode() && node->children[1]->IsEmpty())
+	{
+		delete node->children[0];
+		delete node->children[1];
+		node->children[0] = NULL;
+		node->children[1] = NULL;
+	}
+
+	UpdateBSPNodeBounds(node);
+	return true;
+}
+
+
+// brushBounds is the bounds of the brush as it was inserted
+void RemoveBrushFromBSPTree(BSPNode* root, int brushIndex, BoundingBox brushBounds)
+{
+	RemoveBrushFromBSPTree_r(root, brushIndex, brushBounds);
+}
+
+
+void TranslateBrush(Brush& brush, glm::vec3 offset)
+{
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		BspPolygon& polygon = brush.polygons[i];
+		for (int j = 0; j < polygon.vertices.size(); j++)
+		{
+			polygon.vertices[j] += offset;
+		}
+		polygon.plane.distance += glm::dot(polygon.plane.normal, offset);
+	}
+	SnapBrush(brush);
+}
+
+
+void ResetBrushUsedFlags(Brush& brush)
+{
+	brush.used.assign(brush.polygons.size(), false);
+}
+
+
+/*
+	What an edit changed in the flat tree, for everything that keeps data per leaf outside
+	of it: the PVS, entities linked to leaves.
+
+	changedLeaves are leaves from before the patch that got rewritten or dropped, plus any
+	the caller adds, see ReplaceBSPTreeBrush. newLeaves are the leaves that took their place.
+	A leaf rewritten in place is in both.
+*/
+struct FlatBSPPatch
+{
+	std::vector<int> changedLeaves;
+	std::vector<int> newLeaves;
+};
+
+
+// child and everything below it isnt reachable from the root anymore
+void DropFlatBSPSubtree(FlatBSPTree* tree, int child, FlatBSPPatch* patch)
+{
+	if (IsFlatBSPLeaf(child))
+	{
+		int leafIndex = FlatBSPLeafIndex(child);
+		tree->numLiveLeaves--;
+		tree->numLiveLeafBrushes -= tree->leaves[leafIndex].numLeafBrushes;
+		patch->changedLeaves.push_back(leafIndex);
+		return;
+	}
+
+	tree->numLiveNodes--;
+	DropFlatBSPSubtree(tree, tree->nodes[child].children[0], patch);
+	DropFlatBSPSubtree(tree, tree->nodes[child].children[1], patch);
+}
+
+
+// a subtree the edit built, goes at the end of the arrays
+int AppendFlatBSPSubtree(FlatBSPTree* tree, BSPNode* node, std::vector<Brush>& sourceBrushes, FlatBSPPatch* patch)
+{
+	int firstNode = tree->nodes.size();
+	int firstLeaf = tree->leaves.size();
+	int child = FlattenBSPTree_r(tree, node, sourceBrushes);
+
+	tree->numLiveNodes += tree->nodes.size() - firstNode;
+	for (int i = firstLeaf; i < tree->leaves.size(); i++)
+	{
+		tree->numLiveLeaves++;
+		tree->numLiveLeafBrushes += tree->leaves[i].numLeafBrushes;
+		patch->newLeaves.push_back(i);
+	}
+	return child;
+}
+
+
+// the leaf keeps its index, and its range of leafBrushes if the new list fits in it
+void RewriteFlatBSPLeaf(FlatBSPTree* tree, BSPNode* node, FlatBSPPatch* patch)
+{
+	int leafIndex = FlatBSPLeafIndex(node->flatChild);
+	FlatBSPLeaf* leaf = &tree->leaves[leafIndex];
+
+	FlatBSPLeaf newLeaf = AddFlatBSPLeafBrushes(tree, node);
+	if (newLeaf.numLeafBrushes <= leaf->numLeafBrushes)
+	{
+		std::copy(tree->leafBrushes.begin() + newLeaf.firstLeafBrush, tree->leafBrushes.end(),
+			tree->leafBrushes.begin() + leaf->firstLeafBrush);
+		tree->leafBrushes.resize(newLeaf.firstLeafBrush);
+		newLeaf.firstLeafBrush = leaf->firstLeafBrush;
+	}
+
+	tree->numLiveLeafBrushes += newLeaf.numLeafBrushes - leaf->numLeafBrushes;
+	*leaf = newLeaf;
+	tree->leafBounds[leafIndex] = { node->bboxMin, node->bboxMax };
+
+	patch->changedLeaves.push_back(leafIndex);
+	patch->newLeaves.push_back(leafIndex);
+}
+
+
+// returns the flat child node is now. The parent drops what it had there before if that differs
+int PatchFlatBSPTree_r(FlatBSPTree* tree, BSPNode* node, std::vector<Brush>& sourceBrushes, FlatBSPPatch* patch)
+{
+	if (node->flatChild == FLAT_BSP_NOT_FLATTENED)
+	{
+		return AppendFlatBSPSubtree(tree, node, sourceBrushes, patch);
+	}
+
+	if (!node->dirty)
+	{
+		return node->flatChild;
+	}
+
+	if (node->IsLeafNode())
+	{
+		// a node that collapsed into a leaf
+		if (!IsFlatBSPLeaf(node->flatChild))
+		{
+			return AppendFlatBSPSubtree(tree, node, sourceBrushes, patch);
+		}
+
+		node->dirty = false;
+		RewriteFlatBSPLeaf(tree, node, patch);
+		return node->flatChild;
+	}
+
+	// inserting into a leaf replaces its BSPNode, so a node we flattened was always a node
+	assert(!IsFlatBSPLeaf(node->flatChild));
+	node->dirty = false;
+	int nodeIndex = node->flatChild;
+
+	Plane plane;
+	int side = GetFlatBSPNodePlane(node, &plane);
+	BSPNode* children[2] = { node->children[side], node->children[!side] };
+
+	for (int i = 0; i < 2; i++)
+	{
+		int oldChild = tree->nodes[nodeIndex].children[i];
+		int child = PatchFlatBSPTree_r(tree, children[i], sourceBrushes, patch);
+		if (child != oldChild)
+		{
+			DropFlatBSPSubtree(tree, oldChild, patch);
+			tree->nodes[nodeIndex].children[i] = child;
+		}
+	}
+
+	tree->nodeBounds[nodeIndex] = { node->bboxMin, node->bboxMax };
+	return nodeIndex;
+}
+
+
+// brings tree up to date with the edits made to root since it was flattened from it.
+// Views of tree go stale like after a flatten
+void PatchFlatBSPTree(BSPNode* root, std::vector<Brush>& sourceBrushes, FlatBSPTree* tree, FlatBSPPatch* patch)
+{
+	int oldRoot = tree->root;
+	tree->root = PatchFlatBSPTree_r(tree, root, sourceBrushes, patch);
+	if (tree->root != oldRoot)
+	{
+		DropFlatBSPSubtree(tree, oldRoot, patch);
+	}
+}
+
+
+// the flat brush at brush.brushIndex, or a new one right after the last. Its old sides
+// and features stay behind in the arrays
+void SetFlatBSPBrush(FlatBSPTree* tree, Brush& brush)
+{
+	int brushIndex = brush.brushIndex;
+	assert(brushIndex >= 0 && brushIndex <= tree->brushes.size());
+
+	tree->numLiveBrushSides += brush.polygons.size();
+	if (brushIndex == tree->brushes.size())
+	{
+		AddFlatBSPBrush(tree, brush);
+		return;
+	}
+
+	FlatBSPBrushFeatures features;
+	tree->numLiveBrushSides -= tree->brushes[brushIndex].numSides;
+	tree->brushes[brushIndex] = AddFlatBSPBrushSides(tree, brush, &features);
+	tree->brushFeatures[brushIndex] = features;
+}
+
+
+inline void SetPVSRowBit(unsigned char* row, int leafIndex)
+{
+	row[leafIndex >> 3] |= 1 << (leafIndex & 7);
+}
+
+
+/*
+	Keeps the PVS of a patched tree without running vis again. It only has to stay
+	conservative, a leaf can be marked visible when it isnt, never the other way around.
+
+	A new leaf is inside the leaves it replaced, so it sees what they saw and whatever saw
+	them sees it. A removed brush opens up sight lines through where it was, and each of
+	those goes through a leaf touching the brush on either side, so those go in changedLeaves
+	too: whatever saw one of them now sees whatever they saw.
+
+	So every new leaf, and every leaf that saw a changed one, gets the rows of all the
+	changed leaves, and the changed and new leaves themselves. It gets coarser with every
+	edit, the next full build computes it properly again.
+*/
+void PatchBSPVisibility(FlatBSPTree* tree, FlatBSPPatch* patch)
+{
+	if (tree->pvs.size() == 0)
+	{
+		return;
+	}
+
+	// rows only get wider when the new leaves dont fit, and then by doubling
+	int numLeaves = tree->leaves.size();
+	int numOldLeaves = tree->pvs.size() / tree->pvsRowBytes;
+	int rowBytes = tree->pvsRowBytes;
+	if (rowBytes * 8 < numLeaves)
+	{
+		rowBytes = std::max((numLeaves + 7) / 8, 2 * rowBytes);
+
+		std::vector<unsigned char> pvs(numLeaves * rowBytes, 0);
+		for (int i = 0; i < numOldLeaves; i++)
+		{
+			memcpy(&pvs[i * rowBytes], &tree->pvs[i * tree->pvsRowBytes], tree->pvsRowBytes);
+		}
+		tree->pvs.swap(pvs);
+		tree->pvsRowBytes = rowBytes;
+	}
+	else
+	{
+		tree->pvs.resize(numLeaves * rowBytes, 0);
+	}
+
+	std::vector<unsigned char> changed(rowBytes, 0);
+	std::vector<unsigned char> reach(rowBytes, 0);
+	for (int i = 0; i < patch->changedLeaves.size(); i++)
+	{
+		int leafIndex = patch->changedLeaves[i];
+		SetPVSRowBit(changed.data(), leafIndex);
+		SetPVSRowBit(reach.data(), leafIndex);
+
+		unsigned char* row = &tree->pvs[leafIndex * rowBytes];
+		for (int j = 0; j < rowBytes; j++)
+		{
+			reach[j] |= row[j];
+		}
+	}
+
+	std::vector<bool> isNew(numLeaves, false);
+	for (int i = 0; i < patch->newLeaves.size(); i++)
+	{
+		isNew[patch->newLeaves[i]] = true;
+		SetPVSRowBit(reach.data(), patch->newLeaves[i]);
+	}
+
+	// an edit only changes a few leaves, so only a few bytes of a row can have one of them
+	std::vector<int> changedBytes;
+	for (int j = 0; j < rowBytes; j++)
+	{
+		if (changed[j])
+		{
+			changedBytes.push_back(j);
+		}
+	}
+
+	for (int i = 0; i < numLeaves; i++)
+	{
+		unsigned char* row = &tree->pvs[i * rowBytes];
+		bool sawChanged = isNew[i];
+		for (int j = 0; j < changedBytes.size() && !sawChanged; j++)
+		{
+			sawChanged = (row[changedBytes[j]] & changed[changedBytes[j]]) != 0;
+		}
+
+		if (sawChanged)
+		{
+			for (int j = 0; j < rowBytes; j++)
+			{
+				row[j] |= reach[j];
+			}
+		}
+	}
+}
+
+
+/*
+	Puts brush into brushes at brush.brushIndex, replacing what was there in both the BSPNode
+	tree and its flat tree. One past the end adds it, a brush without polygons removes the
+	old one. root is the tree built from brushes and flattened into tree.
+*/
+void ReplaceBSPTreeBrush(BSPNode** root, std::vector<Brush>& brushes, FlatBSPTree* tree, Brush brush,
+	BSPBuildSettings settings, FlatBSPPatch* patch)
+{
+	int brushIndex = brush.brushIndex;
+	assert(brushIndex >= 0 && brushIndex <= brushes.size());
+
+	if (brushIndex == brushes.size())
+	{
+		brushes.push_back(Brush());
+	}
+	else if (brushes[brushIndex].polygons.size() > 0)
+	{
+		BoundingBox bb = brushes[brushIndex].GetBoundingBox();
+
+		// sight lines through the old brush open up, see PatchBSPVisibility
+		if (tree->pvs.size() > 0)
+		{
+			BSPCollisionModel model = GetBSPCollisionModel(tree);
+			BoundingBox touching = { bb.min - glm::vec3(1), bb.max + glm::vec3(1) };
+			std::vector<int> leaves = BoxLeafs(&model, touching);
+			patch->changedLeaves.insert(patch->changedLeaves.end(), leaves.begin(), leaves.end());
+		}
+
+		RemoveBrushFromBSPTree(*root, brushIndex, bb);
+	}
+
+	ResetBrushUsedFlags(brush);
+	brushes[brushIndex] = brush;
+	if (brush.polygons.size() > 0)
+	{
+		*root = InsertBrushIntoBSPTree(*root, brush, settings);
+	}
+
+	SetFlatBSPBrush(tree, brush);
+	PatchFlatBSPTree(*root, brushes, tree, patch);
+	PatchBSPVisibility(tree, patch);
+}
+
+
+// how much of the PVS is set between the leaves of the tree that arent solid. Dropped leaves
+// dont count. 1 once every leaf sees every other and the PVS culls nothing
+float GetPVSDensity(FlatBSPTree* tree)
+{
+	if (tree->pvs.size() == 0)
+	{
+		return 0;
+	}
+
+	std::vector<int> leaves;
+	std::vector<int> stack;
+	stack.push_back(tree->root);
+	while (stack.size() > 0)
+	{
+		int child = stack.back();
+		stack.pop_back();
+
+		if (IsFlatBSPLeaf(child))
+		{
+			// solid leaves have an empty row, not even themselves
+			int leafIndex = FlatBSPLeafIndex(child);
+			if (IsLeafInPVSRow(&tree->pvs[leafIndex * tree->pvsRowBytes], leafIndex))
+			{
+				leaves.push_back(leafIndex);
+			}
+			continue;
+		}
+
+		stack.push_back(tree->nodes[child].children[0]);
+		stack.push_back(tree->nodes[child].children[1]);
+	}
+
+	if (leaves.size() == 0)
+	{
+		return 0;
+	}
+
+	int numVisible = 0;
+	for (int i = 0; i < leaves.size(); i++)
+	{
+		unsigned char* row = &tree->pvs[leaves[i] * tree->pvsRowBytes];
+		for (int j = 0; j < leaves.size(); j++)
+		{
+			numVisible += IsLeafInPVSRow(row, leaves[j]);
+		}
+	}
+	return numVisible / ((float)leaves.size() * leaves.size());
+}
+
+
+void ResetBSPEditState(BSPEditState* state, FlatBSPTree* tree, int numBrushes)
+{
+	state->numLiveBrushes = numBrushes;
+	numBrushes = std::max(numBrushes, 1);
+
+	state->baselineNodesPerBrush = tree->numLiveNodes / (float)numBrushes;
+	state->baselineDuplicationFactor = tree->numLiveLeafBrushes / (float)numBrushes;
+	state->baselinePVSDensity = GetPVSDensity(tree);
+	state->numEditsSinceRebuild = 0;
+}
+
+
+// true once the patched tree is much worse than what a full build gave us, its PVS has lost
+// most of the culling the full build had, or most of its arrays are things patching dropped
+bool NeedsFullRebuild(BSPEditState* state, FlatBSPTree* tree)
+{
+	const float MAX_QUALITY_RATIO = 1.5f;
+
+	// of the leaf pairs the full build's PVS culled
+	const float MAX_PVS_CULLING_LOST = 0.5f;
+
+	// small trees are cheap to rebuild and their ratios jump around
+	const float MIN_NODES_PER_BRUSH = 4;
+	const float MIN_DUPLICATION_FACTOR = 2;
+
+	// arrays can grow to this many times what is live, plus some slack for small trees
+	const int MAX_ARRAY_GROWTH = 2;
+	const int MIN_ARRAY_SLACK = 256;
+
+	int numBrushes = std::max(state->numLiveBrushes, 1);
+	float nodesPerBrush = tree->numLiveNodes / (float)numBrushes;
+	float duplicationFactor = tree->numLiveLeafBrushes / (float)numBrushes;
+
+	float maxNodesPerBrush = MAX_QUALITY_RATIO * std::max(state->baselineNodesPerBrush, MIN_NODES_PER_BRUSH);
+	float maxDuplicationFactor = MAX_QUALITY_RATIO * std::max(state->baselineDuplicationFactor, MIN_DUPLICATION_FACTOR);
+	if (nodesPerBrush > maxNodesPerBrush || duplicationFactor > maxDuplicationFactor)
+	{
+		return true;
+	}
+
+	float maxPVSDensity = state->baselinePVSDensity + MAX_PVS_CULLING_LOST * (1 - state->baselinePVSDensity);
+	if (tree->pvs.size() > 0 && GetPVSDensity(tree) > maxPVSDensity)
+	{
+		return true;
+	}
+
+	return tree->nodes.size() + tree->leaves.size() > MAX_ARRAY_GROWTH * (tree->numLiveNodes + tree->numLiveLeaves) + MIN_ARRAY_SLACK ||
+		tree->leafBrushes.size() > MAX_ARRAY_GROWTH * tree->numLiveLeafBrushes + MIN_ARRAY_SLACK ||
+		tree->brushSides.size() > MAX_ARRAY_GROWTH * tree->numLiveBrushSides + MIN_ARRAY_SLACK;
+}
@@ -0,0 +1,574 @@
+#pragma once
+
+#include <fstream>
+
+#include "bsp_tree.h"
+#include "bsp_hull.h"
+
+/*
+	Precompiled collision BSP. AssetBuilder -compile_bsp writes one per level, the game maps
+	the file into memory and points a BSPCollisionModel straight into it, so nothing gets
+	parsed or allocated at load.
+
+	 ________ ________ _______ ________ ________ _________ _______ ________ ________ _____ ________
+	| header | planes | nodes | leaves | leaf   | brushes | brush | node   | leaf   | pvs | brush  |
+	|        |        |       |        | brushes|         | sides | bounds | bounds |     | side   |
+	|        |        |       |        |        |         |       |        |        |     | blocks |
+	 -------- -------- ------- -------- -------- --------- ------- -------- -------- ----- --------
+	 __________ __________ _______ _________ _______ _______ __________
+	| brush    | brush    | brush | split   | faces | brush | polygon  |
+	| features | vertices | edges | polygons|       | faces | vertices |
+	|          |          |       |         |       |       |          |
+	 ---------- ---------- ------- --------- ------- ------- ----------
+
+	Like the lumps of quake's .bsp, every lump is an offset from the start of the file, so it
+	doesnt matter where the file ends up mapped. The structs are written as they sit in memory,
+	which means the file is only good for builds with the same struct layout on a little endian
+	machine. Compile the file again whenever the level or any of these structs change.
+
+	The header is stamped with the level and a hash of the brushes it was compiled from, and
+	a file is only loaded for exactly those brushes. Flat brush i is source brush i, so a file
+	of an older version of the level would hand out brush indices of the wrong brushes.
+
+	The last four lumps are what the game needs besides collision: the split polygon of each
+	node for the bsp overlay, and the faces CSG left visible on each source brush for the
+	entities to render. They are what the compile would have given, so a precompiled level
+	looks the same as a compiled one. Unlike the rest they get copied out at load, the
+	entities own their faces.
+
+	Clip hulls go in files of their own, same layout, with the box they were grown by in
+	the header and no polygons. The tree of the level itself has a zero sized box.
+*/
+
+const unsigned int BSP_FILE_MAGIC = ('P' << 24) | ('S' << 16) | ('B' << 8) | 'C';	// "CBSP"
+const int BSP_FILE_VERSION = 9;
+
+// enough for any of the lump structs, and a mapped file starts on a page
+const int BSP_FILE_LUMP_ALIGNMENT = 16;
+
+enum BSPFileLumpType
+{
+	BSP_LUMP_PLANES,
+	BSP_LUMP_NODES,
+	BSP_LUMP_LEAVES,
+	BSP_LUMP_LEAF_BRUSHES,
+	BSP_LUMP_BRUSHES,
+	BSP_LUMP_BRUSH_SIDES,
+	BSP_LUMP_NODE_BOUNDS,
+	BSP_LUMP_LEAF_BOUNDS,
+	BSP_LUMP_PVS,
+	BSP_LUMP_BRUSH_SIDE_BLOCKS,
+	BSP_LUMP_BRUSH_FEATURES,
+	BSP_LUMP_BRUSH_VERTICES,
+	BSP_LUMP_BRUSH_EDGES,
+	BSP_LUMP_SPLIT_POLYGONS,
+	BSP_LUMP_FACES,
+	BSP_LUMP_BRUSH_FACES,
+	BSP_LUMP_POLYGON_VERTICES,
+	NUM_BSP_LUMPS
+};
+
+// vertices [firstVertex, firstVertex + numVertices) of the polygon vertices lump
+struct BSPFilePolygon
+{
+	int firstVertex;
+	int numVertices;
+};
+
+// faces [firstFace, firstFace + numFaces) of the faces lump
+struct BSPFileBrushFaces
+{
+	int firstFace;
+	int numFaces;
+};
+
+const int bspFileLumpElementSizes[NUM_BSP_LUMPS] =
+{
+	sizeof(Plane),
+	sizeof(FlatBSPNode),
+	sizeof(FlatBSPLeaf),
+	sizeof(int),
+	sizeof(FlatBSPBrush),
+	sizeof(int),
+	sizeof(BoundingBox),
+	sizeof(BoundingBox),
+	1,
+	sizeof(BrushSideBlock),
+	sizeof(FlatBSPBrushFeatures),
+	sizeof(glm::vec3),
+	sizeof(BrushEdge),
+	sizeof(BSPFilePolygon),
+	sizeof(BSPFilePolygon),
+	sizeof(BSPFileBrushFaces),
+	sizeof(glm::vec3)
+};
+
+// in bytes
+struct BSPFileLump
+{
+	unsigned int offset;
+	unsigned int size;
+};
+
+// the level and the brushes a file was compiled from
+struct BSPFileStamp
+{
+	int level;
+	int numBrushes;
+	unsigned int brushHash;
+};
+
+struct BSPFileHeader
+{
+	unsigned int magic;
+	int version;
+	BSPFileStamp stamp;
+
+	int root;
+	int pvsRowBytes;
+	BSPHullSize hullSize;
+
+	BSPFileLump lumps[NUM_BSP_LUMPS];
+};
+
+// the polygons that go with the level's own file, see the top of the file
+struct BSPFilePolygons
+{
+	// indexed like BSPCollisionModel::nodes
+	std::vector<BspPolygon> splitPolygons;
+
+	// indexed like the source brushes, see ApplyVisibleFacesToEntities
+	std::vector<std::vector<BspPolygon>> visibleFaces;
+};
+
+
+// FNV-1a
+unsigned int HashBSPFileBytes(unsigned int hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+
+// over the exact bits of every vertex, the level builders always make the same floats
+BSPFileStamp GetBSPFileStamp(int level, std::vector<Brush>& brushes)
+{
+	BSPFileStamp stamp;
+	stamp.level = level;
+	stamp.numBrushes = brushes.size();
+	stamp.brushHash = 2166136261u;
+
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		int numPolygons = brushes[i].polygons.size();
+		stamp.brushHash = HashBSPFileBytes(stamp.brushHash, &numPolygons, sizeof(int));
+		for (int j = 0; j < numPolygons; j++)
+		{
+			std::vector<glm::vec3>& vertices = brushes[i].polygons[j].vertices;
+			int numVertices = vertices.size();
+			stamp.brushHash = HashBSPFileBytes(stamp.brushHash, &numVertices, sizeof(int));
+			stamp.brushHash = HashBSPFileBytes(stamp.brushHash, vertices.data(), numVertices * sizeof(glm::vec3));
+		}
+	}
+	return stamp;
+}
+
+
+bool IsSameBSPFileStamp(BSPFileStamp a, BSPFileStamp b)
+{
+	return a.level == b.level && a.numBrushes == b.numBrushes && a.brushHash == b.brushHash;
+}
+
+
+// the split polygons of a compiled tree, and the faces its compile left visible
+BSPFilePolygons GetBSPFilePolygons(FlatBSPTree* tree, std::vector<std::vector<BspPolygon>>& visibleFaces)
+{
+	BSPFilePolygons polygons;
+	for (int i = 0; i < tree->debugNodes.size(); i++)
+	{
+		polygons.splitPolygons.push_back(tree->debugNodes[i].splitPolygon);
+	}
+	polygons.visibleFaces = visibleFaces;
+	return polygons;
+}
+
+
+void AddBSPFilePolygon(BspPolygon& polygon, std::vector<BSPFilePolygon>& filePolygons, std::vector<glm::vec3>& vertices)
+{
+	BSPFilePolygon filePolygon;
+	filePolygon.firstVertex = vertices.size();
+	filePolygon.numVertices = polygon.vertices.size();
+	vertices.insert(vertices.end(), polygon.vertices.begin(), polygon.vertices.end());
+	filePolygons.push_back(filePolygon);
+}
+
+
+unsigned int AlignBSPFileOffset(unsigned int offset)
+{
+	return (offset + BSP_FILE_LUMP_ALIGNMENT - 1) & ~(BSP_FILE_LUMP_ALIGNMENT - 1);
+}
+
+
+void WriteBSPFilePadding(std::ofstream& file, unsigned int offset)
+{
+	while ((unsigned int)file.tellp() < offset)
+	{
+		file.put(0);
+	}
+}
+
+
+// returns false if the file couldnt be written. polygons is NULL for hulls
+bool WriteBSPFile(const char* filename, BSPCollisionModel* model, BSPFileStamp stamp, BSPHullSize hullSize = {}, 
+	BSPFilePolygons* polygons = NULL)
+{
+	std::vector<BSPFilePolygon> splitPolygons;
+	std::vector<BSPFilePolygon> faces;
+	std::vector<BSPFileBrushFaces> brushFaces;
+	std::vector<glm::vec3> polygonVertices;
+	if (polygons)
+	{
+		for (int i = 0; i < polygons->splitPolygons.size(); i++)
+		{
+			AddBSPFilePolygon(polygons->splitPolygons[i], splitPolygons, polygonVertices);
+		}
+
+		for (int i = 0; i < polygons->visibleFaces.size(); i++)
+		{
+			BSPFileBrushFaces range;
+			range.firstFace = faces.size();
+			range.numFaces = polygons->visibleFaces[i].size();
+			for (int j = 0; j < range.numFaces; j++)
+			{
+				AddBSPFilePolygon(polygons->visibleFaces[i][j], faces, polygonVertices);
+			}
+			brushFaces.push_back(range);
+		}
+	}
+
+	const void* lumpData[NUM_BSP_LUMPS];
+	int lumpCounts[NUM_BSP_LUMPS];
+
+	lumpData[BSP_LUMP_PLANES] = model->planes;			lumpCounts[BSP_LUMP_PLANES] = model->numPlanes;
+	lumpData[BSP_LUMP_NODES] = model->nodes;			lumpCounts[BSP_LUMP_NODES] = model->numNodes;
+	lumpData[BSP_LUMP_LEAVES] = model->leaves;			lumpCounts[BSP_LUMP_LEAVES] = model->numLeaves;
+	lumpData[BSP_LUMP_LEAF_BRUSHES] = model->leafBrushes;	lumpCounts[BSP_LUMP_LEAF_BRUSHES] = model->numLeafBrushes;
+	lumpData[BSP_LUMP_BRUSHES] = model->brushes;		lumpCounts[BSP_LUMP_BRUSHES] = model->numBrushes;
+	lumpData[BSP_LUMP_BRUSH_SIDES] = model->brushSides;	lumpCounts[BSP_LUMP_BRUSH_SIDES] = model->numBrushSides;
+	lumpData[BSP_LUMP_NODE_BOUNDS] = model->nodeBounds;	lumpCounts[BSP_LUMP_NODE_BOUNDS] = model->numNodes;
+	lumpData[BSP_LUMP_LEAF_BOUNDS] = model->leafBounds;	lumpCounts[BSP_LUMP_LEAF_BOUNDS] = model->numLeaves;
+	lumpData[BSP_LUMP_PVS] = model->pvs;				lumpCounts[BSP_LUMP_PVS] = model->pvs ? model->numLeaves * model->pvsRowBytes : 0;
+	lumpData[BSP_LUMP_BRUSH_SIDE_BLOCKS] = model->brushSideBlocks;	lumpCounts[BSP_LUMP_BRUSH_SIDE_BLOCKS] = model->numBrushSideBlocks;
+	lumpData[BSP_LUMP_BRUSH_FEATURES] = model->brushFeatures;	lumpCounts[BSP_LUMP_BRUSH_FEATURES] = model->numBrushes;
+	lumpData[BSP_LUMP_BRUSH_VERTICES] = model->brushVertices;	lumpCounts[BSP_LUMP_BRUSH_VERTICES] = model->numBrushVertices;
+	lumpData[BSP_LUMP_BRUSH_EDGES] = model->brushEdges;		lumpCounts[BSP_LUMP_BRUSH_EDGES] = model->numBrushEdges;
+	lumpData[BSP_LUMP_SPLIT_POLYGONS] = splitPolygons.data();	lumpCounts[BSP_LUMP_SPLIT_POLYGONS] = splitPolygons.size();
+	lumpData[BSP_LUMP_FACES] = faces.data();					lumpCounts[BSP_LUMP_FACES] = faces.size();
+	lumpData[BSP_LUMP_BRUSH_FACES] = brushFaces.data();			lumpCounts[BSP_LUMP_BRUSH_FACES] = brushFaces.size();
+	lumpData[BSP_LUMP_POLYGON_VERTICES] = polygonVertices.data();	lumpCounts[BSP_LUMP_POLYGON_VERTICES] = polygonVertices.size();
+
+	BSPFileHeader header = {};
+	header.magic = BSP_FILE_MAGIC;
+	header.version = BSP_FILE_VERSION;
+	header.stamp = stamp;
+	header.root = model->root;
+	header.pvsRowBytes = model->pvs ? model->pvsRowBytes : 0;
+	header.hullSize = hullSize;
+
+	unsigned int offset = AlignBSPFileOffset(sizeof(BSPFileHeader));
+	for (int i = 0; i < NUM_BSP_LUMPS; i++)
+	{
+		header.lumps[i].offset = offset;
+		header.lumps[i].size = lumpCounts[i] * bspFileLumpElementSizes[i];
+		offset = AlignBSPFileOffset(offset + header.lumps[i].size);
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file.write((const char*)&header, sizeof(BSPFileHeader));
+	for (int i = 0; i < NUM_BSP_LUMPS; i++)
+	{
+		WriteBSPFilePadding(file, header.lumps[i].offset);
+		if (header.lumps[i].size > 0)
+		{
+			file.write((const char*)lumpData[i], header.lumps[i].size);
+		}
+	}
+	WriteBSPFilePadding(file, offset);
+
+	return file.good();
+}
+
+
+// NULL if the lump doesnt fit in the file or isnt a whole number of elements
+void* GetBSPFileLump(void* memory, size_t size, BSPFileHeader* header, BSPFileLumpType type, int* count)
+{
+	BSPFileLump* lump = &header->lumps[type];
+	int elementSize = bspFileLumpElementSizes[type];
+
+	if ((size_t)lump->offset + lump->size > size ||
+		lump->offset % BSP_FILE_LUMP_ALIGNMENT != 0 ||
+		lump->size % elementSize != 0)
+	{
+		return NULL;
+	}
+
+	*count = lump->size / elementSize;
+	return (unsigned char*)memory + lump->offset;
+}
+
+
+// [first, first + count) inside [0, size)
+bool IsBSPFileRange(int first, int count, int size)
+{
+	return first >= 0 && count >= 0 && first <= size && count <= size - first;
+}
+
+
+bool IsBSPFileChild(int child, int parent, int numNodes, int numLeaves)
+{
+	if (IsFlatBSPLeaf(child))
+	{
+		return FlatBSPLeafIndex(child) < numLeaves;
+	}
+
+	// flattening is preorder, children come after their node. Also rules out cycles
+	return child > parent && child < numNodes;
+}
+
+
+// Every index the traces follow, so a broken file fails to load instead of sending a trace 
+// off the end of a lump
+bool IsBSPFileModelValid(BSPCollisionModel* model)
+{
+	for (int i = 0; i < model->numNodes; i++)
+	{
+		FlatBSPNode* node = &model->nodes[i];
+		if (node->planeIndex < 0 || node->planeIndex >= model->numPlanes ||
+			node->planeType < PLANE_X || node->planeType > PLANE_NON_AXIAL ||
+			!IsBSPFileChild(node->children[0], i, model->numNodes, model->numLeaves) ||
+			!IsBSPFileChild(node->children[1], i, model->numNodes, model->numLeaves))
+		{
+			return false;
+		}
+	}
+
+	for (int i = 0; i < model->numLeaves; i++)
+	{
+		if (!IsBSPFileRange(model->leaves[i].firstLeafBrush, model->leaves[i].numLeafBrushes, model->numLeafBrushes))
+		{
+			return false;
+		}
+	}
+
+	for (int i = 0; i < model->numLeafBrushes; i++)
+	{
+		if (model->leafBrushes[i] < 0 || model->leafBrushes[i] >= model->numBrushes)
+		{
+			return false;
+		}
+	}
+
+	for (int i = 0; i < model->numBrushes; i++)
+	{
+		FlatBSPBrush* brush = &model->brushes[i];
+		FlatBSPBrushFeatures* features = &model->brushFeatures[i];
+		if (!IsBSPFileRange(brush->firstSide, brush->numSides, model->numBrushSides) ||
+			!IsBSPFileRange(brush->firstSideBlock, GetNumBrushSideBlocks(brush->numSides), model->numBrushSideBlocks) ||
+			!IsBSPFileRange(features->firstVertex, features->numVertices, model->numBrushVertices) ||
+			!IsBSPFileRange(features->firstEdge, features->numEdges, model->numBrushEdges))
+		{
+			return false;
+		}
+	}
+
+	for (int i = 0; i < model->numBrushSides; i++)
+	{
+		if (model->brushSides[i] < 0 || model->brushSides[i] >= model->numPlanes)
+		{
+			return false;
+		}
+	}
+
+	for (int i = 0; i < model->numBrushEdges; i++)
+	{
+		for (int j = 0; j < 2; j++)
+		{
+			if (model->brushEdges[i].vertices[j] < 0 || model->brushEdges[i].vertices[j] >= model->numBrushVertices)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+// false if any polygon is outside the vertex lump
+bool CopyBSPFilePolygons(BSPFilePolygon* filePolygons, int count, glm::vec3* vertices, int numVertices, std::vector<BspPolygon>& polygons)
+{
+	polygons.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		if (!IsBSPFileRange(filePolygons[i].firstVertex, filePolygons[i].numVertices, numVertices))
+		{
+			return false;
+		}
+
+		glm::vec3* first = vertices + filePolygons[i].firstVertex;
+		polygons[i].vertices.assign(first, first + filePolygons[i].numVertices);
+	}
+	return true;
+}
+
+
+// the level's file has a split polygon for every node and faces for every source brush
+bool LoadBSPFilePolygons(void** lumps, int* counts, BSPFileStamp stamp, BSPFilePolygons* polygons)
+{
+	if (counts[BSP_LUMP_SPLIT_POLYGONS] != counts[BSP_LUMP_NODES] ||
+		counts[BSP_LUMP_BRUSH_FACES] != stamp.numBrushes)
+	{
+		return false;
+	}
+
+	glm::vec3* vertices = (glm::vec3*)lumps[BSP_LUMP_POLYGON_VERTICES];
+	int numVertices = counts[BSP_LUMP_POLYGON_VERTICES];
+	if (!CopyBSPFilePolygons((BSPFilePolygon*)lumps[BSP_LUMP_SPLIT_POLYGONS], counts[BSP_LUMP_SPLIT_POLYGONS], 
+		vertices, numVertices, polygons->splitPolygons))
+	{
+		return false;
+	}
+
+	std::vector<BspPolygon> faces;
+	if (!CopyBSPFilePolygons((BSPFilePolygon*)lumps[BSP_LUMP_FACES], counts[BSP_LUMP_FACES], vertices, numVertices, faces))
+	{
+		return false;
+	}
+
+	BSPFileBrushFaces* brushFaces = (BSPFileBrushFaces*)lumps[BSP_LUMP_BRUSH_FACES];
+	polygons->visibleFaces.resize(stamp.numBrushes);
+	for (int i = 0; i < stamp.numBrushes; i++)
+	{
+		if (!IsBSPFileRange(brushFaces[i].firstFace, brushFaces[i].numFaces, faces.size()))
+		{
+			return false;
+		}
+		polygons->visibleFaces[i].assign(faces.begin() + brushFaces[i].firstFace, 
+			faces.begin() + brushFaces[i].firstFace + brushFaces[i].numFaces);
+	}
+	return true;
+}
+
+
+// Points model into memory, which has to stay around for as long as the model is used.
+// The file has to be stamped with stamp, and every index in it is range checked.
+// hullSize can be NULL, otherwise it gets the box the tree was grown by. 
+// polygons can be NULL, otherwise the file has to have them and they get copied out
+bool LoadBSPFile(void* memory, size_t size, BSPFileStamp stamp, BSPCollisionModel* model, BSPHullSize* hullSize = NULL,
+	BSPFilePolygons* polygons = NULL)
+{
+	*model = {};
+
+	if (memory == NULL || size < sizeof(BSPFileHeader))
+	{
+		return false;
+	}
+
+	BSPFileHeader* header = (BSPFileHeader*)memory;
+	if (header->magic != BSP_FILE_MAGIC || header->version != BSP_FILE_VERSION ||
+		!IsSameBSPFileStamp(header->stamp, stamp))
+	{
+		return false;
+	}
+
+	void* lumps[NUM_BSP_LUMPS];
+	int counts[NUM_BSP_LUMPS];
+	for (int i = 0; i < NUM_BSP_LUMPS; i++)
+	{
+		lumps[i] = GetBSPFileLump(memory, size, header, (BSPFileLumpType)i, &counts[i]);
+		if (lumps[i] == NULL)
+		{
+			return false;
+		}
+	}
+
+	int numNodes = counts[BSP_LUMP_NODES];
+	int numLeaves = counts[BSP_LUMP_LEAVES];
+	if (numLeaves == 0 ||
+		counts[BSP_LUMP_NODE_BOUNDS] != numNodes ||
+		counts[BSP_LUMP_BRUSH_FEATURES] != counts[BSP_LUMP_BRUSHES] ||
+		counts[BSP_LUMP_LEAF_BOUNDS] != numLeaves ||
+		header->pvsRowBytes < 0 ||
+		counts[BSP_LUMP_PVS] != numLeaves * header->pvsRowBytes ||
+		(counts[BSP_LUMP_PVS] > 0 && header->pvsRowBytes < (numLeaves + 7) / 8))
+	{
+		return false;
+	}
+
+	if (IsFlatBSPLeaf(header->root) ? FlatBSPLeafIndex(header->root) >= numLeaves : header->root != 0 || numNodes == 0)
+	{
+		return false;
+	}
+
+	model->root = header->root;
+
+	model->planes = (Plane*)lumps[BSP_LUMP_PLANES];
+	model->numPlanes = counts[BSP_LUMP_PLANES];
+
+	model->nodes = (FlatBSPNode*)lumps[BSP_LUMP_NODES];
+	model->numNodes = numNodes;
+
+	model->leaves = (FlatBSPLeaf*)lumps[BSP_LUMP_LEAVES];
+	model->numLeaves = numLeaves;
+
+	model->leafBrushes = (int*)lumps[BSP_LUMP_LEAF_BRUSHES];
+	model->numLeafBrushes = counts[BSP_LUMP_LEAF_BRUSHES];
+
+	model->brushes = (FlatBSPBrush*)lumps[BSP_LUMP_BRUSHES];
+	model->numBrushes = counts[BSP_LUMP_BRUSHES];
+
+	model->brushSides = (int*)lumps[BSP_LUMP_BRUSH_SIDES];
+	model->numBrushSides = counts[BSP_LUMP_BRUSH_SIDES];
+
+	model->brushSideBlocks = (BrushSideBlock*)lumps[BSP_LUMP_BRUSH_SIDE_BLOCKS];
+	model->numBrushSideBlocks = counts[BSP_LUMP_BRUSH_SIDE_BLOCKS];
+
+	model->brushFeatures = (FlatBSPBrushFeatures*)lumps[BSP_LUMP_BRUSH_FEATURES];
+
+	model->brushVertices = (glm::vec3*)lumps[BSP_LUMP_BRUSH_VERTICES];
+	model->numBrushVertices = counts[BSP_LUMP_BRUSH_VERTICES];
+
+	model->brushEdges = (BrushEdge*)lumps[BSP_LUMP_BRUSH_EDGES];
+	model->numBrushEdges = counts[BSP_LUMP_BRUSH_EDGES];
+
+	model->nodeBounds = (BoundingBox*)lumps[BSP_LUMP_NODE_BOUNDS];
+	model->leafBounds = (BoundingBox*)lumps[BSP_LUMP_LEAF_BOUNDS];
+
+	if (counts[BSP_LUMP_PVS] > 0)
+	{
+		model->pvs = (unsigned char*)lumps[BSP_LUMP_PVS];
+		model->pvsRowBytes = header->pvsRowBytes;
+	}
+
+	// source brushes are flattened first, every one of them has its flat brush
+	if (model->numBrushes < stamp.numBrushes || !IsBSPFileModelValid(model) ||
+		(polygons && !LoadBSPFilePolygons(lumps, counts, stamp, polygons)))
+	{
+		*model = {};
+		return false;
+	}
+
+	if (hullSize)
+	{
+		*hullSize = header->hullSize;
+	}
+	return true;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "bsp_tree.h"
+
+/*
+	Clip hulls, like quake's. A box touches a brush exactly when the box's origin is inside
+	the brush grown by the box (the Minkowski sum of the brush and the box mirrored through
+	the origin). So for the box sizes we trace with all the time, the compiler builds one more
+	tree out of grown brushes, and a box trace of that size becomes a point trace against it.
+	No per plane box offsets at trace time, and no offsets to push traversal down both sides.
+
+		 _______					 ___________
+		|		|	   + [-10, 10]	|  _______  |
+		| brush |		  ---->		| |		  | |
+		|_______|					| |_______| |
+									|___________|
+
+	The grown brush is cut by every plane its faces could have: its own faces pushed out by
+	the box, the 6 axial planes, and the bevels between its edges and the axes. Without the
+	bevels a box sliding along the edge of a ramp would be stopped by planes that are far
+	out past the corner.
+*/
+
+const int MAX_BSP_HULLS = 4;
+
+struct BSPHullSize
+{
+	glm::vec3 mins;
+	glm::vec3 maxs;
+};
+
+struct BSPHull
+{
+	BSPHullSize size;
+
+	// compiler output, empty when the hull was loaded from a file
+	FlatBSPTree tree;
+	BSPCollisionModel model;
+
+	// the compiler side, kept so brush edits can patch the hull like the world tree.
+	// brushes are the grown brushes, indexed by Brush::brushIndex
+	BSPNode* root;
+	std::vector<Brush> brushes;
+};
+
+
+// the supporting plane with this normal of the brush grown by size.
+// The offsets are the same ones CheckBrush pushes planes out with
+Plane GetHullPlane(glm::vec3 normal, Brush& brush, BSPHullSize size)
+{
+	float distance = -FLT_MAX;
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		for (int j = 0; j < brush.polygons[i].vertices.size(); j++)
+		{
+			distance = std::max(distance, glm::dot(normal, brush.polygons[i].vertices[j]));
+		}
+	}
+
+	glm::vec3 offset;
+	for (int i = 0; i < 3; i++)
+	{
+		offset[i] = normal[i] < 0 ? size.maxs[i] : size.mins[i];
+	}
+
+	Plane plane;
+	plane.normal = normal;
+	plane.distance = distance - glm::dot(offset, normal);
+	return plane;
+}
+
+
+// Removed brushes stay empty, so the result lines up with brushes by brushIndex
+Brush ExpandBrushForHull(Brush& brush, BSPHullSize size)
+{
+	Brush expanded;
+	expanded.entityIndex = brush.entityIndex;
+	expanded.brushIndex = brush.brushIndex;
+	if (brush.polygons.size() == 0)
+	{
+		return expanded;
+	}
+
+	std::vector<glm::vec3> normals = GetBrushBevelNormals(brush);
+
+	std::vector<Plane> planes;
+	for (int i = 0; i < normals.size(); i++)
+	{
+		planes.push_back(GetHullPlane(normals[i], brush, size));
+	}
+
+	BoundingBox bb = brush.GetBoundingBox();
+	bb.min -= size.maxs;
+	bb.max -= size.mins;
+
+	// a face of the grown brush is what is left of its plane after clipping by all the others.
+	// Bevels that only touch the brush along an edge clip down to nothing
+	const float MIN_HULL_FACE_AREA = 0.01f;
+	for (int i = 0; i < planes.size(); i++)
+	{
+		std::vector<glm::vec3> vertices = BaseWindingForPlane(planes[i], bb);
+		for (int j = 0; j < planes.size() && vertices.size() >= 3; j++)
+		{
+			if (j != i)
+			{
+				vertices = ClipVerticesBehindPlane(vertices, planes[j]);
+			}
+		}
+
+		if (vertices.size() < 3)
+		{
+			continue;
+		}
+
+		glm::vec3 areaVector = glm::vec3(0);
+		for (int j = 1; j + 1 < vertices.size(); j++)
+		{
+			areaVector += glm::cross(vertices[j] - vertices[0], vertices[j + 1] - vertices[0]);
+		}
+		if (glm::length(areaVector) * 0.5f < MIN_HULL_FACE_AREA)
+		{
+			continue;
+		}
+
+		BspPolygon polygon(&vertices[0], vertices.size());
+		polygon.plane = planes[i];
+		expanded.polygons.push_back(polygon);
+	}
+
+	expanded.used.assign(expanded.polygons.size(), false);
+	return expanded;
+}
+
+
+// brushes has to be indexed by brushIndex, like World::brushes
+void CompileBSPHull(std::vector<Brush>& brushes, BSPHullSize size, BSPBuildSettings settings, BSPHull* hull)
+{
+	hull->brushes.clear();
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		hull->brushes.push_back(ExpandBrushForHull(brushes[i], size));
+		hull->brushes[i].brushIndex = i;
+	}
+
+	hull->size = size;
+	hull->tree = FlatBSPTree();
+
+	hull->root = BuildBSPTree(hull->brushes, 0, settings);
+	FlattenBSPTree(hull->root, hull->brushes, &hull->tree);
+
+	hull->model = GetBSPCollisionModel(&hull->tree);
+}
+
+
+// what only the compiler and edits need, traces just use the model
+void FreeBSPHullTree(BSPHull* hull)
+{
+	FreeBSPTree(hull->root);
+	hull->root = NULL;
+	hull->brushes.clear();
+}
+
+
+bool IsHullSize(BSPHullSize size, glm::vec3 mins, glm::vec3 maxs)
+{
+	return size.mins == mins && size.maxs == maxs;
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+
+#include "bsp_tree.h"
+#include "bsp_edit.h"
+#include "bsp_vis.h"
+
+/*
+	Timed BSP compile (CSG -> build -> flatten -> vis) and a JSON report of the result,
+	so we can diff tree quality and compile times between versions of the compiler.
+*/
+
+const int BSP_REPORT_VERSION = 1;
+
+struct BSPBuildReport
+{
+	const char* levelName;
+	BSPBuildSettings settings;
+	int numIterations;
+
+	int numSourceBrushes;
+	int numSourcePolygons;
+	int numVisibleFaces;
+
+	// milliseconds, averaged over numIterations
+	double csgMs;
+	double buildMs;
+	double flattenMs;
+	double visMs;
+	double totalMs;
+	double minTotalMs;
+
+	BSPBuildCounters counters;
+	BSPTreeStats treeStats;
+	VisStats visStats;
+	int numPlanes;
+};
+
+
+double GetElapsedMs(std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end)
+{
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+
+// Runs the whole compile on brushes. The returned BSPNode tree is owned by the caller.
+// report can be NULL, otherwise the timings and counters of this run are written into it
+BSPNode* CompileBSP(std::vector<Brush>& brushes, BSPBuildSettings settings, FlatBSPTree* tree,
+	std::vector<std::vector<BspPolygon>>* visibleFaces, BSPBuildReport* report)
+{
+	BSPBuildCounters counters = {};
+	settings.counters = &counters;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	if (settings.verbose)
+	{
+		std::cout << "############# CSG" << std::endl;
+	}
+	*visibleFaces = CSGRemoveHiddenFaces(brushes);
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	if (settings.verbose)
+	{
+		std::cout << "############# BuildBSPTree" << std::endl;
+	}
+	BSPNode* root = BuildBSPTree(brushes, 0, settings);
+	auto t2 = std::chrono::high_resolution_clock::now();
+
+	*tree = FlatBSPTree();
+	FlattenBSPTree(root, brushes, tree);
+	auto t3 = std::chrono::high_resolution_clock::now();
+
+	if (settings.verbose)
+	{
+		std::cout << "############# Vis" << std::endl;
+	}
+	VisStats visStats = ComputeBSPVisibility(tree);
+	auto t4 = std::chrono::high_resolution_clock::now();
+
+	if (report)
+	{
+		report->settings = settings;
+		report->settings.counters = NULL;
+		report->numIterations = 1;
+
+		report->numSourceBrushes = brushes.size();
+		report->numSourcePolygons = 0;
+		for (int i = 0; i < brushes.size(); i++)
+		{
+			report->numSourcePolygons += brushes[i].polygons.size();
+		}
+
+		report->numVisibleFaces = 0;
+		for (int i = 0; i < visibleFaces->size(); i++)
+		{
+			report->numVisibleFaces += (*visibleFaces)[i].size();
+		}
+
+		report->csgMs = GetElapsedMs(t0, t1);
+		report->buildMs = GetElapsedMs(t1, t2);
+		report->flattenMs = GetElapsedMs(t2, t3);
+		report->visMs = GetElapsedMs(t3, t4);
+		report->totalMs = GetElapsedMs(t0, t4);
+		report->minTotalMs = report->totalMs;
+
+		report->counters = counters;
+		report->treeStats = GetFlatBSPTreeStats(tree);
+		report->visStats = visStats;
+		report->numPlanes = tree->planes.size();
+	}
+
+	return root;
+}
+
+
+// compiles a fresh copy of brushes numIterations times, timings in the report are averaged
+void BenchmarkBSPCompile(const char* levelName, std::vector<Brush>& brushes, BSPBuildSettings settings,
+	int numIterations, BSPBuildReport* report)
+{
+	settings.verbose = false;
+	numIterations = std::max(numIterations, 1);
+
+	double csgMs = 0, buildMs = 0, flattenMs = 0, visMs = 0, totalMs = 0, minTotalMs = DBL_MAX;
+	for (int i = 0; i < numIterations; i++)
+	{
+		// CSG marks hidden faces as used, so every run needs its own copy
+		std::vector<Brush> brushesCopy = brushes;
+		std::vector<std::vector<BspPolygon>> visibleFaces;
+		FlatBSPTree tree;
+
+		BSPNode* root = CompileBSP(brushesCopy, settings, &tree, &visibleFaces, report);
+		FreeBSPTree(root);
+
+		csgMs += report->csgMs;
+		buildMs += report->buildMs;
+		flattenMs += report->flattenMs;
+		visMs += report->visMs;
+		totalMs += report->totalMs;
+		minTotalMs = std::min(minTotalMs, report->totalMs);
+	}
+
+	report->levelName = levelName;
+	report->numIterations = numIterations;
+	report->csgMs = csgMs / numIterations;
+	report->buildMs = buildMs / numIterations;
+	report->flattenMs = flattenMs / numIterations;
+	report->visMs = visMs / numIterations;
+	report->totalMs = totalMs / numIterations;
+	report->minTotalMs = minTotalMs;
+}
+
+
+void WriteBSPReportJson(std::ostream& out, BSPBuildReport* report, const char* indent = "")
+{
+	BSPTreeStats* stats = &report->treeStats;
+	BSPBuildCounters* counters = &report->counters;
+
+	float brushDuplicationFactor = 0;
+	if (report->numSourceBrushes > 0)
+	{
+		brushDuplicationFactor = stats->numLeafBrushes / (float)report->numSourceBrushes;
+	}
+
+	float averageLeafBrushes = 0;
+	if (stats->numLeaves > 0)
+	{
+		averageLeafBrushes = stats->numLeafBrushes / (float)stats->numLeaves;
+	}
+
+	float averageSolidLeafBrushes = 0;
+	if (stats->numSolidLeaves > 0)
+	{
+		averageSolidLeafBrushes = stats->numLeafBrushes / (float)stats->numSolidLeaves;
+	}
+
+	out << indent << "{" << std::endl;
+	out << indent << "	\"reportVersion\": " << BSP_REPORT_VERSION << "," << std::endl;
+	out << indent << "	\"level\": \"" << (report->levelName ? report->levelName : "") << "\"," << std::endl;
+	out << indent << "	\"splitCostModel\": \"" << GetSplitCostModelName(report->settings.splitCostModel) << "\"," << std::endl;
+	out << indent << "	\"iterations\": " << report->numIterations << "," << std::endl;
+
+	out << indent << "	\"timeMs\": {" << std::endl;
+	out << indent << "		\"csg\": " << report->csgMs << "," << std::endl;
+	out << indent << "		\"build\": " << report->buildMs << "," << std::endl;
+	out << indent << "		\"flatten\": " << report->flattenMs << "," << std::endl;
+	out << indent << "		\"vis\": " << report->visMs << "," << std::endl;
+	out << indent << "		\"total\": " << report->totalMs << "," << std::endl;
+	out << indent << "		\"minTotal\": " << report->minTotalMs << std::endl;
+	out << indent << "	}," << std::endl;
+
+	out << indent << "	\"input\": {" << std::endl;
+	out << indent << "		\"brushes\": " << report->numSourceBrushes << "," << std::endl;
+	out << indent << "		\"polygons\": " << report->numSourcePolygons << "," << std::endl;
+	out << indent << "		\"visibleFaces\": " << report->numVisibleFaces << std::endl;
+	out << indent << "	}," << std::endl;
+
+	out << indent << "	\"tree\": {" << std::endl;
+	out << indent << "		\"nodes\": " << stats->numNodes << "," << std::endl;
+	out << indent << "		\"leaves\": " << stats->numLeaves << "," << std::endl;
+	out << indent << "		\"solidLeaves\": " << stats->numSolidLeaves << "," << std::endl;
+	out << indent << "		\"emptyLeaves\": " << stats->numLeaves - stats->numSolidLeaves << "," << std::endl;
+	out << indent << "		\"planes\": " << report->numPlanes << "," << std::endl;
+	out << indent << "		\"maxDepth\": " << stats->maxDepth << "," << std::endl;
+	out << indent << "		\"averageLeafDepth\": " << stats->averageLeafDepth << "," << std::endl;
+	out << indent << "		\"leafDepthHistogram\": [";
+	for (int i = 0; i < stats->leafDepthHistogram.size(); i++)
+	{
+		out << (i > 0 ? ", " : "") << stats->leafDepthHistogram[i];
+	}
+	out << "]" << std::endl;
+	out << indent << "	}," << std::endl;
+
+	out << indent << "	\"splits\": {" << std::endl;
+	out << indent << "		\"brushesSplit\": " << counters->numBrushesSplit << "," << std::endl;
+	out << indent << "		\"polygonsSplit\": " << counters->numPolygonsSplit << "," << std::endl;
+	out << indent << "		\"brushPieces\": " << counters->numBrushPieces << std::endl;
+	out << indent << "	}," << std::endl;
+
+	out << indent << "	\"vis\": {" << std::endl;
+	out << indent << "		\"portals\": " << report->visStats.numPortals << "," << std::endl;
+	out << indent << "		\"solidLeaves\": " << report->visStats.numSolidLeaves << "," << std::endl;
+	out << indent << "		\"threads\": " << report->visStats.numThreads << "," << std::endl;
+	out << indent << "		\"averageVisibleLeaves\": " << report->visStats.averageVisibleLeaves << std::endl;
+	out << indent << "	}," << std::endl;
+
+	out << indent << "	\"leafBrushRefs\": " << stats->numLeafBrushes << "," << std::endl;
+	out << indent << "	\"brushDuplicationFactor\": " << brushDuplicationFactor << "," << std::endl;
+	out << indent << "	\"averageLeafBrushes\": " << averageLeafBrushes << "," << std::endl;
+	out << indent << "	\"averageSolidLeafBrushes\": " << averageSolidLeafBrushes << "," << std::endl;
+	out << indent << "	\"estimatedTraceCost\": " << stats->estimatedTraceCost << std::endl;
+	out << indent << "}";
+}
@@ -3,6 +3,9 @@
 #include "../PlatformShared/platform_shared.h"
 
 #include <algorithm>
+#include <atomic>
+#include <climits>
+#include <float.h>
 #include <iostream>
 #include <vector>
 
@@ -13,6 +16,84 @@ struct BoundingBox
 	glm::vec3 max;
 };
 
+// min > max, so that the first AddPointToBoundingBox sets it to that point
+BoundingBox EmptyBoundingBox()
+{
+	BoundingBox bb;
+	bb.min = glm::vec3(FLT_MAX);
+	bb.max = glm::vec3(-FLT_MAX);
+	return bb;
+}
+
+bool IsBoundingBoxEmpty(const BoundingBox& bb)
+{
+	return bb.min.x > bb.max.x || bb.min.y > bb.max.y || bb.min.z > bb.max.z;
+}
+
+void AddPointToBoundingBox(BoundingBox& bb, glm::vec3 point)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		bb.min[i] = std::min<float>(bb.min[i], point[i]);
+		bb.max[i] = std::max<float>(bb.max[i], point[i]);
+	}
+}
+
+BoundingBox UnionBoundingBox(const BoundingBox& a, const BoundingBox& b)
+{
+	BoundingBox result;
+	for (int i = 0; i < 3; i++)
+	{
+		result.min[i] = std::min<float>(a.min[i], b.min[i]);
+		result.max[i] = std::max<float>(a.max[i], b.max[i]);
+	}
+	return result;
+}
+
+// touching counts as overlapping. Empty boxes never overlap anything
+bool BoundingBoxesOverlap(const BoundingBox& a, const BoundingBox& b)
+{
+	return a.min.x <= b.max.x && b.min.x <= a.max.x &&
+			a.min.y <= b.max.y && b.min.y <= a.max.y &&
+			a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+// slab test of the segment start + t * delta, t in [0, maxFraction]
+bool SegmentOverlapsBoundingBox(glm::vec3 start, glm::vec3 delta, const BoundingBox& bb, float maxFraction)
+{
+	float tMin = 0;
+	float tMax = maxFraction;
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (fabs(delta[i]) < 1e-8f)
+		{
+			if (start[i] < bb.min[i] || start[i] > bb.max[i])
+			{
+				return false;
+			}
+		}
+		else
+		{
+			float invDelta = 1.0f / delta[i];
+			float t0 = (bb.min[i] - start[i]) * invDelta;
+			float t1 = (bb.max[i] - start[i]) * invDelta;
+			if (t0 > t1)
+			{
+				std::swap(t0, t1);
+			}
+
+			tMin = std::max(tMin, t0);
+			tMax = std::min(tMax, t1);
+			if (tMin > tMax)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
 struct Plane
 {
 	glm::vec3 normal;
@@ -67,7 +148,8 @@ struct BSPLeaf
 };
 */
 
-int idCounter;
+// atomic because world rebuilds compile on a worker thread while the game edits brushes
+std::atomic<int> idCounter(0);
 struct BspPolygon
 {
 	std::vector<glm::vec3> vertices;
@@ -112,6 +194,26 @@ struct Brush
 	std::vector<BspPolygon> polygons;
 	std::vector<bool> used;
 
+	// entity that renders this brush, so CSG results can be written back to its model. -1 if none
+	int entityIndex = -1;
+
+	// index of the brush this came from in the list given to BuildBSPTree. 
+	// Pieces created by SplitBrush keep the index of the brush they were cut from
+	int brushIndex = -1;
+
+	BoundingBox GetBoundingBox()
+	{
+		BoundingBox bb = EmptyBoundingBox();
+		for (int i = 0; i < polygons.size(); i++)
+		{
+			for (int j = 0; j < polygons[i].vertices.size(); j++)
+			{
+				AddPointToBoundingBox(bb, polygons[i].vertices[j]);
+			}
+		}
+		return bb;
+	}
+
 	void PrintDebug()
 	{
 		std::cout << "Printing Brush" << std::endl;
@@ -124,7 +226,11 @@ struct Brush
 };
 
 
-int nodeIdCounter;
+std::atomic<int> nodeIdCounter(0);
+
+// BSPNode::flatChild of a node FlattenBSPTree hasnt seen yet
+const int FLAT_BSP_NOT_FLATTENED = INT_MAX;
+
 struct BSPNode
 {
 	static int idCounter;
@@ -139,17 +245,29 @@ struct BSPNode
 	// leafs only
 	std::vector<Brush> brushes;
 
-
+	// tight bounds of all the brushes in this subtree. Empty leaves get an empty box
 	glm::vec3 bboxMin;
 	glm::vec3 bboxMax;
 
-	BSPNode() { id = nodeIdCounter++; }
+	// where FlattenBSPTree put this node, and whether an edit went through it since.
+	// Lets PatchFlatBSPTree in bsp_edit.h redo only what an edit touched
+	int flatChild;
+	bool dirty;
+
+	BSPNode()
+	{
+		id = nodeIdCounter++;
+		flatChild = FLAT_BSP_NOT_FLATTENED;
+		dirty = false;
+	}
 
 	BSPNode(BSPNode* frontTree, BSPNode* backTree)
 	{
 		id = nodeIdCounter++;
 		children[0] = frontTree;
 		children[1] = backTree;
+		flatChild = FLAT_BSP_NOT_FLATTENED;
+		dirty = false;
 	}
 
 	bool IsEmpty()
@@ -190,14 +308,114 @@ enum SplittingPlaneResult
 	BRUSH_COPLANNAR
 };
 
+/*
+	Snapping, so faces that are meant to be on the same plane end up on exactly the same 
+	plane, instead of planes a few ulps apart that the compiler has to split against each 
+	other. Same idea as SnapVector / SnapPlane in qbsp.
+
+	- a normal within NORMAL_SNAP_EPSILON of an axis becomes that axis, tiny components become 0
+	- a plane distance within DIST_SNAP_EPSILON of an integer becomes that integer
+	- a vertex coordinate within VERTEX_SNAP_EPSILON of the VERTEX_SNAP_GRID goes on the grid
+*/
+const float NORMAL_SNAP_EPSILON = 0.00001f;
+const float DIST_SNAP_EPSILON = 0.01f;
+const float VERTEX_SNAP_GRID = 1.0f / 8.0f;
+const float VERTEX_SNAP_EPSILON = 0.01f;
+
+float SnapToGrid(float value, float grid, float epsilon)
+{
+	float snapped = floor(value / grid + 0.5f) * grid;
+	if (fabs(value - snapped) < epsilon)
+	{
+		return snapped;
+	}
+	return value;
+}
+
+void SnapNormal(glm::vec3& normal)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (fabs(fabs(normal[i]) - 1) < NORMAL_SNAP_EPSILON)
+		{
+			float sign = normal[i] > 0 ? 1.0f : -1.0f;
+			normal = glm::vec3(0);
+			normal[i] = sign;
+			return;
+		}
+	}
+
+	bool changed = false;
+	for (int i = 0; i < 3; i++)
+	{
+		if (normal[i] != 0 && fabs(normal[i]) < NORMAL_SNAP_EPSILON)
+		{
+			normal[i] = 0;
+			changed = true;
+		}
+	}
+
+	if (changed)
+	{
+		normal = glm::normalize(normal);
+	}
+}
+
+void SnapVertex(glm::vec3& vertex)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		vertex[i] = SnapToGrid(vertex[i], VERTEX_SNAP_GRID, VERTEX_SNAP_EPSILON);
+	}
+}
+
+// Call on a brush before anything gets built from it. Vertices go on the grid first, then 
+// each face gets a snapped plane through its snapped vertices
+void SnapBrush(Brush& brush)
+{
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		BspPolygon& polygon = brush.polygons[i];
+		for (int j = 0; j < polygon.vertices.size(); j++)
+		{
+			SnapVertex(polygon.vertices[j]);
+		}
+
+		SnapNormal(polygon.plane.normal);
+
+		float distance = 0;
+		for (int j = 0; j < polygon.vertices.size(); j++)
+		{
+			distance += glm::dot(polygon.plane.normal, polygon.vertices[j]);
+		}
+		polygon.plane.distance = SnapToGrid(distance / polygon.vertices.size(), 1, DIST_SNAP_EPSILON);
+	}
+}
+
+
+/*
+	How thick a plane is when classifying points against it. The absolute part covers 
+	authoring slop, the relative part covers float error, which grows with the distance 
+	from the origin. So a level built far from the origin doesnt start splitting faces 
+	that lie on the plane.
+*/
+const float PLANE_THICKNESS_EPSILON = 0.1f;
+const float PLANE_THICKNESS_EPSILON_RELATIVE = 0.000001f;
+
+float GetPlaneThickness(Plane plane, glm::vec3 point)
+{
+	float scale = std::max(fabs(plane.distance), std::max(fabs(point.x), std::max(fabs(point.y), fabs(point.z))));
+	return PLANE_THICKNESS_EPSILON + scale * PLANE_THICKNESS_EPSILON_RELATIVE;
+}
+
 SplittingPlaneResult ClassifyPointToPlane(glm::vec3 point, Plane splittingPlane)
 {
-	const float PLANE_THICKNESS_EPSILON = 0.1;
+	float thickness = GetPlaneThickness(splittingPlane, point);
 	float dist = glm::dot(splittingPlane.normal, point) - splittingPlane.distance;
 
-	if (dist > PLANE_THICKNESS_EPSILON)
+	if (dist > thickness)
 		return SplittingPlaneResult::POINT_FRONT;
-	if (dist < -PLANE_THICKNESS_EPSILON)
+	if (dist < -thickness)
 		return SplittingPlaneResult::POINT_BACK;
 	return SplittingPlaneResult::POINT_ON_PLANE;
 }
@@ -283,6 +501,90 @@ bool IsAxialPlane(Plane plane)
 }
 
 
+// Like cplane_t::type in quake. Only planes facing the positive axis are PLANE_X/Y/Z, 
+// FlattenBSPTree flips the other axial ones, so the distance to an axial plane is just 
+// one coordinate minus the plane distance
+enum PlaneType
+{
+	PLANE_X,
+	PLANE_Y,
+	PLANE_Z,
+	PLANE_NON_AXIAL
+};
+
+PlaneType GetPlaneType(Plane plane)
+{
+	if (plane.normal == glm::vec3(1, 0, 0))
+		return PLANE_X;
+	if (plane.normal == glm::vec3(0, 1, 0))
+		return PLANE_Y;
+	if (plane.normal == glm::vec3(0, 0, 1))
+		return PLANE_Z;
+	return PLANE_NON_AXIAL;
+}
+
+
+// How PickSplittingPlane scores candidate planes
+enum SplitCostModel
+{
+	SPLIT_COST_BALANCE,		// numInBoth + |numInFront - numInBack|, with a penalty for non axial planes
+	SPLIT_COST_SAH,			// surface area heuristic, expected cost of a trace going through the node
+	SPLIT_COST_PROFILE,		// what the traces of BSPBuildSettings::traceCorpus would cost, counted per child
+};
+
+
+// a box trace as the game issued it
+struct RecordedTrace
+{
+	glm::vec3 start;
+	glm::vec3 end;
+	glm::vec3 mins;
+	glm::vec3 maxs;
+};
+
+// traces recorded from play, or made up to look like it. See WorldBoxTrace, and CreatePlayerTraceCorpus in the AssetBuilder
+struct TraceCorpus
+{
+	std::vector<RecordedTrace> traces;
+};
+
+void RecordTrace(TraceCorpus* corpus, glm::vec3 start, glm::vec3 end, glm::vec3 mins, glm::vec3 maxs)
+{
+	RecordedTrace trace = { start, end, mins, maxs };
+	corpus->traces.push_back(trace);
+}
+
+// filled in by BuildBSPTree_r when BSPBuildSettings::counters is set
+struct BSPBuildCounters
+{
+	int numBrushesSplit;
+	int numPolygonsSplit;
+	int numBrushPieces;		// brush pieces that ended up in leaves
+};
+
+struct BSPBuildSettings
+{
+	SplitCostModel splitCostModel = SPLIT_COST_BALANCE;
+	bool verbose = true;
+
+	// only used by SPLIT_COST_PROFILE
+	TraceCorpus* traceCorpus = NULL;
+
+	BSPBuildCounters* counters = NULL;
+};
+
+const char* GetSplitCostModelName(SplitCostModel model)
+{
+	switch (model)
+	{
+		case SPLIT_COST_BALANCE:	return "balance";
+		case SPLIT_COST_SAH:		return "sah";
+		case SPLIT_COST_PROFILE:	return "profile";
+	}
+	return "unknown";
+}
+
+
 float EvaluateSplittingPlane(int id, Plane splittingPlane, std::vector<Brush>& brushes, bool print = false)
 {
 	// std::cout << "id is " << id; 
@@ -378,9 +680,203 @@ void ExtendPlanePolygon(BspPolygon& polygon, BoundingBox bb)
 	polygon.vertices = v;
 }
 
+BoundingBox GetBrushesBoundingBox(std::vector<Brush>& brushes)
+{
+	BoundingBox bb = EmptyBoundingBox();
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		bb = UnionBoundingBox(bb, brushes[i].GetBoundingBox());
+	}
+	return bb;
+}
+
+float GetBoundingBoxSurfaceArea(const BoundingBox& bb)
+{
+	if (IsBoundingBoxEmpty(bb))
+	{
+		return 0;
+	}
+
+	glm::vec3 d = bb.max - bb.min;
+	return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+
+// relative costs used by the SAH model. A brush test is a CheckBrush, 
+// which is about one plane test per face
+const float SAH_TRAVERSAL_COST_AXIAL = 1.0f;
+const float SAH_TRAVERSAL_COST_NON_AXIAL = 1.5f;
+const float SAH_BRUSH_TEST_COST = 6.0f;
+
+// the brushes on each side of a split plane and their bounds. Brushes that cross the plane
+// count on both sides
+struct SplitSides
+{
+	int numInFront;
+	int numInBack;
+	BoundingBox frontBounds;
+	BoundingBox backBounds;
+};
+
+SplitSides GetSplitSides(Plane splittingPlane, std::vector<Brush>& brushes, std::vector<BoundingBox>& brushBounds)
+{
+	SplitSides sides;
+	sides.numInFront = 0;
+	sides.numInBack = 0;
+	sides.frontBounds = EmptyBoundingBox();
+	sides.backBounds = EmptyBoundingBox();
+
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		bool hasFront = false, hasBack = false;
+		std::vector<BspPolygon>& polygons = brushes[i].polygons;
+		for (int j = 0; j < polygons.size(); j++)
+		{
+			for (int k = 0; k < polygons[j].vertices.size(); k++)
+			{
+				SplittingPlaneResult result = ClassifyPointToPlane(polygons[j].vertices[k], splittingPlane);
+				hasFront |= result == SplittingPlaneResult::POINT_FRONT;
+				hasBack |= result == SplittingPlaneResult::POINT_BACK;
+			}
+		}
+
+		// a brush lying exactly on the plane goes in front, same as EvaluateSplittingPlane
+		if (hasFront || !hasBack)
+		{
+			sides.numInFront++;
+			sides.frontBounds = UnionBoundingBox(sides.frontBounds, brushBounds[i]);
+		}
+		if (hasBack)
+		{
+			sides.numInBack++;
+			sides.backBounds = UnionBoundingBox(sides.backBounds, brushBounds[i]);
+		}
+	}
+	return sides;
+}
+
+
+/*
+	Surface area heuristic. For a trace that enters the parent volume, the chance it also
+	enters a child is roughly surfaceArea(child) / surfaceArea(parent), so
+
+		cost = traversal + brushTest * (SA(front) / SA(parent) * numFront + SA(back) / SA(parent) * numBack)
+
+	brushes that cross the plane count on both sides. For axial planes the child volumes are 
+	the parent box cut at the plane, otherwise we use the bounds of the brushes on each side.
+*/
+float EvaluateSplittingPlaneSAH(Plane splittingPlane, std::vector<Brush>& brushes, 
+	std::vector<BoundingBox>& brushBounds, BoundingBox parentBounds)
+{
+	SplitSides sides = GetSplitSides(splittingPlane, brushes, brushBounds);
+	int numInFront = sides.numInFront, numInBack = sides.numInBack;
+	BoundingBox frontBounds = sides.frontBounds;
+	BoundingBox backBounds = sides.backBounds;
+
+	bool isAxial = IsAxialPlane(splittingPlane);
+	if (isAxial)
+	{
+		int axis = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			if (splittingPlane.normal[i] != 0)
+			{
+				axis = i;
+			}
+		}
+
+		// normal is +-1 along the axis, so the plane sits at distance * normal[axis]
+		float planeCoord = splittingPlane.distance * splittingPlane.normal[axis];
+		frontBounds = parentBounds;
+		backBounds = parentBounds;
+		if (splittingPlane.normal[axis] > 0)
+		{
+			frontBounds.min[axis] = std::max<float>(frontBounds.min[axis], planeCoord);
+			backBounds.max[axis] = std::min<float>(backBounds.max[axis], planeCoord);
+		}
+		else
+		{
+			frontBounds.max[axis] = std::min<float>(frontBounds.max[axis], planeCoord);
+			backBounds.min[axis] = std::max<float>(backBounds.min[axis], planeCoord);
+		}
+	}
+
+	float parentArea = GetBoundingBoxSurfaceArea(parentBounds);
+	float frontProbability = 1, backProbability = 1;
+	if (parentArea > 0)
+	{
+		frontProbability = GetBoundingBoxSurfaceArea(frontBounds) / parentArea;
+		backProbability = GetBoundingBoxSurfaceArea(backBounds) / parentArea;
+	}
+
+	float traversalCost = isAxial ? SAH_TRAVERSAL_COST_AXIAL : SAH_TRAVERSAL_COST_NON_AXIAL;
+	return traversalCost + SAH_BRUSH_TEST_COST * (frontProbability * numInFront + backProbability * numInBack);
+}
+
+
+// same padding RecursiveHullCheck prunes with
+bool TraceTouchesBoundingBox(RecordedTrace& trace, BoundingBox bb)
+{
+	const float TRACE_BOUNDS_PADDING = 0.03125f;
+	if (IsBoundingBoxEmpty(bb))
+	{
+		return false;
+	}
+
+	bb.min -= trace.maxs + glm::vec3(TRACE_BOUNDS_PADDING);
+	bb.max -= trace.mins - glm::vec3(TRACE_BOUNDS_PADDING);
+	return SegmentOverlapsBoundingBox(trace.start, trace.end - trace.start, bb, 1);
+}
+
+
+// indices of the corpus traces that touch bb
+std::vector<int> GetTracesTouchingBoundingBox(TraceCorpus* corpus, BoundingBox bb)
+{
+	std::vector<int> result;
+	for (int i = 0; i < corpus->traces.size(); i++)
+	{
+		if (TraceTouchesBoundingBox(corpus->traces[i], bb))
+		{
+			result.push_back(i);
+		}
+	}
+	return result;
+}
+
+
+/*
+	Profile guided. What the recorded traces that reach this node would cost if the node
+	split here and the children were leaves: every trace pays to go through the node, and
+	each brush on a side is tested by every trace that touches the bounds of that side
+
+		cost = traversal * numTraces + brushTest * (numFrontTraces * numFront + numBackTraces * numBack)
+
+	the SAH with the surface area guesses replaced by counting. It is the same count
+	MeasureTraceCorpusCost makes of a built tree, one node at a time. Parts of the level no
+	trace reaches cost nothing whichever way they split, PickSplittingPlane balances those.
+*/
+float EvaluateSplittingPlaneProfile(Plane splittingPlane, std::vector<Brush>& brushes, std::vector<BoundingBox>& brushBounds,
+	TraceCorpus* corpus, std::vector<int>& nodeTraces)
+{
+	SplitSides sides = GetSplitSides(splittingPlane, brushes, brushBounds);
+
+	int numFrontTraces = 0, numBackTraces = 0;
+	for (int i = 0; i < nodeTraces.size(); i++)
+	{
+		RecordedTrace& trace = corpus->traces[nodeTraces[i]];
+		numFrontTraces += TraceTouchesBoundingBox(trace, sides.frontBounds);
+		numBackTraces += TraceTouchesBoundingBox(trace, sides.backBounds);
+	}
+
+	float traversalCost = IsAxialPlane(splittingPlane) ? SAH_TRAVERSAL_COST_AXIAL : SAH_TRAVERSAL_COST_NON_AXIAL;
+	return traversalCost * nodeTraces.size() +
+		SAH_BRUSH_TEST_COST * ((float)numFrontTraces * sides.numInFront + (float)numBackTraces * sides.numInBack);
+}
+
+
 // pick planes so as to minimize splitting of geometry and to attempt
 // to balance the geometry equall on both sides of the splitting plane. 
-bool PickSplittingPlane(std::vector<Brush>& brushes, BspPolygon& splitPolygon, Plane& splittingPlane)
+bool PickSplittingPlane(std::vector<Brush>& brushes, BspPolygon& splitPolygon, Plane& splittingPlane, BSPBuildSettings settings)
 {
 	const float k = 0;
 
@@ -388,21 +884,27 @@ bool PickSplittingPlane(std::vector<Brush>& brushes, BspPolygon& splitPolygon, P
 	int brushIndex = 0, polygonPlaneIndex = 0;
 	float bestScore = FLT_MAX;
 
-	BoundingBox bb;
-	for (int i = 0; i < brushes.size(); i++)
+	BoundingBox bb = GetBrushesBoundingBox(brushes);
+
+	std::vector<BoundingBox> brushBounds;
+	if (settings.splitCostModel == SPLIT_COST_SAH || settings.splitCostModel == SPLIT_COST_PROFILE)
 	{
-		std::vector<BspPolygon>& polygons = brushes[i].polygons;
-		for (int j = 0; j < polygons.size(); j++)
+		for (int i = 0; i < brushes.size(); i++)
 		{
-			std::vector<glm::vec3> vertices = polygons[j].vertices;
-			for (int k = 0; k < vertices.size(); k++)
-			{
-				for (int it = 0; it < 3; it++)
-				{
-					bb.min[it] = std::min<float>(bb.min[it], vertices[k][it]);
-					bb.max[it] = std::max<float>(bb.max[it], vertices[k][it]);
-				}
-			}
+			brushBounds.push_back(brushes[i].GetBoundingBox());
+		}
+	}
+
+	// no recorded trace reaches this node, so the profile has nothing to say about it
+	SplitCostModel costModel = settings.splitCostModel;
+	std::vector<int> nodeTraces;
+	if (costModel == SPLIT_COST_PROFILE)
+	{
+		assert(settings.traceCorpus != NULL);
+		nodeTraces = GetTracesTouchingBoundingBox(settings.traceCorpus, bb);
+		if (nodeTraces.size() == 0)
+		{
+			costModel = SPLIT_COST_BALANCE;
 		}
 	}
 
@@ -421,9 +923,21 @@ bool PickSplittingPlane(std::vector<Brush>& brushes, BspPolygon& splitPolygon, P
 			if (brushes[i].used[j] == true)
 				continue;
 
-			float score = EvaluateSplittingPlane(polygons[j].id, polygons[j].plane, brushes, true);
+			float score = 0;
+			if (costModel == SPLIT_COST_SAH)
+			{
+				score = EvaluateSplittingPlaneSAH(polygons[j].plane, brushes, brushBounds, bb);
+			}
+			else if (costModel == SPLIT_COST_PROFILE)
+			{
+				score = EvaluateSplittingPlaneProfile(polygons[j].plane, brushes, brushBounds, settings.traceCorpus, nodeTraces);
+			}
+			else
+			{
+				score = EvaluateSplittingPlane(polygons[j].id, polygons[j].plane, brushes, true);
+			}
 
-			if (!IsAxialPlane(polygons[j].plane))
+			if (!IsAxialPlane(polygons[j].plane) && settings.verbose)
 			{
 				std::cout << "i " << i << " j " << j << std::endl;
 				int a = 1;
@@ -493,32 +1007,39 @@ bool PickSplittingPlane(std::vector<Brush>& brushes, BspPolygon& splitPolygon, P
 }
 
 
-// Page 175 IntersectSegmentPlane
-bool IntersectEdgeAgainstPlane(glm::vec3 p0, glm::vec3 p1, Plane plane, glm::vec3& q)
+// Where the edge p0 -> p1 crosses the plane, the two points have to be on opposite sides.
+// Uses the distances we already classified with, so t is always in [0, 1]. On an axial 
+// plane the coordinate is set exactly, so the new vertex doesnt drift off the plane
+glm::vec3 IntersectEdgeAgainstPlane(glm::vec3 p0, glm::vec3 p1, Plane plane)
 {
-	float t = 0;
-	glm::vec3 vec1_0 = p1 - p0;
-
-	t = (plane.distance - glm::dot(plane.normal, p0)) / glm::dot(plane.normal, vec1_0);
+	float d0 = glm::dot(plane.normal, p0) - plane.distance;
+	float d1 = glm::dot(plane.normal, p1) - plane.distance;
+	float t = d0 / (d0 - d1);
 
-	if (0.0f <= t && t <= 1.0f)
+	glm::vec3 q = p0 + t * (p1 - p0);
+	for (int i = 0; i < 3; i++)
 	{
-		q = p0 + t * vec1_0;
-		return true;
+		if (plane.normal[i] == 1)
+		{
+			q[i] = plane.distance;
+		}
+		else if (plane.normal[i] == -1)
+		{
+			q[i] = -plane.distance;
+		}
 	}
-
-	return false;
+	return q;
 }
 
 void SplitPolygon(BspPolygon& polygon, Plane plane, BspPolygon*& frontPoly, BspPolygon*& backPoly)
 {
-	int numFront = 0, numBack = 0;
-	const int MAX_POINTS = 1024;
-
-	glm::vec3 frontVerts[MAX_POINTS], backVerts[MAX_POINTS];
-
 	int numVerts = polygon.vertices.size();
 
+	// each side gets at most every vertex plus the two crossing points
+	std::vector<glm::vec3> frontVerts, backVerts;
+	frontVerts.reserve(numVerts + 2);
+	backVerts.reserve(numVerts + 2);
+
 	// vector from v0 -----> v1
 	glm::vec3 v0 = polygon.vertices[numVerts - 1];
 	SplittingPlaneResult v0Side = ClassifyPointToPlane(v0, plane);
@@ -533,47 +1054,369 @@ void SplitPolygon(BspPolygon& polygon, Plane plane, BspPolygon*& frontPoly, BspP
 		{
 			if (v0Side == SplittingPlaneResult::POINT_BACK)
 			{
-				glm::vec3 intersectionPoint;
-				IntersectEdgeAgainstPlane(v0, v1, plane, intersectionPoint);
-				assert(ClassifyPointToPlane(intersectionPoint, plane) == SplittingPlaneResult::POINT_ON_PLANE);
-				frontVerts[numFront++] = backVerts[numBack++] = intersectionPoint;
+				glm::vec3 intersectionPoint = IntersectEdgeAgainstPlane(v0, v1, plane);
+				frontVerts.push_back(intersectionPoint);
+				backVerts.push_back(intersectionPoint);
 			}
-			frontVerts[numFront++] = v1;
+			frontVerts.push_back(v1);
 		}
 		else if (v1Side == SplittingPlaneResult::POINT_BACK)
 		{
 			if (v0Side == SplittingPlaneResult::POINT_FRONT)
 			{
-				glm::vec3 intersectionPoint;
-				IntersectEdgeAgainstPlane(v0, v1, plane, intersectionPoint);
-				assert(ClassifyPointToPlane(intersectionPoint, plane) == SplittingPlaneResult::POINT_ON_PLANE);
-				frontVerts[numFront++] = backVerts[numBack++] = intersectionPoint;
+				glm::vec3 intersectionPoint = IntersectEdgeAgainstPlane(v0, v1, plane);
+				frontVerts.push_back(intersectionPoint);
+				backVerts.push_back(intersectionPoint);
 			}
 			else if (v0Side == SplittingPlaneResult::POINT_ON_PLANE)
 			{
-				backVerts[numBack++] = v0;
+				backVerts.push_back(v0);
 			}
 
-			backVerts[numBack++] = v1;
+			backVerts.push_back(v1);
 		}
 		else
 		{
-			frontVerts[numFront++] = v1;
+			frontVerts.push_back(v1);
 			if (v0Side == SplittingPlaneResult::POINT_BACK)
 			{
-				backVerts[numBack++] = v1;
+				backVerts.push_back(v1);
 			}
 		}
 		v0 = v1;
 		v0Side = v1Side;
 	}
 
-	frontPoly = new BspPolygon(frontVerts, numFront);
-	backPoly = new BspPolygon(backVerts, numBack);
+	frontPoly = new BspPolygon(&frontVerts[0], frontVerts.size());
+	backPoly = new BspPolygon(&backVerts[0], backVerts.size());
 
 }
 
-std::vector<std::vector<bool>> GetPlaneUsedFlags(std::vector<Brush> brushes)
+// Keeps the part of the polygon that is behind or on the plane. Vertices stay in the same winding order
+std::vector<glm::vec3> ClipVerticesBehindPlane(const std::vector<glm::vec3>& vertices, Plane plane)
+{
+	std::vector<glm::vec3> result;
+	if (vertices.size() == 0)
+	{
+		return result;
+	}
+
+	int numVerts = vertices.size();
+	glm::vec3 v0 = vertices[numVerts - 1];
+	SplittingPlaneResult v0Side = ClassifyPointToPlane(v0, plane);
+
+	for (int i = 0; i < numVerts; i++)
+	{
+		glm::vec3 v1 = vertices[i];
+		SplittingPlaneResult v1Side = ClassifyPointToPlane(v1, plane);
+
+		bool crosses = (v0Side == SplittingPlaneResult::POINT_FRONT && v1Side == SplittingPlaneResult::POINT_BACK) ||
+						(v0Side == SplittingPlaneResult::POINT_BACK && v1Side == SplittingPlaneResult::POINT_FRONT);
+		if (crosses)
+		{
+			result.push_back(IntersectEdgeAgainstPlane(v0, v1, plane));
+		}
+
+		if (v1Side != SplittingPlaneResult::POINT_FRONT)
+		{
+			result.push_back(v1);
+		}
+
+		v0 = v1;
+		v0Side = v1Side;
+	}
+
+	return result;
+}
+
+
+// A quad on the plane that is large enough to cover the bounding box. 
+// Winding is chosen so that BspPolygon::UpdatePlane gives back the same normal
+std::vector<glm::vec3> BaseWindingForPlane(Plane plane, BoundingBox bb)
+{
+	glm::vec3 center = (bb.min + bb.max) * 0.5f;
+	float size = glm::length(bb.max - bb.min) + 1;
+
+	// project the box center onto the plane
+	glm::vec3 origin = center - (glm::dot(plane.normal, center) - plane.distance) * plane.normal;
+
+	// pick the axis that is least aligned with the normal to build the tangents
+	glm::vec3 up = glm::vec3(0, 1, 0);
+	if (fabs(plane.normal.y) > fabs(plane.normal.x) && fabs(plane.normal.y) > fabs(plane.normal.z))
+	{
+		up = glm::vec3(0, 0, 1);
+	}
+
+	glm::vec3 right = glm::normalize(glm::cross(up, plane.normal));
+	up = glm::cross(plane.normal, right);
+
+	std::vector<glm::vec3> vertices = {
+		origin + size * (-right + up),
+		origin + size * (-right - up),
+		origin + size * (right - up),
+		origin + size * (right + up)
+	};
+
+	glm::vec3 normal = glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[1]);
+	if (glm::dot(normal, plane.normal) < 0)
+	{
+		std::reverse(vertices.begin(), vertices.end());
+	}
+	return vertices;
+}
+
+
+/*
+	Cuts a convex brush into two closed convex brushes. Polygons that cross the plane 
+	are split, and both halves get a cap polygon on the split plane so that the pieces
+	are still closed volumes, not just open polygon soups.
+
+				   split plane
+						|
+			 ___________|__________
+			|			|		   |
+			|	front  cap  back   |
+			|___________|__________|
+						|
+*/
+// returns the number of polygons that were cut in two
+int SplitBrush(Brush& brush, Plane plane, Brush& frontBrush, Brush& backBrush)
+{
+	int numPolygonsSplit = 0;
+
+	frontBrush.entityIndex = brush.entityIndex;
+	backBrush.entityIndex = brush.entityIndex;
+	frontBrush.brushIndex = brush.brushIndex;
+	backBrush.brushIndex = brush.brushIndex;
+
+	for (int j = 0; j < brush.polygons.size(); j++)
+	{
+		BspPolygon* polygon = &brush.polygons[j];
+		BspPolygon* frontPart = NULL;
+		BspPolygon* backPart = NULL;
+
+		SplittingPlaneResult result = ClassifyPolygonToPlane(polygon, plane);
+
+		switch (result)
+		{
+		case SplittingPlaneResult::POLYGON_FRONT:
+			frontBrush.polygons.push_back(*polygon);
+			frontBrush.used.push_back(brush.used[j]);
+			break;
+		case SplittingPlaneResult::POLYGON_BACK:
+			backBrush.polygons.push_back(*polygon);
+			backBrush.used.push_back(brush.used[j]);
+			break;
+		case SplittingPlaneResult::POLYGON_COPLANNAR:
+			// a face on the split plane bounds whichever side it faces away from
+			if (glm::dot(polygon->plane.normal, plane.normal) > 0)
+			{
+				backBrush.polygons.push_back(*polygon);
+				backBrush.used.push_back(brush.used[j]);
+			}
+			else
+			{
+				frontBrush.polygons.push_back(*polygon);
+				frontBrush.used.push_back(brush.used[j]);
+			}
+			break;
+		case SplittingPlaneResult::POLYGON_BOTH:
+			SplitPolygon(*polygon, plane, frontPart, backPart);
+
+			// both halves are still on the original face plane, dont let rounding in UpdatePlane change it
+			frontPart->plane = polygon->plane;
+			backPart->plane = polygon->plane;
+
+			frontBrush.polygons.push_back(*frontPart);
+			backBrush.polygons.push_back(*backPart);
+
+			frontBrush.used.push_back(brush.used[j]);
+			backBrush.used.push_back(brush.used[j]);
+
+			delete frontPart;
+			delete backPart;
+			numPolygonsSplit++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// the brush didnt actually cross the plane
+	if (frontBrush.polygons.size() == 0 || backBrush.polygons.size() == 0)
+	{
+		return numPolygonsSplit;
+	}
+
+	// the cap is the split plane clipped by every face of the original brush
+	std::vector<glm::vec3> capVertices = BaseWindingForPlane(plane, brush.GetBoundingBox());
+	for (int j = 0; j < brush.polygons.size() && capVertices.size() >= 3; j++)
+	{
+		capVertices = ClipVerticesBehindPlane(capVertices, brush.polygons[j].plane);
+	}
+
+	if (capVertices.size() < 3)
+	{
+		return numPolygonsSplit;
+	}
+
+	// back half: the cap faces the front side, same as the split plane
+	BspPolygon backCap(&capVertices[0], capVertices.size());
+	backCap.plane = plane;
+
+	// front half: the cap faces the back side
+	std::reverse(capVertices.begin(), capVertices.end());
+	BspPolygon frontCap(&capVertices[0], capVertices.size());
+	frontCap.plane = GetOppositeFacingPlane(plane);
+
+	// the split plane is already in the tree, so neither cap should be picked again
+	frontBrush.polygons.push_back(frontCap);
+	frontBrush.used.push_back(true);
+
+	backBrush.polygons.push_back(backCap);
+	backBrush.used.push_back(true);
+
+	return numPolygonsSplit;
+}
+
+
+/*
+	Returns the pieces of the polygon that are not buried inside the other brush.
+	We walk through the other brush's planes, anything in front of a plane is outside 
+	for sure. Whatever survives behind all of the planes is inside and gets dropped.
+
+	Two faces lying on the same plane and facing the same way are duplicates, 
+	keepCoplanar decides which brush keeps it. Faces on the same plane facing each 
+	other are touching solids, so they are treated as buried.
+*/
+std::vector<BspPolygon> ClipPolygonAgainstBrush(BspPolygon polygon, Brush& other, bool keepCoplanar)
+{
+	std::vector<BspPolygon> outside;
+	BspPolygon remaining = polygon;
+
+	for (int i = 0; i < other.polygons.size(); i++)
+	{
+		Plane plane = other.polygons[i].plane;
+		SplittingPlaneResult result = ClassifyPolygonToPlane(&remaining, plane);
+
+		if (result == SplittingPlaneResult::POLYGON_FRONT)
+		{
+			outside.push_back(remaining);
+			return outside;
+		}
+		else if (result == SplittingPlaneResult::POLYGON_COPLANNAR)
+		{
+			if (keepCoplanar && glm::dot(remaining.plane.normal, plane.normal) > 0)
+			{
+				outside.push_back(remaining);
+				return outside;
+			}
+		}
+		else if (result == SplittingPlaneResult::POLYGON_BOTH)
+		{
+			std::vector<glm::vec3> frontVertices = ClipVerticesBehindPlane(remaining.vertices, GetOppositeFacingPlane(plane));
+			std::vector<glm::vec3> backVertices = ClipVerticesBehindPlane(remaining.vertices, plane);
+
+			if (frontVertices.size() >= 3)
+			{
+				BspPolygon frontPart(&frontVertices[0], frontVertices.size());
+				frontPart.plane = polygon.plane;
+				outside.push_back(frontPart);
+			}
+
+			if (backVertices.size() < 3)
+			{
+				return outside;
+			}
+
+			BspPolygon backPart(&backVertices[0], backVertices.size());
+			backPart.plane = polygon.plane;
+			remaining = backPart;
+		}
+	}
+
+	// inside the brush
+	return outside;
+}
+
+
+BoundingBox GetPolygonBoundingBox(BspPolygon& polygon)
+{
+	BoundingBox bb = EmptyBoundingBox();
+	for (int i = 0; i < polygon.vertices.size(); i++)
+	{
+		AddPointToBoundingBox(bb, polygon.vertices[i]);
+	}
+	return bb;
+}
+
+
+/*
+	CSG hidden face removal, similar to what qbsp does before building the tree.
+	Returns the visible pieces of every brush's faces, indexed by brush.
+
+	Brushes themselves are left closed so collision still sees every plane, but a face 
+	that is completely buried inside other solids is marked as used, so it never becomes
+	a splitting plane candidate.
+*/
+std::vector<std::vector<BspPolygon>> CSGRemoveHiddenFaces(std::vector<Brush>& brushes)
+{
+	std::vector<std::vector<BspPolygon>> visibleFaces(brushes.size());
+
+	std::vector<BoundingBox> brushBounds;
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		brushBounds.push_back(brushes[i].GetBoundingBox());
+	}
+
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		for (int j = 0; j < brushes[i].polygons.size(); j++)
+		{
+			std::vector<BspPolygon> fragments = { brushes[i].polygons[j] };
+			BoundingBox polygonBounds = GetPolygonBoundingBox(brushes[i].polygons[j]);
+
+			for (int k = 0; k < brushes.size() && fragments.size() > 0; k++)
+			{
+				if (k == i || !BoundingBoxesOverlap(polygonBounds, brushBounds[k]))
+				{
+					continue;
+				}
+
+				// for duplicated coplanar faces, the brush that comes first keeps it
+				bool keepCoplanar = i < k;
+
+				std::vector<BspPolygon> survivors;
+				for (int f = 0; f < fragments.size(); f++)
+				{
+					std::vector<BspPolygon> outside = ClipPolygonAgainstBrush(fragments[f], brushes[k], keepCoplanar);
+					survivors.insert(survivors.end(), outside.begin(), outside.end());
+				}
+				fragments = survivors;
+			}
+
+			if (fragments.size() == 0)
+			{
+				brushes[i].used[j] = true;
+			}
+			else if (fragments.size() == 1)
+			{
+				visibleFaces[i].push_back(fragments[0]);
+			}
+			else
+			{
+				// partly buried faces that got cut into several pieces are kept whole,
+				// the buried part is hidden by the depth buffer and we dont add polygons
+				visibleFaces[i].push_back(brushes[i].polygons[j]);
+			}
+		}
+	}
+
+	return visibleFaces;
+}
+
+
+std::vector<std::vector<bool>> GetPlaneUsedFlags(std::vector<Brush> brushes)
 {
 	std::vector<std::vector<bool>> flags;
 	for (int i = 0; i < brushes.size(); i++)
@@ -641,18 +1484,21 @@ void PrintBrushes(std::vector<Brush> brushes)
 
 
 
-BSPNode* BuildBSPTree_r(std::vector<Brush> brushes, int depth)
+BSPNode* BuildBSPTree_r(std::vector<Brush> brushes, int depth, BSPBuildSettings settings)
 {
 	const int MAX_DEPTH = 10;
 	const int MIN_LEAF_SIZE = 20;
 
 
-	std::cout << ">>>>>>>>>>>>>>> Depth is " << depth << std::endl;
+	if (settings.verbose)
+	{
+		std::cout << ">>>>>>>>>>>>>>> Depth is " << depth << std::endl;
+	}
 
 	BspPolygon splitPolygon;
 	Plane splitPlane;
 
-	bool succeess = PickSplittingPlane(brushes, splitPolygon, splitPlane);
+	bool succeess = PickSplittingPlane(brushes, splitPolygon, splitPlane, settings);
 	if (!succeess)
 	{
 
@@ -661,8 +1507,20 @@ BSPNode* BuildBSPTree_r(std::vector<Brush> brushes, int depth)
 		node->children[0] = NULL;
 		node->children[1] = NULL;
 
-		printf("		Creating leafnode\n");
-		printf("		count is %d\n\n", node->brushes.size());
+		BoundingBox bb = GetBrushesBoundingBox(brushes);
+		node->bboxMin = bb.min;
+		node->bboxMax = bb.max;
+
+		if (settings.counters)
+		{
+			settings.counters->numBrushPieces += brushes.size();
+		}
+
+		if (settings.verbose)
+		{
+			printf("		Creating leafnode\n");
+			printf("		count is %d\n\n", (int)node->brushes.size());
+		}
 
 		return node;
 	}
@@ -689,33 +1547,11 @@ BSPNode* BuildBSPTree_r(std::vector<Brush> brushes, int depth)
 		}
 		else
 		{
-			for (int j = 0; j < brushes[i].polygons.size(); j++)
+			int numPolygonsSplit = SplitBrush(brushes[i], splitPlane, frontBrush, backBrush);
+			if (settings.counters)
 			{
-				BspPolygon* polygon = &brushes[i].polygons[j];
-				BspPolygon* frontPart = NULL;
-				BspPolygon* backPart = NULL;
-
-				SplittingPlaneResult result = ClassifyPolygonToPlane(polygon, splitPlane);
-
-				switch (result)
-				{
-				case SplittingPlaneResult::POLYGON_FRONT:
-					frontBrush.polygons.push_back(*polygon);
-					frontBrush.used.push_back(brushes[i].used[j]);
-					break;
-				case SplittingPlaneResult::POLYGON_BACK:
-					backBrush.polygons.push_back(*polygon);
-					backBrush.used.push_back(brushes[i].used[j]);
-					break;
-				case SplittingPlaneResult::POLYGON_BOTH:
-					SplitPolygon(*polygon, splitPlane, frontPart, backPart);
-					frontBrush.polygons.push_back(*frontPart);
-					backBrush.polygons.push_back(*backPart);
-
-					frontBrush.used.push_back(brushes[i].used[j]);
-					backBrush.used.push_back(brushes[i].used[j]);
-					break;
-				}
+				settings.counters->numPolygonsSplit += numPolygonsSplit;
+				settings.counters->numBrushesSplit += frontBrush.polygons.size() > 0 && backBrush.polygons.size() > 0;
 			}
 
 			if (frontBrush.polygons.size() > 0)
@@ -730,13 +1566,18 @@ BSPNode* BuildBSPTree_r(std::vector<Brush> brushes, int depth)
 
 	}
 
-	PrintBrushes(frontBrushes);
-	PrintBrushes(backBrushes);
+	if (settings.verbose)
+	{
+		PrintBrushes(frontBrushes);
+		PrintBrushes(backBrushes);
+	}
 
-	BSPNode* frontTree = BuildBSPTree_r(frontBrushes, depth + 1);
-	BSPNode* backTree = BuildBSPTree_r(backBrushes, depth + 1);
+	BSPNode* frontTree = BuildBSPTree_r(frontBrushes, depth + 1, settings);
+	BSPNode* backTree = BuildBSPTree_r(backBrushes, depth + 1, settings);
 	BSPNode* node = new BSPNode(frontTree, backTree);
 	node->splitPlane = splitPlane;
+	node->bboxMin = glm::min(frontTree->bboxMin, backTree->bboxMin);
+	node->bboxMax = glm::max(frontTree->bboxMax, backTree->bboxMax);
 
 //	std::cout << "split normal is " << node->splitPlane.normal << std::endl;
 
@@ -752,8 +1593,779 @@ BSPNode* BuildBSPTree_r(std::vector<Brush> brushes, int depth)
 
 
 // test case: https://www.bluesnews.com/abrash/chap64.shtml
-BSPNode* BuildBSPTree(std::vector<Brush> brushes, int depth)
+BSPNode* BuildBSPTree(std::vector<Brush> brushes, int depth, BSPBuildSettings settings = BSPBuildSettings())
 {
+	// brushes with no polygons are slots of removed brushes, see bsp_edit.h. 
+	// They keep their index but dont go in the tree
+	std::vector<Brush> liveBrushes;
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		brushes[i].brushIndex = i;
+		if (brushes[i].polygons.size() > 0)
+		{
+			liveBrushes.push_back(brushes[i]);
+		}
+	}
+
 	// std::vector<std::vector<bool>> planeFlags = GetPlaneUsedFlags(brushes);
-	return BuildBSPTree_r(brushes, depth);
-}
\ No newline at end of file
+	return BuildBSPTree_r(liveBrushes, depth, settings);
+}
+
+
+void FreeBSPTree(BSPNode* node)
+{
+	if (node == NULL)
+		return;
+
+	FreeBSPTree(node->children[0]);
+	FreeBSPTree(node->children[1]);
+	delete node;
+}
+
+
+/*
+	The BSPNode tree is what the compiler works with. Once its finished, we convert it 
+	into a linear array of small nodes so traces dont have to chase pointers through 
+	big scattered nodes. Similar to cnode_t / cleaf_t in quake's cmodel.c
+
+	children[i] >= 0 is a node index
+	children[i] < 0 is a leaf, leaf index is -(children[i] + 1)
+
+	nodes are written out depth first, so the front child of a node usually 
+	sits right after it in memory.
+
+	planeType is the PlaneType of the node's plane, so traversal can go straight to the 
+	single coordinate compare without looking at the normal.
+*/
+struct FlatBSPNode
+{
+	int planeIndex;
+	int planeType;
+	int children[2];
+};
+
+// Each leaf owns a range of FlatBSPTree::leafBrushes, which are indices into 
+// FlatBSPTree::brushes. The pieces SplitBrush creates are only for building the tree, for 
+// collision the leaf refers to each whole brush that has a piece in it. Every brush is 
+// stored once no matter how many leaves it spans, like dleafbrushes in quake's .bsp
+struct FlatBSPLeaf
+{
+	int firstLeafBrush;
+	int numLeafBrushes;
+};
+
+enum BrushContents
+{
+	BRUSH_CONTENTS_SOLID = 1 << 0,
+};
+
+// A brush as the trace sees it, the compiler's Brush without its polygons. Its sides are a 
+// range of FlatBSPTree::brushSides, which are indices into FlatBSPTree::planes, so brushes 
+// sharing a plane share one copy of it. The same planes are also in 
+// FlatBSPTree::brushSideBlocks, starting at firstSideBlock.
+// bounds lets the trace skip the brush without touching its planes
+struct FlatBSPBrush
+{
+	BoundingBox bounds;
+	int contents;		// BrushContents flags, 0 for removed brushes
+	int firstSide;
+	int numSides;
+	int firstSideBlock;
+};
+
+// two of FlatBSPTree::brushVertices
+struct BrushEdge
+{
+	int vertices[2];
+};
+
+// Corners and edges of a brush, indexed like FlatBSPTree::brushes. Box traces get by with 
+// the planes, round traces also need the corners and edges the planes meet at
+struct FlatBSPBrushFeatures
+{
+	int firstVertex;
+	int numVertices;
+	int firstEdge;
+	int numEdges;
+};
+
+const int BRUSH_SIDE_BLOCK_SIZE = 4;
+
+// BRUSH_SIDE_BLOCK_SIZE brush sides with each component in its own array, so CheckBrush can
+// load one component of all of them at once. The last block of a brush is padded with sides
+// everything is behind
+struct BrushSideBlock
+{
+	float normalX[BRUSH_SIDE_BLOCK_SIZE];
+	float normalY[BRUSH_SIDE_BLOCK_SIZE];
+	float normalZ[BRUSH_SIDE_BLOCK_SIZE];
+	float distance[BRUSH_SIDE_BLOCK_SIZE];
+};
+
+inline int GetNumBrushSideBlocks(int numSides)
+{
+	return (numSides + BRUSH_SIDE_BLOCK_SIZE - 1) / BRUSH_SIDE_BLOCK_SIZE;
+}
+
+// Things we only need for printing and rendering, indexed the same way as FlatBSPTree::nodes
+struct FlatBSPNodeDebugInfo
+{
+	int id;		// id of the BSPNode this came from
+	BspPolygon splitPolygon;
+};
+
+struct FlatBSPTree
+{
+	// same encoding as FlatBSPNode::children, the root can be a leaf if the tree never split
+	int root;
+
+	std::vector<Plane> planes;
+
+	// FindOrAddPlane's hash of planes, PLANE_HASH_SIZE chains threaded through planeHashNext
+	std::vector<int> planeHashHeads;
+	std::vector<int> planeHashNext;
+
+	std::vector<FlatBSPNode> nodes;
+	std::vector<FlatBSPLeaf> leaves;
+	std::vector<int> leafBrushes;
+
+	// indexed by Brush::brushIndex, removed brushes have no sides. 
+	// Pieces without a brushIndex are added after the source brushes
+	std::vector<FlatBSPBrush> brushes;
+	std::vector<int> brushSides;
+	std::vector<BrushSideBlock> brushSideBlocks;
+
+	std::vector<FlatBSPBrushFeatures> brushFeatures;
+	std::vector<glm::vec3> brushVertices;
+	std::vector<BrushEdge> brushEdges;
+
+	// kept out of the nodes so traversal that doesnt need them stays compact.
+	// Used for pruning traces and for render side culling
+	std::vector<BoundingBox> nodeBounds;
+	std::vector<BoundingBox> leafBounds;
+
+	// potentially visible set, one bit per leaf, pvsRowBytes per leaf. See bsp_vis.h
+	int pvsRowBytes;
+	std::vector<unsigned char> pvs;
+
+	// side tables
+	std::vector<FlatBSPNodeDebugInfo> debugNodes;
+	std::vector<int> debugLeafIds;
+
+	// what is still in use. PatchFlatBSPTree leaves the nodes, leaves and brush sides it
+	// replaces behind in the arrays, these dont count them
+	int numLiveNodes;
+	int numLiveLeaves;
+	int numLiveLeafBrushes;
+	int numLiveBrushSides;
+};
+
+
+inline bool IsFlatBSPLeaf(int child)
+{
+	return child < 0;
+}
+
+inline int FlatBSPLeafIndex(int child)
+{
+	return -(child + 1);
+}
+
+inline int FlatBSPLeafChild(int leafIndex)
+{
+	return -(leafIndex + 1);
+}
+
+BoundingBox* GetFlatBSPBounds(FlatBSPTree* tree, int child)
+{
+	if (IsFlatBSPLeaf(child))
+	{
+		return &tree->leafBounds[FlatBSPLeafIndex(child)];
+	}
+	return &tree->nodeBounds[child];
+}
+
+
+// the vertices of the brush being added start at firstVertex
+int FindOrAddBrushVertex(FlatBSPTree* tree, int firstVertex, glm::vec3 vertex)
+{
+	for (int i = firstVertex; i < tree->brushVertices.size(); i++)
+	{
+		if (glm::distance(tree->brushVertices[i], vertex) < VERTEX_SNAP_EPSILON)
+		{
+			return i;
+		}
+	}
+
+	tree->brushVertices.push_back(vertex);
+	return tree->brushVertices.size() - 1;
+}
+
+
+bool HasBrushEdge(FlatBSPTree* tree, int firstEdge, int vertex0, int vertex1)
+{
+	for (int i = firstEdge; i < tree->brushEdges.size(); i++)
+	{
+		BrushEdge& edge = tree->brushEdges[i];
+		if ((edge.vertices[0] == vertex0 && edge.vertices[1] == vertex1) ||
+			(edge.vertices[0] == vertex1 && edge.vertices[1] == vertex0))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// polygons share their corners and every edge is on two of them, both only go in once
+FlatBSPBrushFeatures AddFlatBSPBrushFeatures(FlatBSPTree* tree, Brush& brush)
+{
+	FlatBSPBrushFeatures features;
+	features.firstVertex = tree->brushVertices.size();
+	features.firstEdge = tree->brushEdges.size();
+
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		std::vector<glm::vec3>& vertices = brush.polygons[i].vertices;
+		for (int j = 0; j < vertices.size(); j++)
+		{
+			int vertex0 = FindOrAddBrushVertex(tree, features.firstVertex, vertices[j]);
+			int vertex1 = FindOrAddBrushVertex(tree, features.firstVertex, vertices[(j + 1) % vertices.size()]);
+			if (vertex0 != vertex1 && !HasBrushEdge(tree, features.firstEdge, vertex0, vertex1))
+			{
+				BrushEdge edge = { { vertex0, vertex1 } };
+				tree->brushEdges.push_back(edge);
+			}
+		}
+	}
+
+	features.numVertices = tree->brushVertices.size() - features.firstVertex;
+	features.numEdges = tree->brushEdges.size() - features.firstEdge;
+	return features;
+}
+
+
+/*
+	Node planes and brush sides share one table of planes, like qbsp's FindFloatPlane. Planes
+	are hashed by their normal and distance snapped to a coarse grid, so the same plane always
+	lands in the same chain and the lookup only compares against the few planes in it.
+	Brushes are snapped when they are made, so a plane that is meant to be shared is bit for
+	bit the same and the compare can be exact.
+*/
+const int PLANE_HASH_SIZE = 1024;
+const float PLANE_HASH_NORMAL_GRID = 1.0f / 16.0f;
+
+int GetPlaneHash(Plane plane)
+{
+	unsigned int hash = (unsigned int)(int)floor(plane.distance + 0.5f);
+	for (int i = 0; i < 3; i++)
+	{
+		hash = hash * 31 + (unsigned int)(int)floor(plane.normal[i] / PLANE_HASH_NORMAL_GRID + 0.5f);
+	}
+	return hash & (PLANE_HASH_SIZE - 1);
+}
+
+
+int FindOrAddPlane(FlatBSPTree* tree, Plane plane)
+{
+	if (tree->planeHashHeads.size() != PLANE_HASH_SIZE)
+	{
+		tree->planeHashHeads.assign(PLANE_HASH_SIZE, -1);
+	}
+
+	int hash = GetPlaneHash(plane);
+	for (int i = tree->planeHashHeads[hash]; i != -1; i = tree->planeHashNext[i])
+	{
+		if (tree->planes[i] == plane)
+		{
+			return i;
+		}
+	}
+
+	tree->planes.push_back(plane);
+	tree->planeHashNext.push_back(tree->planeHashHeads[hash]);
+	tree->planeHashHeads[hash] = tree->planes.size() - 1;
+	return tree->planes.size() - 1;
+}
+
+
+void AddBevelNormal(std::vector<glm::vec3>& normals, glm::vec3 normal)
+{
+	float length = glm::length(normal);
+	if (length < NORMAL_SNAP_EPSILON)
+	{
+		return;
+	}
+
+	normal /= length;
+	SnapNormal(normal);
+	for (int i = 0; i < normals.size(); i++)
+	{
+		if (glm::dot(normals[i], normal) > 1 - NORMAL_SNAP_EPSILON)
+		{
+			return;
+		}
+	}
+	normals.push_back(normal);
+}
+
+
+// every normal a box sliding over the brush can be stopped along: the brush's own first,
+// then the 6 axial ones and the bevels between its edges and the axes
+std::vector<glm::vec3> GetBrushBevelNormals(Brush& brush)
+{
+	std::vector<glm::vec3> normals;
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		AddBevelNormal(normals, brush.polygons[i].plane.normal);
+	}
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		glm::vec3 normal = glm::vec3(0);
+		normal[axis] = 1;
+		AddBevelNormal(normals, normal);
+		AddBevelNormal(normals, -normal);
+	}
+
+	// edge bevels, each edge shows up twice but AddBevelNormal drops the copies
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		std::vector<glm::vec3>& vertices = brush.polygons[i].vertices;
+		for (int j = 0; j < vertices.size(); j++)
+		{
+			glm::vec3 edge = vertices[(j + 1) % vertices.size()] - vertices[j];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				glm::vec3 axisVector = glm::vec3(0);
+				axisVector[axis] = 1;
+				glm::vec3 normal = glm::cross(edge, axisVector);
+				AddBevelNormal(normals, normal);
+				AddBevelNormal(normals, -normal);
+			}
+		}
+	}
+	return normals;
+}
+
+
+/*
+	Bevels, quake's AddBrushBevels. A box trace pushes each side of a brush out by the box,
+	and past a sharp corner the pushed out sides meet well away from the brush:
+
+				*
+			   / \			the sides pushed out by the box meet at *, above the
+			  / ^ \			top of the brush ^. A box coming down over the top
+			 / / \ \		stops at *, though it never gets near the brush
+			/ /	  \ \
+
+	So a brush also gets sides through its corners and edges, along the axes and along the
+	bevels between its edges and the axes (see GetBrushBevelNormals). They cut those corners
+	off, and only touch the brush, so nothing but box traces can tell they are there. Axial
+	brushes already have all of them.
+*/
+std::vector<Plane> GetBrushSidePlanes(Brush& brush)
+{
+	std::vector<Plane> planes;
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		planes.push_back(brush.polygons[i].plane);
+	}
+
+	std::vector<glm::vec3> normals = GetBrushBevelNormals(brush);
+	for (int i = 0; i < normals.size(); i++)
+	{
+		bool isSide = false;
+		for (int j = 0; j < brush.polygons.size() && !isSide; j++)
+		{
+			isSide = glm::dot(brush.polygons[j].plane.normal, normals[i]) > 1 - NORMAL_SNAP_EPSILON;
+		}
+		if (isSide)
+		{
+			continue;
+		}
+
+		Plane plane;
+		plane.normal = normals[i];
+		plane.distance = -FLT_MAX;
+		for (int j = 0; j < brush.polygons.size(); j++)
+		{
+			for (int k = 0; k < brush.polygons[j].vertices.size(); k++)
+			{
+				plane.distance = std::max(plane.distance, glm::dot(plane.normal, brush.polygons[j].vertices[k]));
+			}
+		}
+
+		// an edge bevel that only touches a corner cuts nothing off
+		bool touchesEdge = false;
+		glm::vec3 corner = glm::vec3(FLT_MAX);
+		for (int j = 0; j < brush.polygons.size(); j++)
+		{
+			for (int k = 0; k < brush.polygons[j].vertices.size(); k++)
+			{
+				glm::vec3 vertex = brush.polygons[j].vertices[k];
+				if (glm::dot(plane.normal, vertex) < plane.distance - VERTEX_SNAP_EPSILON)
+				{
+					continue;
+				}
+
+				if (corner.x == FLT_MAX)
+				{
+					corner = vertex;
+				}
+				touchesEdge = touchesEdge || glm::distance(corner, vertex) > VERTEX_SNAP_EPSILON;
+			}
+		}
+		if (IsAxialPlane(plane) || touchesEdge)
+		{
+			planes.push_back(plane);
+		}
+	}
+	return planes;
+}
+
+
+// appends the sides of brush, features says where its vertices and edges went
+FlatBSPBrush AddFlatBSPBrushSides(FlatBSPTree* tree, Brush& brush, FlatBSPBrushFeatures* features)
+{
+	FlatBSPBrush flatBrush;
+	flatBrush.bounds = brush.GetBoundingBox();
+	flatBrush.contents = brush.polygons.size() > 0 ? BRUSH_CONTENTS_SOLID : 0;
+	flatBrush.firstSide = tree->brushSides.size();
+	flatBrush.firstSideBlock = tree->brushSideBlocks.size();
+
+	std::vector<Plane> planes = GetBrushSidePlanes(brush);
+	flatBrush.numSides = planes.size();
+	for (int i = 0; i < planes.size(); i++)
+	{
+		tree->brushSides.push_back(FindOrAddPlane(tree, planes[i]));
+	}
+
+	for (int i = 0; i < GetNumBrushSideBlocks(flatBrush.numSides); i++)
+	{
+		BrushSideBlock block;
+		for (int j = 0; j < BRUSH_SIDE_BLOCK_SIZE; j++)
+		{
+			Plane plane;
+			plane.normal = glm::vec3(0);
+			plane.distance = FLT_MAX;
+
+			int side = i * BRUSH_SIDE_BLOCK_SIZE + j;
+			if (side < flatBrush.numSides)
+			{
+				plane = planes[side];
+			}
+
+			block.normalX[j] = plane.normal.x;
+			block.normalY[j] = plane.normal.y;
+			block.normalZ[j] = plane.normal.z;
+			block.distance[j] = plane.distance;
+		}
+		tree->brushSideBlocks.push_back(block);
+	}
+	*features = AddFlatBSPBrushFeatures(tree, brush);
+	return flatBrush;
+}
+
+
+// returns the index of the new brush
+int AddFlatBSPBrush(FlatBSPTree* tree, Brush& brush)
+{
+	FlatBSPBrushFeatures features;
+	tree->brushes.push_back(AddFlatBSPBrushSides(tree, brush, &features));
+	tree->brushFeatures.push_back(features);
+	return tree->brushes.size() - 1;
+}
+
+
+// appends the brushes of a leaf to tree->leafBrushes, pieces of the same brush go in once
+FlatBSPLeaf AddFlatBSPLeafBrushes(FlatBSPTree* tree, BSPNode* node)
+{
+	FlatBSPLeaf leaf;
+	leaf.firstLeafBrush = tree->leafBrushes.size();
+
+	for (int i = 0; i < node->brushes.size(); i++)
+	{
+		int brushIndex = node->brushes[i].brushIndex;
+		if (brushIndex == -1)
+		{
+			tree->leafBrushes.push_back(AddFlatBSPBrush(tree, node->brushes[i]));
+		}
+		else if (std::find(tree->leafBrushes.begin() + leaf.firstLeafBrush, tree->leafBrushes.end(), brushIndex) == tree->leafBrushes.end())
+		{
+			tree->leafBrushes.push_back(brushIndex);
+		}
+	}
+
+	leaf.numLeafBrushes = tree->leafBrushes.size() - leaf.firstLeafBrush;
+	return leaf;
+}
+
+
+// axial planes have to face the positive axis, see PlaneType. Flipping the plane swaps the sides,
+// returns the child of node that goes in front of plane
+int GetFlatBSPNodePlane(BSPNode* node, Plane* plane)
+{
+	*plane = node->splitPlane;
+	if (IsAxialPlane(*plane) && GetPlaneType(*plane) == PLANE_NON_AXIAL)
+	{
+		*plane = GetOppositeFacingPlane(*plane);
+		return 1;
+	}
+	return 0;
+}
+
+
+int FlattenBSPTree_r(FlatBSPTree* tree, BSPNode* node, std::vector<Brush>& sourceBrushes)
+{
+	if (node->IsLeafNode())
+	{
+		FlatBSPLeaf leaf = AddFlatBSPLeafBrushes(tree, node);
+
+		tree->leaves.push_back(leaf);
+		tree->leafBounds.push_back({ node->bboxMin, node->bboxMax });
+		tree->debugLeafIds.push_back(node->id);
+
+		node->flatChild = FlatBSPLeafChild(tree->leaves.size() - 1);
+		node->dirty = false;
+		return node->flatChild;
+	}
+
+	int nodeIndex = tree->nodes.size();
+	tree->nodes.push_back(FlatBSPNode());
+	tree->nodeBounds.push_back({ node->bboxMin, node->bboxMax });
+	tree->debugNodes.push_back(FlatBSPNodeDebugInfo());
+
+	tree->debugNodes[nodeIndex].id = node->id;
+	tree->debugNodes[nodeIndex].splitPolygon = node->debugSplitPolygon;
+
+	Plane plane;
+	int side = GetFlatBSPNodePlane(node, &plane);
+
+	int planeIndex = FindOrAddPlane(tree, plane);
+	int frontChild = FlattenBSPTree_r(tree, node->children[side], sourceBrushes);
+	int backChild = FlattenBSPTree_r(tree, node->children[!side], sourceBrushes);
+
+	// recursion may have grown the array, so index instead of holding a pointer
+	tree->nodes[nodeIndex].planeIndex = planeIndex;
+	tree->nodes[nodeIndex].planeType = GetPlaneType(plane);
+	tree->nodes[nodeIndex].children[0] = frontChild;
+	tree->nodes[nodeIndex].children[1] = backChild;
+
+	node->flatChild = nodeIndex;
+	node->dirty = false;
+	return nodeIndex;
+}
+
+
+// sourceBrushes is the same list that was given to BuildBSPTree
+void FlattenBSPTree(BSPNode* root, std::vector<Brush>& sourceBrushes, FlatBSPTree* tree)
+{
+	tree->planes.clear();
+	tree->planeHashHeads.clear();
+	tree->planeHashNext.clear();
+	tree->nodes.clear();
+	tree->leaves.clear();
+	tree->leafBrushes.clear();
+	tree->brushes.clear();
+	tree->brushSides.clear();
+	tree->brushSideBlocks.clear();
+	tree->brushFeatures.clear();
+	tree->brushVertices.clear();
+	tree->brushEdges.clear();
+	tree->nodeBounds.clear();
+	tree->leafBounds.clear();
+	tree->debugNodes.clear();
+	tree->debugLeafIds.clear();
+	tree->pvsRowBytes = 0;
+	tree->pvs.clear();
+
+	// source brushes go first so a brushIndex is also the index of the flat brush
+	for (int i = 0; i < sourceBrushes.size(); i++)
+	{
+		assert(sourceBrushes[i].brushIndex == -1 || sourceBrushes[i].brushIndex == i);
+		AddFlatBSPBrush(tree, sourceBrushes[i]);
+	}
+
+	tree->root = FlattenBSPTree_r(tree, root, sourceBrushes);
+
+	tree->numLiveNodes = tree->nodes.size();
+	tree->numLiveLeaves = tree->leaves.size();
+	tree->numLiveLeafBrushes = tree->leafBrushes.size();
+	tree->numLiveBrushSides = tree->brushSides.size();
+}
+
+
+/*
+	What traces and PVS lookups run on at runtime. Just pointers and counts, so it can point 
+	into the arrays of a FlatBSPTree we just compiled, or straight into a bsp file mapped 
+	into memory (see bsp_file.h) without copying anything.
+
+	A view of a FlatBSPTree goes stale when the tree gets flattened or patched, get a new one.
+*/
+struct BSPCollisionModel
+{
+	int root;
+
+	Plane* planes;
+	int numPlanes;
+
+	FlatBSPNode* nodes;
+	int numNodes;
+
+	FlatBSPLeaf* leaves;
+	int numLeaves;
+
+	int* leafBrushes;
+	int numLeafBrushes;
+
+	FlatBSPBrush* brushes;
+	int numBrushes;
+
+	// indices into planes
+	int* brushSides;
+	int numBrushSides;
+
+	BrushSideBlock* brushSideBlocks;
+	int numBrushSideBlocks;
+
+	// numBrushes entries
+	FlatBSPBrushFeatures* brushFeatures;
+
+	glm::vec3* brushVertices;
+	int numBrushVertices;
+
+	BrushEdge* brushEdges;
+	int numBrushEdges;
+
+	// numNodes and numLeaves entries
+	BoundingBox* nodeBounds;
+	BoundingBox* leafBounds;
+
+	// NULL when there is no vis
+	unsigned char* pvs;
+	int pvsRowBytes;
+};
+
+
+BSPCollisionModel GetBSPCollisionModel(FlatBSPTree* tree)
+{
+	BSPCollisionModel model = {};
+	model.root = tree->root;
+
+	model.planes = tree->planes.data();
+	model.numPlanes = tree->planes.size();
+
+	model.nodes = tree->nodes.data();
+	model.numNodes = tree->nodes.size();
+
+	model.leaves = tree->leaves.data();
+	model.numLeaves = tree->leaves.size();
+
+	model.leafBrushes = tree->leafBrushes.data();
+	model.numLeafBrushes = tree->leafBrushes.size();
+
+	model.brushes = tree->brushes.data();
+	model.numBrushes = tree->brushes.size();
+
+	model.brushSides = tree->brushSides.data();
+	model.numBrushSides = tree->brushSides.size();
+
+	model.brushSideBlocks = tree->brushSideBlocks.data();
+	model.numBrushSideBlocks = tree->brushSideBlocks.size();
+
+	model.brushFeatures = tree->brushFeatures.data();
+
+	model.brushVertices = tree->brushVertices.data();
+	model.numBrushVertices = tree->brushVertices.size();
+
+	model.brushEdges = tree->brushEdges.data();
+	model.numBrushEdges = tree->brushEdges.size();
+
+	model.nodeBounds = tree->nodeBounds.data();
+	model.leafBounds = tree->leafBounds.data();
+
+	if (tree->pvs.size() > 0)
+	{
+		model.pvs = tree->pvs.data();
+		model.pvsRowBytes = tree->pvsRowBytes;
+	}
+	return model;
+}
+
+
+BoundingBox* GetBSPModelBounds(BSPCollisionModel* model, int child)
+{
+	if (IsFlatBSPLeaf(child))
+	{
+		return &model->leafBounds[FlatBSPLeafIndex(child)];
+	}
+	return &model->nodeBounds[child];
+}
+
+
+// numbers to compare the quality of trees built with different settings
+struct BSPTreeStats
+{
+	int numNodes;
+	int numLeaves;
+	int numSolidLeaves;
+	int maxDepth;
+	float averageLeafDepth;
+	int numLeafBrushes;		// sum of brushes over all leaves
+	std::vector<int> leafDepthHistogram;	// number of leaves at each depth
+
+	// expected cost of a trace entering the root, using the same costs as the SAH split model
+	float estimatedTraceCost;
+};
+
+void GetFlatBSPTreeStats_r(FlatBSPTree* tree, int child, int depth, float rootArea, BSPTreeStats* stats, int* leafDepthSum)
+{
+	// chance that a trace entering the root also enters this child
+	float probability = 1;
+	if (rootArea > 0)
+	{
+		probability = GetBoundingBoxSurfaceArea(*GetFlatBSPBounds(tree, child)) / rootArea;
+	}
+
+	if (IsFlatBSPLeaf(child))
+	{
+		FlatBSPLeaf* leaf = &tree->leaves[FlatBSPLeafIndex(child)];
+		stats->numLeaves++;
+		stats->numSolidLeaves += leaf->numLeafBrushes > 0;
+		stats->numLeafBrushes += leaf->numLeafBrushes;
+		stats->maxDepth = std::max(stats->maxDepth, depth);
+		*leafDepthSum += depth;
+
+		if (stats->leafDepthHistogram.size() <= depth)
+		{
+			stats->leafDepthHistogram.resize(depth + 1, 0);
+		}
+		stats->leafDepthHistogram[depth]++;
+
+		stats->estimatedTraceCost += probability * SAH_BRUSH_TEST_COST * leaf->numLeafBrushes;
+		return;
+	}
+
+	FlatBSPNode* node = &tree->nodes[child];
+	bool isAxial = node->planeType != PLANE_NON_AXIAL;
+	stats->estimatedTraceCost += probability * (isAxial ? SAH_TRAVERSAL_COST_AXIAL : SAH_TRAVERSAL_COST_NON_AXIAL);
+
+	stats->numNodes++;
+	GetFlatBSPTreeStats_r(tree, node->children[0], depth + 1, rootArea, stats, leafDepthSum);
+	GetFlatBSPTreeStats_r(tree, node->children[1], depth + 1, rootArea, stats, leafDepthSum);
+}
+
+BSPTreeStats GetFlatBSPTreeStats(FlatBSPTree* tree)
+{
+	BSPTreeStats stats = {};
+	int leafDepthSum = 0;
+	float rootArea = GetBoundingBoxSurfaceArea(*GetFlatBSPBounds(tree, tree->root));
+	GetFlatBSPTreeStats_r(tree, tree->root, 0, rootArea, &stats, &leafDepthSum);
+
+	if (stats.numLeaves > 0)
+	{
+		stats.averageLeafDepth = leafDepthSum / (float)stats.numLeaves;
+	}
+	return stats;
+}
@@ -0,0 +1,588 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "bsp_tree.h"
+
+/*
+	Portals and the potentially visible set, roughly what qbsp's portalization and
+	vis -fast (basevis) do.
+
+	1.	Portalize: every node's cell is a convex volume. We start with a box around the
+		world, and at every node the split plane clipped to the node's cell becomes a new
+		portal between the two children, while the portals already bounding the cell
+		get split between the children. When we reach the leaves, each leaf is bounded
+		by its portals.
+
+	2.	Leaves whose whole cell sits inside one of their brushes are solid and drop out.
+		The rest of the portals, the ones between two empty leaves, are what vis uses.
+
+	3.	For every one way portal, flood through the leaves behind it, only going through
+		portals that are at least partly in front of it. The leaves we reach might be
+		visible through that portal. A leaf's PVS is the union over the portals leaving it.
+
+	The flood for each portal is independent, so they are spread over a few threads.
+*/
+
+struct VisPortal
+{
+	std::vector<glm::vec3> winding;
+	Plane plane;
+
+	// cells on the front and back side of plane
+	int cells[2];
+	bool removed;
+};
+
+// one way portal used by the flood, plane normal points into leaf
+struct VisFlowPortal
+{
+	std::vector<glm::vec3> winding;
+	Plane plane;
+	int leaf;
+};
+
+struct VisContext
+{
+	FlatBSPTree* tree;
+
+	std::vector<VisPortal> portals;
+
+	// portals bounding each cell. Cells are the tree nodes, then the leaves, then the outside
+	std::vector<std::vector<int>> cellPortals;
+	int outsideCell;
+
+	std::vector<bool> leafIsSolid;
+	std::vector<VisFlowPortal> flowPortals;
+	std::vector<std::vector<int>> leafFlowPortals;		// flow portals leaving each leaf
+};
+
+struct VisStats
+{
+	int numPortals;			// between two empty leaves
+	int numSolidLeaves;
+	int numThreads;
+	float averageVisibleLeaves;
+};
+
+
+int GetVisCell(VisContext* vis, int child)
+{
+	if (IsFlatBSPLeaf(child))
+	{
+		return vis->tree->nodes.size() + FlatBSPLeafIndex(child);
+	}
+	return child;
+}
+
+bool IsVisCellLeaf(VisContext* vis, int cell)
+{
+	return cell >= vis->tree->nodes.size() && cell != vis->outsideCell;
+}
+
+int GetVisCellLeafIndex(VisContext* vis, int cell)
+{
+	return cell - vis->tree->nodes.size();
+}
+
+
+float GetWindingArea(const std::vector<glm::vec3>& winding)
+{
+	glm::vec3 sum = glm::vec3(0);
+	for (int i = 2; i < winding.size(); i++)
+	{
+		sum += glm::cross(winding[i - 1] - winding[0], winding[i] - winding[0]);
+	}
+	return glm::length(sum) * 0.5f;
+}
+
+
+void AddVisPortal(VisContext* vis, std::vector<glm::vec3>& winding, Plane plane, int frontCell, int backCell)
+{
+	// slivers from clipping are not worth keeping
+	const float MIN_PORTAL_AREA = 0.1f;
+	if (winding.size() < 3 || GetWindingArea(winding) < MIN_PORTAL_AREA)
+	{
+		return;
+	}
+
+	VisPortal portal;
+	portal.winding = winding;
+	portal.plane = plane;
+	portal.cells[0] = frontCell;
+	portal.cells[1] = backCell;
+	portal.removed = false;
+
+	int portalIndex = vis->portals.size();
+	vis->portals.push_back(portal);
+	vis->cellPortals[frontCell].push_back(portalIndex);
+	vis->cellPortals[backCell].push_back(portalIndex);
+}
+
+
+void RemovePortalFromCell(VisContext* vis, int cell, int portalIndex)
+{
+	std::vector<int>& portals = vis->cellPortals[cell];
+	portals.erase(std::remove(portals.begin(), portals.end(), portalIndex), portals.end());
+}
+
+
+// the 6 faces of a box a bit larger than the world, between the outside and the root
+void MakeHeadnodePortals(VisContext* vis, BoundingBox bounds)
+{
+	const float PADDING = 8;
+	bounds.min -= glm::vec3(PADDING);
+	bounds.max += glm::vec3(PADDING);
+
+	Plane boxPlanes[6];
+	for (int i = 0; i < 3; i++)
+	{
+		boxPlanes[i * 2].normal = glm::vec3(0);
+		boxPlanes[i * 2].normal[i] = 1;
+		boxPlanes[i * 2].distance = bounds.max[i];
+
+		boxPlanes[i * 2 + 1].normal = glm::vec3(0);
+		boxPlanes[i * 2 + 1].normal[i] = -1;
+		boxPlanes[i * 2 + 1].distance = -bounds.min[i];
+	}
+
+	int rootCell = GetVisCell(vis, vis->tree->root);
+	for (int i = 0; i < 6; i++)
+	{
+		std::vector<glm::vec3> winding = BaseWindingForPlane(boxPlanes[i], bounds);
+		for (int j = 0; j < 6; j++)
+		{
+			if (j != i)
+			{
+				winding = ClipVerticesBehindPlane(winding, boxPlanes[j]);
+			}
+		}
+
+		// box planes face out, so the outside is in front
+		AddVisPortal(vis, winding, boxPlanes[i], vis->outsideCell, rootCell);
+	}
+}
+
+
+// keeps the part of the winding on the side of the portal where cell is
+std::vector<glm::vec3> ClipWindingToCellSide(VisContext* vis, std::vector<glm::vec3>& winding, VisPortal* portal, int cell)
+{
+	if (portal->cells[0] == cell)
+	{
+		return ClipVerticesBehindPlane(winding, GetOppositeFacingPlane(portal->plane));
+	}
+	return ClipVerticesBehindPlane(winding, portal->plane);
+}
+
+
+void MakeTreePortals_r(VisContext* vis, int child, BoundingBox bounds)
+{
+	if (IsFlatBSPLeaf(child))
+	{
+		return;
+	}
+
+	FlatBSPTree* tree = vis->tree;
+	FlatBSPNode* node = &tree->nodes[child];
+	Plane plane = tree->planes[node->planeIndex];
+
+	int cell = GetVisCell(vis, child);
+	int frontCell = GetVisCell(vis, node->children[0]);
+	int backCell = GetVisCell(vis, node->children[1]);
+
+	// the new portal is the split plane clipped to this node's cell
+	std::vector<glm::vec3> nodeWinding = BaseWindingForPlane(plane, bounds);
+	std::vector<int> portals = vis->cellPortals[cell];
+	for (int i = 0; i < portals.size() && nodeWinding.size() >= 3; i++)
+	{
+		nodeWinding = ClipWindingToCellSide(vis, nodeWinding, &vis->portals[portals[i]], cell);
+	}
+
+	// hand the portals bounding this cell to the children
+	for (int i = 0; i < portals.size(); i++)
+	{
+		// copy, AddVisPortal can grow the array
+		VisPortal portal = vis->portals[portals[i]];
+		vis->portals[portals[i]].removed = true;
+
+		int side = portal.cells[0] == cell ? 0 : 1;
+		int otherCell = portal.cells[!side];
+		RemovePortalFromCell(vis, otherCell, portals[i]);
+
+		int numFront = 0, numBack = 0;
+		for (int j = 0; j < portal.winding.size(); j++)
+		{
+			SplittingPlaneResult result = ClassifyPointToPlane(portal.winding[j], plane);
+			numFront += result == SplittingPlaneResult::POINT_FRONT;
+			numBack += result == SplittingPlaneResult::POINT_BACK;
+		}
+
+		std::vector<glm::vec3> frontWinding, backWinding;
+		if (numFront == 0 && numBack == 0)
+		{
+			// portal lies on the split plane, it goes to whichever child the cell is on
+			glm::vec3 intoCell = side == 0 ? portal.plane.normal : -portal.plane.normal;
+			if (glm::dot(intoCell, plane.normal) > 0)
+			{
+				frontWinding = portal.winding;
+			}
+			else
+			{
+				backWinding = portal.winding;
+			}
+		}
+		else if (numBack == 0)
+		{
+			frontWinding = portal.winding;
+		}
+		else if (numFront == 0)
+		{
+			backWinding = portal.winding;
+		}
+		else
+		{
+			frontWinding = ClipVerticesBehindPlane(portal.winding, GetOppositeFacingPlane(plane));
+			backWinding = ClipVerticesBehindPlane(portal.winding, plane);
+		}
+
+		int frontCells[2] = { portal.cells[0], portal.cells[1] };
+		int backCells[2] = { portal.cells[0], portal.cells[1] };
+		frontCells[side] = frontCell;
+		backCells[side] = backCell;
+
+		AddVisPortal(vis, frontWinding, portal.plane, frontCells[0], frontCells[1]);
+		AddVisPortal(vis, backWinding, portal.plane, backCells[0], backCells[1]);
+	}
+	vis->cellPortals[cell].clear();
+
+	AddVisPortal(vis, nodeWinding, plane, frontCell, backCell);
+
+	MakeTreePortals_r(vis, node->children[0], bounds);
+	MakeTreePortals_r(vis, node->children[1], bounds);
+}
+
+
+// a leaf is solid if its whole cell, the hull of its portals, is inside one of its brushes
+bool IsVisLeafSolid(VisContext* vis, int leafIndex)
+{
+	FlatBSPTree* tree = vis->tree;
+	FlatBSPLeaf* leaf = &tree->leaves[leafIndex];
+	std::vector<int>& portals = vis->cellPortals[GetVisCell(vis, FlatBSPLeafChild(leafIndex))];
+
+	for (int i = 0; i < leaf->numLeafBrushes; i++)
+	{
+		FlatBSPBrush* brush = &tree->brushes[tree->leafBrushes[leaf->firstLeafBrush + i]];
+		int* sides = &tree->brushSides[brush->firstSide];
+
+		bool inside = true;
+		for (int j = 0; j < portals.size() && inside; j++)
+		{
+			std::vector<glm::vec3>& winding = vis->portals[portals[j]].winding;
+			for (int k = 0; k < winding.size() && inside; k++)
+			{
+				for (int p = 0; p < brush->numSides; p++)
+				{
+					if (ClassifyPointToPlane(winding[k], tree->planes[sides[p]]) == SplittingPlaneResult::POINT_FRONT)
+					{
+						inside = false;
+						break;
+					}
+				}
+			}
+		}
+
+		if (inside)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void MakeFlowPortals(VisContext* vis)
+{
+	int numLeaves = vis->tree->leaves.size();
+	vis->leafFlowPortals.assign(numLeaves, std::vector<int>());
+
+	for (int i = 0; i < vis->portals.size(); i++)
+	{
+		VisPortal* portal = &vis->portals[i];
+		if (portal->removed || !IsVisCellLeaf(vis, portal->cells[0]) || !IsVisCellLeaf(vis, portal->cells[1]))
+		{
+			continue;
+		}
+
+		int frontLeaf = GetVisCellLeafIndex(vis, portal->cells[0]);
+		int backLeaf = GetVisCellLeafIndex(vis, portal->cells[1]);
+		if (vis->leafIsSolid[frontLeaf] || vis->leafIsSolid[backLeaf])
+		{
+			continue;
+		}
+
+		// back leaf looking into the front leaf
+		VisFlowPortal forward;
+		forward.winding = portal->winding;
+		forward.plane = portal->plane;
+		forward.leaf = frontLeaf;
+		vis->leafFlowPortals[backLeaf].push_back(vis->flowPortals.size());
+		vis->flowPortals.push_back(forward);
+
+		// front leaf looking into the back leaf
+		VisFlowPortal backward;
+		backward.winding = portal->winding;
+		std::reverse(backward.winding.begin(), backward.winding.end());
+		backward.plane = GetOppositeFacingPlane(portal->plane);
+		backward.leaf = backLeaf;
+		vis->leafFlowPortals[frontLeaf].push_back(vis->flowPortals.size());
+		vis->flowPortals.push_back(backward);
+	}
+}
+
+
+void SimpleFlood(VisContext* vis, std::vector<bool>& portalFront, std::vector<bool>& mightSee, int leaf)
+{
+	if (mightSee[leaf])
+	{
+		return;
+	}
+	mightSee[leaf] = true;
+
+	std::vector<int>& portals = vis->leafFlowPortals[leaf];
+	for (int i = 0; i < portals.size(); i++)
+	{
+		if (portalFront[portals[i]])
+		{
+			SimpleFlood(vis, portalFront, mightSee, vis->flowPortals[portals[i]].leaf);
+		}
+	}
+}
+
+
+// which leaves might be seen by looking through portal p
+std::vector<bool> BasePortalVis(VisContext* vis, int p)
+{
+	VisFlowPortal* portal = &vis->flowPortals[p];
+	std::vector<bool> portalFront(vis->flowPortals.size(), false);
+
+	for (int i = 0; i < vis->flowPortals.size(); i++)
+	{
+		if (i == p)
+		{
+			continue;
+		}
+		VisFlowPortal* other = &vis->flowPortals[i];
+
+		// other has to be at least partly beyond portal
+		bool inFront = false;
+		for (int j = 0; j < other->winding.size() && !inFront; j++)
+		{
+			inFront = ClassifyPointToPlane(other->winding[j], portal->plane) == SplittingPlaneResult::POINT_FRONT;
+		}
+
+		// and portal has to be at least partly before other
+		bool behind = false;
+		for (int j = 0; j < portal->winding.size() && !behind; j++)
+		{
+			behind = ClassifyPointToPlane(portal->winding[j], other->plane) == SplittingPlaneResult::POINT_BACK;
+		}
+
+		portalFront[i] = inFront && behind;
+	}
+
+	std::vector<bool> mightSee(vis->tree->leaves.size(), false);
+	SimpleFlood(vis, portalFront, mightSee, portal->leaf);
+	return mightSee;
+}
+
+
+void ComputePortalVisThreaded(VisContext* vis, std::vector<std::vector<bool>>& portalMightSee, int numThreads)
+{
+	std::atomic<int> nextPortal(0);
+	auto worker = [&]()
+	{
+		while (true)
+		{
+			int p = nextPortal++;
+			if (p >= vis->flowPortals.size())
+			{
+				return;
+			}
+			portalMightSee[p] = BasePortalVis(vis, p);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numThreads; i++)
+	{
+		threads.push_back(std::thread(worker));
+	}
+	worker();
+
+	for (int i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+}
+
+
+inline bool IsLeafInPVSRow(const unsigned char* row, int leafIndex)
+{
+	return (row[leafIndex >> 3] & (1 << (leafIndex & 7))) != 0;
+}
+
+
+// fills in tree->pvs. Solid leaves get an empty row
+VisStats ComputeBSPVisibility(FlatBSPTree* tree, int numThreads = 0)
+{
+	VisStats stats = {};
+
+	int numLeaves = tree->leaves.size();
+	tree->pvsRowBytes = (numLeaves + 7) / 8;
+	tree->pvs.assign(numLeaves * tree->pvsRowBytes, 0);
+
+	if (IsFlatBSPLeaf(tree->root))
+	{
+		// never split, there is only the one leaf
+		tree->pvs[0] = 1;
+		return stats;
+	}
+
+	VisContext vis;
+	vis.tree = tree;
+	vis.outsideCell = tree->nodes.size() + numLeaves;
+	vis.cellPortals.assign(vis.outsideCell + 1, std::vector<int>());
+
+	BoundingBox bounds = *GetFlatBSPBounds(tree, tree->root);
+	MakeHeadnodePortals(&vis, bounds);
+	MakeTreePortals_r(&vis, tree->root, bounds);
+
+	vis.leafIsSolid.assign(numLeaves, false);
+	for (int i = 0; i < numLeaves; i++)
+	{
+		vis.leafIsSolid[i] = IsVisLeafSolid(&vis, i);
+		stats.numSolidLeaves += vis.leafIsSolid[i];
+	}
+
+	MakeFlowPortals(&vis);
+	stats.numPortals = vis.flowPortals.size() / 2;
+
+	if (numThreads <= 0)
+	{
+		numThreads = std::max<int>(std::thread::hardware_concurrency(), 1);
+	}
+	stats.numThreads = numThreads;
+
+	std::vector<std::vector<bool>> portalMightSee(vis.flowPortals.size());
+	ComputePortalVisThreaded(&vis, portalMightSee, numThreads);
+
+	int numVisible = 0;
+	for (int i = 0; i < numLeaves; i++)
+	{
+		if (vis.leafIsSolid[i])
+		{
+			continue;
+		}
+
+		unsigned char* row = &tree->pvs[i * tree->pvsRowBytes];
+		row[i >> 3] |= 1 << (i & 7);
+
+		std::vector<int>& portals = vis.leafFlowPortals[i];
+		for (int j = 0; j < portals.size(); j++)
+		{
+			std::vector<bool>& mightSee = portalMightSee[portals[j]];
+			for (int k = 0; k < numLeaves; k++)
+			{
+				if (mightSee[k])
+				{
+					row[k >> 3] |= 1 << (k & 7);
+				}
+			}
+		}
+
+		for (int k = 0; k < numLeaves; k++)
+		{
+			numVisible += IsLeafInPVSRow(row, k);
+		}
+	}
+
+	int numEmptyLeaves = numLeaves - stats.numSolidLeaves;
+	if (numEmptyLeaves > 0)
+	{
+		stats.averageVisibleLeaves = numVisible / (float)numEmptyLeaves;
+	}
+	return stats;
+}
+
+
+/////////////////////////////////////////////
+// runtime side
+/////////////////////////////////////////////
+
+int PointInLeaf(BSPCollisionModel* model, glm::vec3 point)
+{
+	int child = model->root;
+	while (!IsFlatBSPLeaf(child))
+	{
+		FlatBSPNode* node = &model->nodes[child];
+		Plane* plane = &model->planes[node->planeIndex];
+		float dist = glm::dot(plane->normal, point) - plane->distance;
+		child = node->children[dist >= 0 ? 0 : 1];
+	}
+	return FlatBSPLeafIndex(child);
+}
+
+
+// every leaf the box touches, touching a leaf's boundary counts
+void BoxLeafs_r(BSPCollisionModel* model, int child, BoundingBox& bb, std::vector<int>& leaves)
+{
+	const float BOX_LEAF_EPSILON = 0.1f;
+
+	while (!IsFlatBSPLeaf(child))
+	{
+		FlatBSPNode* node = &model->nodes[child];
+		Plane* plane = &model->planes[node->planeIndex];
+
+		// distance range of the box corners to the plane
+		glm::vec3 center = (bb.min + bb.max) * 0.5f;
+		glm::vec3 extents = (bb.max - bb.min) * 0.5f;
+		float centerDist = glm::dot(plane->normal, center) - plane->distance;
+		float radius = glm::dot(glm::abs(plane->normal), extents);
+
+		bool front = centerDist + radius >= -BOX_LEAF_EPSILON;
+		bool back = centerDist - radius <= BOX_LEAF_EPSILON;
+
+		if (front && back)
+		{
+			BoxLeafs_r(model, node->children[1], bb, leaves);
+		}
+		child = front ? node->children[0] : node->children[1];
+	}
+
+	leaves.push_back(FlatBSPLeafIndex(child));
+}
+
+std::vector<int> BoxLeafs(BSPCollisionModel* model, BoundingBox bb)
+{
+	std::vector<int> leaves;
+	BoxLeafs_r(model, model->root, bb, leaves);
+	return leaves;
+}
+
+
+bool HasPVS(BSPCollisionModel* model, int leafIndex)
+{
+	// solid leaves have an empty row, not even themselves
+	return model->pvs != NULL && leafIndex >= 0 &&
+		IsLeafInPVSRow(&model->pvs[leafIndex * model->pvsRowBytes], leafIndex);
+}
+
+bool IsLeafPotentiallyVisible(BSPCollisionModel* model, int fromLeaf, int toLeaf)
+{
+	if (!HasPVS(model, fromLeaf))
+	{
+		return true;
+	}
+	return IsLeafInPVSRow(&model->pvs[fromLeaf * model->pvsRowBytes], toLeaf);
+}
@@ -2,6 +2,7 @@
 
 
 #include "../staggered_concentric_pattern/debug_interface.h"
+#include "trace_stats.h"
 
 #include <vector>
 #include <unordered_map>
@@ -60,6 +61,11 @@ struct DebugFrame
 	// all profile nodes, regardless of threads are under this
 	ProfileNode* rootProfileNode;
 
+#ifdef TRACE_STATS
+	// what the traces of the frame cost, handed over by the game with CollateTraceStats
+	TraceStatsFrame traceStats;
+#endif
+
 	void PrintDebug()
 	{
 		std::cout << "frameIndex " << frameIndex << ", beginClock " << beginClock << " endClock " << endClock << std::endl;
@@ -180,6 +186,10 @@ void initDebugFrame(DebugFrame* debugFrame, uint64 beginClock, MemoryArena* memo
 	debugFrame->frameIndex = frameIndex;
 
 	debugFrame->rootProfileNode->children.clear();
+
+#ifdef TRACE_STATS
+	debugFrame->traceStats = {};
+#endif
 }
 
 
@@ -386,4 +396,14 @@ void ProcessDebugEvents(DebugState* debugState, DebugEvent* debugEventsArray, ui
 }
 
 
-
+#ifdef TRACE_STATS
+// the game's trace stats go into the frame being collated, so they come out of the 
+// collation with the frame's profile blocks. Nothing to put them in before the first frame marker
+void CollateTraceStats(DebugState* debugState, TraceStatsFrame* stats)
+{
+	if (debugState->collationFrame)
+	{
+		MergeTraceStatsFrame(&debugState->collationFrame->traceStats, stats);
+	}
+}
+#endif
@@ -0,0 +1,353 @@
+#pragma once
+
+#include <iostream>
+
+#include "../PlatformShared/platform_shared.h"
+#include "world.h"
+
+/*
+	Entity movement, the player's and the simulated movers'.
+
+	The movers are moved in jobs on the platform work queue, a run of movers per job.
+	During the movement phase the world is only read: the collision model is never touched
+	by a trace, the trace mailbox is thread_local, and the ground trace cache belongs to
+	the entity. A job only writes the movers it was given, so where a mover ends up doesnt
+	depend on which thread moved it or when.
+
+			movers	[ 0 .. 31 | 32 .. 63 | 64 .. 95 | ... ]
+					   job 0      job 1      job 2
+						|		   |		  |
+					 thread 3   thread 0   main thread
+
+	The one thing the movers share is world->traceRecording. Each job records into a corpus
+	of its own and those are appended in job order afterwards, which is the order a single
+	threaded run records in. Trace stats are handed back the same way, so they end up in the
+	frame of the thread that moved the entities.
+*/
+
+void CatagorizePosition(World* world, Entity* entity)
+{
+	glm::vec3 end = entity->pos;
+	end[1] -= 0.25;
+
+	TraceResult result = WorldBoxTraceCached(world, &entity->groundTraceCache, entity->pos, end, entity->min, entity->max);
+//	cout << "result.timeFraction " << result.timeFraction << endl;
+
+	if(result.plane == NULL_PLANE && result.outputStartsOut)
+	{
+//		cout << "	has no ground entity ";
+
+		entity->groundEntity = NULL;
+		entity->groundPlane = NULL_PLANE;
+	}
+	else
+	{
+//		cout << "	has ground entity ";
+		entity->groundEntity = (Entity*)1;
+		entity->groundPlane = result.plane;
+	}
+}
+
+
+struct PlayerMoveData
+{
+//	glm::vec3 position;
+	glm::vec3 velocity;
+
+	// prints the move and its traces, only the controlled entity sets it
+	bool print;
+};
+
+void PerformMove2(World* world, Entity* entity, PlayerMoveData* move)
+{
+	glm::vec3 origin = entity->pos;
+	glm::vec3 velocity = move->velocity;
+
+	int numClippingPlaces = 0;
+	float timeLeft = 0.1f;// FIXED_UPDATE_TIME_S;
+	for (int i = 0; i < 1; i++)
+	{
+		glm::vec3 end = origin + timeLeft * velocity;
+
+		if (move->print)
+		{
+			std::cout << "origin " << origin << std::endl;
+			std::cout << "end " << end << std::endl;
+		}
+
+		TraceResult result = WorldBoxTrace(world, origin, end, entity->min, entity->max, move->print);
+
+		if (move->print)
+		{
+			std::cout << "result time fraction " << result.timeFraction << std::endl;
+		}
+
+		if (result.outputAllSolid)
+		{
+			move->velocity = glm::vec3(0);
+			return;
+		}
+
+		if (result.timeFraction > 0)
+		{
+			entity->pos = result.endPos;
+			numClippingPlaces = 0;
+		}
+		else if (result.timeFraction == 0)
+		{
+
+		}
+		else if (result.timeFraction == 1)
+		{
+			break;
+		}
+
+		timeLeft -= timeLeft * result.timeFraction;
+
+
+		numClippingPlaces++;
+	}
+
+
+
+}
+
+
+
+void EntityMoveTick(World* world, Entity* entity, PlayerMoveData* move, bool applyGravity)
+{
+	if (entity->groundEntity != NULL)
+	{
+
+		if (move->velocity.x != 0 || move->velocity.z != 0)
+		{
+			if (move->print)
+			{
+				std::cout << "ground entity" << std::endl;
+			}
+
+			PerformMove2(world, entity, move);
+		}
+	}
+	else
+	{
+	//	std::cout << "in air" << std::endl;
+		if (applyGravity)
+		{
+			const glm::vec3 GRAVITY = glm::vec3(0, -5, 0);
+			move->velocity += GRAVITY;
+		}
+
+		if (move->velocity.x != 0 || move->velocity.y != 0 || move->velocity.z != 0)
+		{
+			PerformMove2(world, entity, move);
+		}
+	}
+}
+
+
+void PlayerMove(World* world, Entity* entity, PlayerMoveData* move, bool applyGravity)
+{
+	// categorize current position
+	CatagorizePosition(world, entity);
+
+	// slide move
+	EntityMoveTick(world, entity, move, applyGravity);
+
+	// categoize current position 2
+	CatagorizePosition(world, entity);
+}
+
+
+// player sized entity that walks in a straight line and turns when it runs into something
+struct EntityMover
+{
+	Entity entity;
+	glm::vec3 wishDirection;
+
+	// xorshift state, each mover has its own so the turns dont depend on the move order
+	unsigned int randomState;
+};
+
+const float ENTITY_MOVER_SPEED = 40.0f;
+
+const int ENTITY_MOVE_JOB_SIZE = 32;
+
+// the platform queue only holds so many entries, bigger jobs past this
+const int MAX_ENTITY_MOVE_JOBS = 64;
+
+struct EntityMoveJob
+{
+	World* world;
+	EntityMover* movers;
+	int numMovers;
+
+	// only used when the world is recording traces
+	TraceCorpus traceRecording;
+
+#ifdef TRACE_STATS
+	TraceStatsFrame traceStats;
+#endif
+};
+
+
+void PickEntityMoverDirection(EntityMover* mover)
+{
+	unsigned int x = mover->randomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	mover->randomState = x;
+
+	float angle = (x & 0xffff) / 65536.0f * 2 * glm::pi<float>();
+	mover->wishDirection = glm::vec3(cos(angle), 0, sin(angle));
+}
+
+
+// Drops count movers at random spots around the level's brushes where their box is clear and 
+// there is something under them to land on. Gives up after a few tries a mover, so it can
+// come back with fewer
+void SpawnEntityMovers(World* world, std::vector<EntityMover>& movers, int count, unsigned int seed)
+{
+	BSPCollisionModel* model = &world->collisionModel;
+	BoundingBox bounds = EmptyBoundingBox();
+	for (int i = 0; i < model->numBrushes; i++)
+	{
+		if (model->brushes[i].contents != 0)
+		{
+			bounds = UnionBoundingBox(bounds, model->brushes[i].bounds);
+		}
+	}
+	if (IsBoundingBoxEmpty(bounds))
+	{
+		return;
+	}
+
+	// room to stand on top of the highest brush
+	bounds.max.y += PLAYER_MAXS.y - PLAYER_MINS.y;
+
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+
+	const int MAX_SPAWN_TRIES = 16;
+	int numSpawned = 0;
+	for (int i = 0; i < count * MAX_SPAWN_TRIES && numSpawned < count; i++)
+	{
+		glm::vec3 pos;
+		for (int j = 0; j < 3; j++)
+		{
+			pos[j] = bounds.min[j] + distribution(random) * (bounds.max[j] - bounds.min[j]);
+		}
+
+		if (BoxContents(model, pos, PLAYER_MINS, PLAYER_MAXS) != 0)
+		{
+			continue;
+		}
+
+		glm::vec3 floor = glm::vec3(pos.x, bounds.min.y, pos.z);
+		TraceResult result = BoxTrace(pos, floor, PLAYER_MINS, PLAYER_MAXS, model);
+		if (result.timeFraction == 1)
+		{
+			continue;
+		}
+
+		EntityMover mover = {};
+		initPlayerEntity(&mover.entity, pos);
+		mover.randomState = random() | 1;
+		PickEntityMoverDirection(&mover);
+
+		movers.push_back(mover);
+		numSpawned++;
+	}
+}
+
+
+void EntityMoverTick(World* world, EntityMover* mover)
+{
+	Entity* entity = &mover->entity;
+	glm::vec3 start = entity->pos;
+
+	PlayerMoveData move = {};
+	move.velocity = ENTITY_MOVER_SPEED * mover->wishDirection;
+	PlayerMove(world, entity, &move, true);
+	entity->velocity = move.velocity;
+
+	// walked into something
+	if (entity->groundEntity != NULL && entity->pos.x == start.x && entity->pos.z == start.z)
+	{
+		PickEntityMoverDirection(mover);
+	}
+}
+
+
+void DoEntityMoveJob(PlatformWorkQueue* queue, void* data)
+{
+	EntityMoveJob* job = (EntityMoveJob*)data;
+
+	// the thread can be in the middle of a frame of its own, like the main thread helping out
+#ifdef TRACE_STATS
+	TraceStatsFrame threadStats = EndTraceStatsFrame();
+#endif
+
+	threadTraceRecording = &job->traceRecording;
+	for (int i = 0; i < job->numMovers; i++)
+	{
+		EntityMoverTick(job->world, &job->movers[i]);
+	}
+	threadTraceRecording = NULL;
+
+#ifdef TRACE_STATS
+	job->traceStats = EndTraceStatsFrame();
+	threadTraceStats = threadStats;
+#endif
+}
+
+
+// moves all movers one tick, on the queue when there is one, otherwise right here
+void MoveEntities(World* world, std::vector<EntityMover>& movers, PlatformAPI* platform, PlatformWorkQueue* queue)
+{
+	if (queue == NULL || platform->addWorkQueueEntry == NULL)
+	{
+		for (int i = 0; i < movers.size(); i++)
+		{
+			EntityMoverTick(world, &movers[i]);
+		}
+		return;
+	}
+
+	int numMovers = movers.size();
+	int jobSize = std::max(ENTITY_MOVE_JOB_SIZE, (numMovers + MAX_ENTITY_MOVE_JOBS - 1) / MAX_ENTITY_MOVE_JOBS);
+
+	// all jobs go in before any are queued, the queue holds pointers into this
+	std::vector<EntityMoveJob> jobs;
+	for (int first = 0; first < numMovers; first += jobSize)
+	{
+		EntityMoveJob job;
+		job.world = world;
+		job.movers = &movers[first];
+		job.numMovers = std::min(jobSize, numMovers - first);
+		jobs.push_back(job);
+	}
+
+	for (int i = 0; i < jobs.size(); i++)
+	{
+		platform->addWorkQueueEntry(queue, DoEntityMoveJob, &jobs[i]);
+	}
+	platform->completeAllWork(queue);
+
+#ifdef TRACE_STATS
+	for (int i = 0; i < jobs.size(); i++)
+	{
+		MergeTraceStatsFrame(&threadTraceStats, &jobs[i].traceStats);
+	}
+#endif
+
+	if (world->traceRecording)
+	{
+		for (int i = 0; i < jobs.size(); i++)
+		{
+			std::vector<RecordedTrace>& traces = jobs[i].traceRecording.traces;
+			world->traceRecording->traces.insert(world->traceRecording->traces.end(), traces.begin(), traces.end());
+		}
+	}
+}
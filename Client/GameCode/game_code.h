@@ -10,10 +10,12 @@
 //#include "debug_interface.h"
 #include "memory.h"
 #include "world.h"
+#include "entity_move.h"
 #include "../staggered_concentric_pattern/asset.h"
 #include "debug.h"
 
 #include <iostream>
+#include <string>
 
 
 
@@ -33,6 +35,8 @@ glm::vec4 COLOR_TEAL = glm::vec4(0, 1, 1, 1);
 
 
 static PlatformAPI platformAPI;
+static PlatformWorkQueue* platformWorkQueue;
+static PlatformWorkQueue* platformLowPriorityQueue;
 
 static FontId debugFontId;
 static LoadedFont* debugLoadedFont;
@@ -45,6 +49,21 @@ int MAX_DEBUG_EVENT_ARRAY_COUNT = 8;
 
 float FIXED_UPDATE_TIME_S = 0.016f;
 
+// records the traces of a play session for AssetBuilder -compare_split_cost -traces
+const bool RECORD_TRACE_CORPUS = false;
+const int TRACE_CORPUS_SIZE = 20000;
+const char* TRACE_CORPUS_FILE = "./Assets/area_a.traces";
+
+// simulated movers for load testing movement, moved on the work queue every tick.
+// They only spawn where there are brushes to stand on, area_a has none
+const int NUM_ENTITY_MOVERS = 256;
+
+// casts a capsule the size of the player down the view direction and draws where it stops
+const bool DEBUG_DRAW_VIEW_CAPSULE_TRACE = false;
+
+// the trace cost histograms of the last collated frame, only in builds with TRACE_STATS
+const bool DEBUG_DRAW_TRACE_STATS = false;
+
 
 // This is mirroring the sim_region struct in handmade_sim_region.h
 struct GameState
@@ -57,6 +76,17 @@ struct GameState
 
 	bool mouseIsDebugMode;
 
+	// what of world->bspDebugDraw gets drawn
+	BSPDebugDrawFilter bspDebugDrawFilter;
+
+	// see NUM_ENTITY_MOVERS
+	std::vector<EntityMover> movers;
+
+#ifdef TRACE_STATS
+	// what the traces of the last frame cost, see trace_stats.h
+	TraceStatsFrame traceStats;
+#endif
+
 	MemoryArena memoryArena;
 };
 
@@ -99,70 +129,6 @@ void* PushRenderElement_(GameRenderCommands* commands, RenderGroupEntryType type
 
 
 
-void PushTreeRecursive(GameRenderCommands* gameRenderCommands, RenderGroup* group, LoadedBitmap* bitmap, BSPNode* node, bool isFront, int depth)
-{
-	static glm::vec4 colorList[5] = { COLOR_RED, COLOR_GREEN, COLOR_BLUE, COLOR_YELLOW, COLOR_TEAL };
-
-	bool renderFlag = true;// depth == 0;
-//	bool renderFlag = depth == 1;
-
-
-	if (node == NULL)
-	{
-		return;
-	}
-
-	// cout << "node " << node->brushes.size() << endl;
-	if (node->brushes.size() > 0)
-	{
-		//	std::cout << "brush size" << node->brushes.size() << std::endl;
-
-		for (int i = 0; i < node->brushes.size(); i++)
-		{
-			//	std::cout << "	polygon size" << node->brushes[i].polygons.size() << std::endl;
-
-			for (int j = 0; j < node->brushes[i].polygons.size(); j++)
-			{
-				if (renderFlag)
-				{
-					if (isFront)
-					{
-						//	cout << "rendering front" << endl;
-				//		PushPlaneOutline(gameRenderCommands, group, bitmap, COLOR_RED, node->brushes[i].polygons[j]);
-					}
-					else
-					{
-						//	cout << "rendering back" << endl;
-
-				//		PushPlaneOutline(gameRenderCommands, group, bitmap, COLOR_BLUE, node->brushes[i].polygons[j]);
-					}
-				}
-			}
-		}
-		return;
-	}
-
-	if (renderFlag)
-	{
-		if (!node->IsLeafNode())
-		{
-			glm::vec4 color = COLOR_GREEN;
-			color.a = 0.01;
-
-			//	if (!IsAxialPlane(node->debugSplitPolygon.plane))
-			{
-				RenderCmdUtil::PushPlane(gameRenderCommands, group, bitmap, color, node->debugSplitPolygon.vertices, true);
-				RenderCmdUtil::PushPlaneOutline(gameRenderCommands, group, bitmap, COLOR_GREEN, node->debugSplitPolygon.vertices);
-			}
-		}
-	}
-
-	// render the splitting plane
-	PushTreeRecursive(gameRenderCommands, group, bitmap, node->children[0], true, depth + 1);
-	PushTreeRecursive(gameRenderCommands, group, bitmap, node->children[1], false, depth + 1);
-}
-
-
 glm::vec3 GetHorizontalVector(glm::vec3 dir, bool left)
 {
 	glm::vec3 supportingVector = glm::vec3(0, 1, 0);
@@ -285,190 +251,23 @@ void RenderEntityStaticModel(GameRenderCommands* gameRenderCommands,
 
 	for (int i = 0; i < entity->model.size(); i++)
 	{
-		assert(entity->model[i].vertices.size() == 4);
+		std::vector<glm::vec3>& vertices = entity->model[i].vertices;
+		assert(vertices.size() >= 3);
 
-		RenderCmdUtil::PushQuad(gameRenderCommands, renderGroup, bitmap,
-			entity->model[i].vertices[0],
-			entity->model[i].vertices[1],
-			entity->model[i].vertices[2],
-			entity->model[i].vertices[3], COLOR_WHITE);
-	}
-
-}
-
-
-void CatagorizePosition(World* world, Entity* entity)
-{
-	glm::vec3 end = entity->pos;
-	end[1] -= 0.25;
-
-	TraceResult result = BoxTrace(entity->pos, end, entity->min, entity->max, world->tree);
-//	cout << "result.timeFraction " << result.timeFraction << endl;
-
-	if(result.plane == NULL_PLANE && result.outputStartsOut)
-	{
-//		cout << "	has no ground entity ";
-
-		entity->groundEntity = NULL;
-		entity->groundPlane = NULL_PLANE;
-	}
-	else 
-	{
-//		cout << "	has ground entity ";
-		entity->groundEntity = (Entity*)1;
-		entity->groundPlane = result.plane;
-	}
-}
-
-
-struct PlayerMoveData
-{
-//	glm::vec3 position;
-	glm::vec3 velocity;
-};
-
-void PerformMove(World* world, Entity* entity, PlayerMoveData* move)
-{
-	glm::vec3 origin = entity->pos;
-	glm::vec3 velocity = move->velocity;
-
-	int numClippingPlaces = 0;
-	float timeLeft = 0.1f;// FIXED_UPDATE_TIME_S;
-	for (int i = 0; i < 1; i++)
-	{
-		glm::vec3 end = origin + timeLeft * velocity;
-
-		cout << "origin " << origin << endl;
-		cout << "end " << end << endl;
-
-		TraceResult result = BoxTrace(origin, end, entity->min, entity->max, world->tree);
-
-		if (result.outputAllSolid)
-		{
-			move->velocity = glm::vec3(0);
-			return;
-		}
-	
-		if (result.timeFraction > 0)
-		{
-			entity->pos = result.endPos;
-			numClippingPlaces = 0;
-		}
-		else if (result.timeFraction == 0)
+		// faces clipped by CSG can have any number of vertices, so we fan them out as quads.
+		// a leftover triangle is pushed as a quad with its last vertex repeated
+		for (int j = 1; j + 1 < vertices.size(); j += 2)
 		{
+			glm::vec3 last = j + 2 < vertices.size() ? vertices[j + 2] : vertices[j + 1];
 
+			RenderCmdUtil::PushQuad(gameRenderCommands, renderGroup, bitmap,
+				vertices[0],
+				vertices[j],
+				vertices[j + 1],
+				last, COLOR_WHITE);
 		}
-		else if (result.timeFraction == 1)
-		{
-			break;
-		}
-
-		timeLeft -= timeLeft * result.timeFraction;
-
-
-		numClippingPlaces++;
 	}
 
-
-
-}
-
-
-
-void PerformMove2(World* world, Entity* entity, PlayerMoveData* move)
-{
-	glm::vec3 origin = entity->pos;
-	glm::vec3 velocity = move->velocity;
-
-	int numClippingPlaces = 0;
-	float timeLeft = 0.1f;// FIXED_UPDATE_TIME_S;
-	for (int i = 0; i < 1; i++)
-	{
-		glm::vec3 end = origin + timeLeft * velocity;
-
-		if (origin.y == 10.5)
-		{
-			int a = 1;
-		}
-
-		cout << "origin " << origin << endl;
-		cout << "end " << end << endl;
-
-		TraceResult result = BoxTrace(origin, end, entity->min, entity->max, world->tree, true);
-
-		cout << "result time fraction " << result.timeFraction << endl;
-
-		if (result.outputAllSolid)
-		{
-			move->velocity = glm::vec3(0);
-			return;
-		}
-
-		if (result.timeFraction > 0)
-		{
-			entity->pos = result.endPos;
-			numClippingPlaces = 0;
-		}
-		else if (result.timeFraction == 0)
-		{
-
-		}
-		else if (result.timeFraction == 1)
-		{
-			break;
-		}
-
-		timeLeft -= timeLeft * result.timeFraction;
-
-
-		numClippingPlaces++;
-	}
-
-
-
-}
-
-
-
-void EntityMoveTick(World* world, Entity* entity, PlayerMoveData* move, bool applyGravity)
-{
-	if (entity->groundEntity != NULL)
-	{
-
-		if (move->velocity.x != 0 || move->velocity.z != 0)
-		{
-			std::cout << "ground entity" << std::endl;
-
-			PerformMove2(world, entity, move);
-		}
-	}
-	else
-	{
-	//	std::cout << "in air" << std::endl;
-		if (applyGravity)
-		{
-			static glm::vec3 GRAVITY = glm::vec3(0, -5, 0);
-			move->velocity += GRAVITY;
-		}
-
-		if (move->velocity.x != 0 || move->velocity.y != 0 || move->velocity.z != 0)
-		{
-			PerformMove2(world, entity, move);
-		}
-	}
-}
-
-
-void PlayerMove(World* world, Entity* entity, PlayerMoveData* move, bool applyGravity)
-{
-	// categorize current position
-	CatagorizePosition(world, entity);
-
-	// slide move
-	EntityMoveTick(world, entity, move, applyGravity);
-
-	// categoize current position 2
-	CatagorizePosition(world, entity);
 }
 
 
@@ -545,6 +344,7 @@ void WorldTickAndRender(GameState* gameState, GameAssets* gameAssets,
 	//	cam->SetViewDirection(newViewDir);
 
 	PlayerMoveData pmove = {};
+	pmove.print = true;
 
 	// process input
 	float stepSize = 40.0f;
@@ -612,6 +412,9 @@ void WorldTickAndRender(GameState* gameState, GameAssets* gameAssets,
 	// world->entities[world->startPlayerEntityId].pos = pmove.position;
 	world->entities[world->startPlayerEntityId].velocity = pmove.velocity;
 
+	UpdateWorldRebuild(world);
+	MoveEntities(world, gameState->movers, &platformAPI, platformWorkQueue);
+
 
 	// Update camera matrix
 	glm::vec3 center = controlledEntity->pos + newViewDir;
@@ -650,13 +453,17 @@ void WorldTickAndRender(GameState* gameState, GameAssets* gameAssets,
 	group.quads->renderSetup = renderSetup;
 
 
+	int cameraLeaf = PointInLeaf(&world->collisionModel, controlledEntity->pos);
 	for (int i = 0; i < world->numEntities; i++)
 	{
 		Entity* entity = &world->entities[i];
 		switch (entity->flag)
 		{
 			case EntityFlag::STATIC:
-				RenderEntityStaticModel(gameRenderCommands, &group, gameAssets, entity);
+				if (IsEntityPotentiallyVisible(world, cameraLeaf, entity))
+				{
+					RenderEntityStaticModel(gameRenderCommands, &group, gameAssets, entity);
+				}
 				break;
 
 			case EntityFlag::PLAYER:
@@ -673,7 +480,32 @@ void WorldTickAndRender(GameState* gameState, GameAssets* gameAssets,
 	LoadedBitmap* bitmap = GetBitmap(gameAssets, bitmapID);
 	RenderCmdUtil::PushCoordinateSystem(gameRenderCommands, &group, bitmap, glm::vec3(0, 0, 0), glm::vec3(scale, scale, scale));
 
-	PushTreeRecursive(gameRenderCommands, &group, bitmap, world->tree, true, 0);
+	for (int i = 0; i < gameState->movers.size(); i++)
+	{
+		Entity* entity = &gameState->movers[i].entity;
+		RenderCmdUtil::PushCube(gameRenderCommands, &group, bitmap, COLOR_YELLOW, entity->pos + entity->min, entity->pos + entity->max);
+	}
+
+	if (DEBUG_DRAW_VIEW_CAPSULE_TRACE)
+	{
+		float radius = PLAYER_MAXS.x;
+		float halfHeight = PLAYER_MAXS.y - radius;
+
+		glm::vec3 viewDir = controlledEntity->GetViewDirection();
+		glm::vec3 start = controlledEntity->pos + 2 * (radius + halfHeight) * viewDir;
+		glm::vec3 end = start + 500.0f * viewDir;
+		TraceResult result = WorldCapsuleTrace(world, start, end, radius, halfHeight);
+
+		RenderCmdUtil::PushSweptCapsuleOutline(gameRenderCommands, &group, bitmap, COLOR_TEAL, start, result.endPos, radius, halfHeight);
+		if (result.timeFraction < 1)
+		{
+			RenderCmdUtil::PushCapsuleOutline(gameRenderCommands, &group, bitmap, COLOR_RED, result.endPos, radius, halfHeight);
+			RenderCmdUtil::PushLine(gameRenderCommands, &group, bitmap, COLOR_BLUE, result.endPos, result.endPos + 20.0f * result.plane.normal, 0.5f);
+		}
+	}
+
+	UpdateWorldBSPDebugDraw(world);
+	PushBSPDebugDraw(gameRenderCommands, &group, bitmap, &world->bspDebugDraw, gameState->bspDebugDrawFilter);
 }
 
 
@@ -716,9 +548,40 @@ extern "C" __declspec(dllexport) void GameUpdateAndRender(GameMemory * gameMemor
 	{
 		// intialize memory arena
 		platformAPI = gameMemory->platformAPI;
+		platformWorkQueue = gameMemory->workQueue;
+		platformLowPriorityQueue = gameMemory->lowPriorityQueue;
+
+
+		// written by AssetBuilder -compile_bsp, initWorld compiles the level itself without it
+		PlatformMappedFile bspFile = {};
+		platformAPI.mapReadOnlyFile("./Assets/area_a.bsp", &bspFile);
+
+		PlatformMappedFile hullFiles[MAX_BSP_HULLS] = {};
+		int numHullFiles = 0;
+		while (numHullFiles < MAX_BSP_HULLS)
+		{
+			std::string filename = "./Assets/area_a.hull" + std::to_string(numHullFiles) + ".bsp";
+			if (!platformAPI.mapReadOnlyFile(filename.c_str(), &hullFiles[numHullFiles]))
+			{
+				break;
+			}
+			numHullFiles++;
+		}
 
+		initWorld(&gameState->world, &bspFile, hullFiles, numHullFiles);
 
-		initWorld(&gameState->world);
+		// full rebuilds after brush edits take longer than a frame, they go on the low
+		// priority queue so completeAllWork on the other one never waits for them
+		gameState->world.rebuildQueue = platformLowPriorityQueue;
+		gameState->world.addWorkQueueEntry = platformAPI.addWorkQueueEntry;
+
+		if (RECORD_TRACE_CORPUS)
+		{
+			gameState->world.traceRecording = new TraceCorpus();
+		}
+
+		SpawnEntityMovers(&gameState->world, gameState->movers, NUM_ENTITY_MOVERS, 1);
+		std::cout << "spawned " << gameState->movers.size() << " of " << NUM_ENTITY_MOVERS << " entity movers" << std::endl;
 
 		gameState->debugCameraEntity = {};
 		gameState->debugCameraEntity.pos = glm::vec3(0, 520, 520);
@@ -729,6 +592,7 @@ extern "C" __declspec(dllexport) void GameUpdateAndRender(GameMemory * gameMemor
 		gameState->debugCameraEntity.max = glm::vec3(10, 10, 10);
 
 		gameState->mouseIsDebugMode = false;
+		gameState->bspDebugDrawFilter = DefaultBSPDebugDrawFilter();
 
 
 		uint8* base = (uint8*)gameMemory->permenentStorage + sizeof(GameState);
@@ -766,6 +630,20 @@ extern "C" __declspec(dllexport) void GameUpdateAndRender(GameMemory * gameMemor
 	*/
 
 	WorldTickAndRender(gameState, transientState->assets, gameInputState, gameRenderCommands, windowDimensions, debugModeState);
+
+#ifdef TRACE_STATS
+	gameState->traceStats = EndTraceStatsFrame();
+#endif
+
+	TraceCorpus* traceRecording = gameState->world.traceRecording;
+	if (traceRecording && traceRecording->traces.size() >= TRACE_CORPUS_SIZE)
+	{
+		WriteTraceCorpus(TRACE_CORPUS_FILE, traceRecording);
+		cout << "wrote " << traceRecording->traces.size() << " traces to " << TRACE_CORPUS_FILE << endl;
+
+		delete traceRecording;
+		gameState->world.traceRecording = NULL;
+	}
 }
 
 
@@ -959,12 +837,52 @@ void RenderProfileBars(DebugState* debugState, GameRenderCommands* gameRenderCom
 	}
 }
 
+// a bar chart per counter, and the numbers next to them
+void RenderTraceStats(TraceStatsFrame* frame, GameRenderCommands* gameRenderCommands,
+	RenderGroup* renderGroup, GameAssets* gameAssets, glm::vec3 topLeft)
+{
+	BitmapId bitmapID = GetFirstBitmapIdFrom(gameAssets, AssetFamilyType::Default);
+	LoadedBitmap* defaultBitmap = GetBitmap(gameAssets, bitmapID);
+
+	const float BAR_WIDTH = 6;
+	const float CHART_HEIGHT = 30;
+	const float CHART_SPACING = 8;
+
+	for (int i = 0; i < NUM_TRACE_STATS; i++)
+	{
+		int maxBucket = 1;
+		for (int j = 0; j < NUM_TRACE_STAT_BUCKETS; j++)
+		{
+			maxBucket = std::max(maxBucket, frame->histograms[i][j]);
+		}
+
+		glm::vec3 chartMin = topLeft + glm::vec3(0, -(i + 1) * (CHART_HEIGHT + CHART_SPACING), 0);
+		RenderCmdUtil::PushBitmap(gameRenderCommands, renderGroup, defaultBitmap, glm::vec4(0, 0, 0.25, 0.25), chartMin,
+			glm::vec3(NUM_TRACE_STAT_BUCKETS * BAR_WIDTH / 2.0, CHART_HEIGHT / 2.0, 0), RenderCmdUtil::AlignmentMode::Left, RenderCmdUtil::AlignmentMode::Bottom);
+
+		for (int j = 0; j < NUM_TRACE_STAT_BUCKETS; j++)
+		{
+			float height = CHART_HEIGHT * frame->histograms[i][j] / maxBucket;
+			if (height > 0)
+			{
+				glm::vec3 barMin = chartMin + glm::vec3(j * BAR_WIDTH, 0, 0.1);
+				RenderCmdUtil::PushBitmap(gameRenderCommands, renderGroup, defaultBitmap, COLOR_YELLOW, barMin,
+					glm::vec3((BAR_WIDTH - 1) / 2.0, height / 2.0, 0), RenderCmdUtil::AlignmentMode::Left, RenderCmdUtil::AlignmentMode::Bottom);
+			}
+		}
+	}
+
+	static char buffer[1024];
+	FormatTraceStatsFrame(frame, buffer, sizeof(buffer));
+	DEBUGTextLine(buffer, gameRenderCommands, renderGroup, gameAssets, topLeft + glm::vec3(NUM_TRACE_STAT_BUCKETS * BAR_WIDTH + 10, 0, 0));
+}
+
+
 extern "C" __declspec(dllexport) void DebugSystemUpdateAndRender(GameMemory * gameMemory,
 	GameInputState * gameInputState,
 	GameRenderCommands * gameRenderCommands,
 	glm::ivec2 windowDimensions, DebugModeState* debugModeState)
 {
-	/*
 	DebugState* debugState = (DebugState*)gameMemory->debugStorage;
 	if (!debugState->isInitalized)
 	{
@@ -988,6 +906,7 @@ extern "C" __declspec(dllexport) void DebugSystemUpdateAndRender(GameMemory * ga
 
 	GameState* gameState = (GameState*)gameMemory->permenentStorage;
 	TransientState* transientState = (TransientState*)gameMemory->transientStorage;
+	DebugTable* globalDebugTable = gameMemory->debugTable;
 
 
 	float halfWidth = gameRenderCommands->settings.dims.x / 2.0f;
@@ -1023,10 +942,6 @@ extern "C" __declspec(dllexport) void DebugSystemUpdateAndRender(GameMemory * ga
 	uint64 newEventArrayIndex = !eventArrayIndex;
 	globalDebugTable->eventArrayIndex_EventIndex = (uint64)(newEventArrayIndex << 32);
 
-	uint32 eventArrayIndex2 = globalDebugTable->eventArrayIndex_EventIndex >> 32;
-	uint32 numEvents2 = globalDebugTable->eventArrayIndex_EventIndex & 0xFFFFFFFF;
-	// cout << "		after new eventArrayIndex " << eventArrayIndex2 << ", numEvents " << numEvents2 << endl;
-
 
 	// one debug event array is almost a frame worth of stuff
 
@@ -1039,8 +954,19 @@ extern "C" __declspec(dllexport) void DebugSystemUpdateAndRender(GameMemory * ga
 	// cout << "		before eventArrayIndex " << eventArrayIndex << ", numEvents " << numEvents << endl;
 	ProcessDebugEvents(debugState, globalDebugTable->events[eventArrayIndex], numEvents);
 
-	// Render Debug stuff
+	// the frame marker of the last frame was just processed, so this frame's trace stats go 
+	// into the frame it opened, and mostRecentFrame is the last complete one
+#ifdef TRACE_STATS
+	CollateTraceStats(debugState, &gameState->traceStats);
+	if (DEBUG_DRAW_TRACE_STATS && transientState->isInitalized && debugState->mostRecentFrame)
+	{
+		RenderTraceStats(&debugState->mostRecentFrame->traceStats, gameRenderCommands, &group, transientState->assets,
+			glm::vec3(-halfWidth + 10, halfheight - 10, 0.2));
+	}
+#endif
 
+	// Render Debug stuff
+	/*
 	RenderProfileBars(debugState, gameRenderCommands, &group, transientState->assets, gameInputState->mousePos);
 
 	glm::vec3 startPos = glm::vec3(-halfWidth, halfheight - 120, 0.2);
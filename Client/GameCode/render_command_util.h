@@ -542,6 +542,77 @@ namespace RenderCmdUtil {
 
 
 
+	// circle of lines around axis, a and b are two perpendicular unit vectors in its plane.
+	// from and to are the arc in turns, a full circle is 0 to 1
+	void PushArc(GameRenderCommands* gameRenderCommands, RenderGroup* group, LoadedBitmap* bitmap, glm::vec4 color,
+		glm::vec3 center, glm::vec3 a, glm::vec3 b, float radius, float from, float to, float thickness)
+	{
+		const int NUM_CIRCLE_SEGMENTS = 24;
+		int numSegments = std::max(1, (int)(NUM_CIRCLE_SEGMENTS * (to - from)));
+
+		glm::vec3 prev;
+		for (int i = 0; i <= numSegments; i++)
+		{
+			float angle = (from + (to - from) * i / numSegments) * 2 * glm::pi<float>();
+			glm::vec3 cur = center + radius * ((float)cos(angle) * a + (float)sin(angle) * b);
+			if (i > 0)
+			{
+				PushLine(gameRenderCommands, group, bitmap, color, prev, cur, thickness);
+			}
+			prev = cur;
+		}
+	}
+
+
+	// capsule standing along y like the round traces use, center +- halfHeight grown by radius
+	void PushCapsuleOutline(GameRenderCommands* gameRenderCommands, RenderGroup* group, LoadedBitmap* bitmap, glm::vec4 color,
+		glm::vec3 center, float radius, float halfHeight)
+	{
+		float thickness = 0.5f;
+		glm::vec3 x = glm::vec3(1, 0, 0);
+		glm::vec3 y = glm::vec3(0, 1, 0);
+		glm::vec3 z = glm::vec3(0, 0, 1);
+		glm::vec3 top = center + halfHeight * y;
+		glm::vec3 bottom = center - halfHeight * y;
+
+		PushArc(gameRenderCommands, group, bitmap, color, top, x, z, radius, 0, 1, thickness);
+		PushArc(gameRenderCommands, group, bitmap, color, bottom, x, z, radius, 0, 1, thickness);
+
+		// the caps, seen from the front and from the side
+		PushArc(gameRenderCommands, group, bitmap, color, top, x, y, radius, 0, 0.5f, thickness);
+		PushArc(gameRenderCommands, group, bitmap, color, bottom, x, y, radius, 0.5f, 1, thickness);
+		PushArc(gameRenderCommands, group, bitmap, color, top, z, y, radius, 0, 0.5f, thickness);
+		PushArc(gameRenderCommands, group, bitmap, color, bottom, z, y, radius, 0.5f, 1, thickness);
+
+		glm::vec3 sides[4] = { x, -x, z, -z };
+		for (int i = 0; i < 4 && halfHeight > 0; i++)
+		{
+			PushLine(gameRenderCommands, group, bitmap, color, bottom + radius * sides[i], top + radius * sides[i], thickness);
+		}
+	}
+
+
+	// the capsule at both ends and lines along the sides of the volume it sweeps through
+	void PushSweptCapsuleOutline(GameRenderCommands* gameRenderCommands, RenderGroup* group, LoadedBitmap* bitmap, glm::vec4 color,
+		glm::vec3 start, glm::vec3 end, float radius, float halfHeight)
+	{
+		PushCapsuleOutline(gameRenderCommands, group, bitmap, color, start, radius, halfHeight);
+		PushCapsuleOutline(gameRenderCommands, group, bitmap, color, end, radius, halfHeight);
+
+		glm::vec3 offsets[6] = 
+		{
+			glm::vec3(radius, 0, 0), glm::vec3(-radius, 0, 0), 
+			glm::vec3(0, 0, radius), glm::vec3(0, 0, -radius),
+			glm::vec3(0, halfHeight + radius, 0), glm::vec3(0, -halfHeight - radius, 0)
+		};
+		for (int i = 0; i < 6; i++)
+		{
+			PushLine(gameRenderCommands, group, bitmap, color, start + offsets[i], end + offsets[i], 0.5f);
+		}
+	}
+
+
+
 	// xyz coordinate system
 	void PushCoordinateSystem(GameRenderCommands* gameRenderCommands, RenderGroup* group, LoadedBitmap* bitmap, glm::vec3 origin, glm::vec3 dim)
 	{
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdio>
+
+/*
+	Trace cost counters, to see why a trace is slow. Every trace counts what it did in its
+	TraceSetupInfo, and when it is done the counts go into this thread's histograms for the
+	frame. The game takes the frame's histograms once a frame for the overlay.
+
+	Only debug builds count, in release the counters and the calls that bump them are
+	compiled out, so the trace code doesnt carry any of it.
+
+	The histogram buckets go up in powers of two
+
+		bucket	  0	  1	  2		3		4		...
+		count	  0	  1	  2-3	4-7		8-15	...
+*/
+
+#ifdef _DEBUG
+#define TRACE_STATS
+#endif
+
+enum TraceStatType
+{
+	TRACE_STAT_NODES,			// nodes the traversal went into
+	TRACE_STAT_LEAVES,			// leaves it reached
+	TRACE_STAT_BRUSHES,			// brushes tested against the trace
+	TRACE_STAT_PLANES,			// node planes and brush sides the trace was checked against
+	TRACE_STAT_EARLY_OUTS,		// subtrees and brushes skipped, by bounds, mailbox, a nearer hit or a separating plane
+	NUM_TRACE_STATS
+};
+
+const char* traceStatNames[NUM_TRACE_STATS] =
+{
+	"nodes",
+	"leaves",
+	"brushes",
+	"planes",
+	"early outs"
+};
+
+const int NUM_TRACE_STAT_BUCKETS = 16;
+
+// one trace
+struct TraceStats
+{
+	int counts[NUM_TRACE_STATS];
+};
+
+// all the traces of a frame on one thread
+struct TraceStatsFrame
+{
+	int numTraces;
+	long long totals[NUM_TRACE_STATS];
+	int maxs[NUM_TRACE_STATS];
+	int histograms[NUM_TRACE_STATS][NUM_TRACE_STAT_BUCKETS];
+};
+
+#ifdef TRACE_STATS
+#define TRACE_STAT(setupInfo, type) ((setupInfo)->stats.counts[type]++)
+#define TRACE_STAT_ADD(setupInfo, type, count) ((setupInfo)->stats.counts[type] += (count))
+#define END_TRACE_STATS(setupInfo) AddTraceStats(&threadTraceStats, &(setupInfo)->stats)
+#else
+#define TRACE_STAT(setupInfo, type)
+#define TRACE_STAT_ADD(setupInfo, type, count)
+#define END_TRACE_STATS(setupInfo)
+#endif
+
+// each thread fills its own, so tracing threads never write the same counters
+thread_local TraceStatsFrame threadTraceStats;
+
+
+int GetTraceStatBucket(int count)
+{
+	int bucket = 0;
+	while (count > 0 && bucket < NUM_TRACE_STAT_BUCKETS - 1)
+	{
+		count >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+
+void AddTraceStats(TraceStatsFrame* frame, TraceStats* stats)
+{
+	frame->numTraces++;
+	for (int i = 0; i < NUM_TRACE_STATS; i++)
+	{
+		int count = stats->counts[i];
+		frame->totals[i] += count;
+		frame->maxs[i] = std::max(frame->maxs[i], count);
+		frame->histograms[i][GetTraceStatBucket(count)]++;
+	}
+}
+
+
+void MergeTraceStatsFrame(TraceStatsFrame* frame, TraceStatsFrame* other)
+{
+	frame->numTraces += other->numTraces;
+	for (int i = 0; i < NUM_TRACE_STATS; i++)
+	{
+		frame->totals[i] += other->totals[i];
+		frame->maxs[i] = std::max(frame->maxs[i], other->maxs[i]);
+		for (int j = 0; j < NUM_TRACE_STAT_BUCKETS; j++)
+		{
+			frame->histograms[i][j] += other->histograms[i][j];
+		}
+	}
+}
+
+
+// hands back what this thread counted since the last call and starts over
+TraceStatsFrame EndTraceStatsFrame()
+{
+	TraceStatsFrame frame = threadTraceStats;
+	threadTraceStats = {};
+	return frame;
+}
+
+
+// one line per counter, average and max per trace and the histogram. Returns the length like snprintf
+int FormatTraceStatsFrame(TraceStatsFrame* frame, char* buffer, int size)
+{
+	int length = snprintf(buffer, size, "%d traces\n", frame->numTraces);
+	for (int i = 0; i < NUM_TRACE_STATS && length < size; i++)
+	{
+		float average = frame->numTraces > 0 ? frame->totals[i] / (float)frame->numTraces : 0;
+		length += snprintf(buffer + length, size - length, "%-10s avg %6.1f max %5d |", traceStatNames[i], average, frame->maxs[i]);
+
+		// leave out the empty buckets at the top
+		int numBuckets = NUM_TRACE_STAT_BUCKETS;
+		while (numBuckets > 1 && frame->histograms[i][numBuckets - 1] == 0)
+		{
+			numBuckets--;
+		}
+		for (int j = 0; j < numBuckets && length < size; j++)
+		{
+			length += snprintf(buffer + length, size - length, " %d", frame->histograms[i][j]);
+		}
+		if (length < size)
+		{
+			length += snprintf(buffer + length, size - length, "\n");
+		}
+	}
+	return length;
+}
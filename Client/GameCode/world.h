@@ -1,6 +1,8 @@
 #pragma once
 
 #include <assert.h> 
+#include <random>
+#include <emmintrin.h>
 
 #include "../PlatformShared/platform_shared.h"
 #include "../staggered_concentric_pattern/memory.h"
@@ -8,6 +10,12 @@
 #include "math.h"
 #include "pattern.h"
 #include "bsp_tree.h"
+#include "bsp_report.h"
+#include "bsp_file.h"
+#include "aabb_tree.h"
+#include "bsp_hull.h"
+#include "bsp_debug_draw.h"
+#include "trace_stats.h"
 
 #define	DIST_EPSILON	(0.03125)
 
@@ -27,6 +35,17 @@ enum EntityFlag
 	PLAYER
 };
 
+// the brushes around an entity its last full trace found, see WorldBoxTraceCached
+struct TraceCache
+{
+	// where the brushes came from, nothing is cached while these dont match the world
+	BSPCollisionModel* model;
+	int collisionVersion;
+
+	BoundingBox region;
+	std::vector<int> brushes;
+};
+
 struct Entity
 {
 	EntityFlag flag;
@@ -69,6 +88,12 @@ struct Entity
 	// For Rendering
 	// TODO: change this model index
 	std::vector<Face> model;
+
+	// leaves of the world tree the model touches, for PVS culling
+	std::vector<int> leaves;
+
+	// for CatagorizePosition, which traces from about the same spot every frame
+	TraceCache groundTraceCache;
 };
 
 struct PlayerEntity
@@ -82,11 +107,75 @@ struct PlayerEntity
 };
 
 
+enum CollisionBackend
+{
+	COLLISION_BACKEND_BSP,
+	COLLISION_BACKEND_AABB_TREE,
+	COLLISION_BACKEND_BSP_HULLS,	// point traces through World::hulls for boxes that have one, otherwise bsp
+	NUM_COLLISION_BACKENDS
+};
+
+const char* collisionBackendNames[NUM_COLLISION_BACKENDS] = { "bsp", "aabb_tree", "bsp_hulls" };
+
+
+const glm::vec3 PLAYER_MINS = glm::vec3(-10, -10, -10);
+const glm::vec3 PLAYER_MAXS = glm::vec3(10, 10, 10);
+
+// box sizes that get a clip hull compiled, see bsp_hull.h
+const BSPHullSize standardHullSizes[] = { { PLAYER_MINS, PLAYER_MAXS } };
+const int NUM_STANDARD_HULLS = sizeof(standardHullSizes) / sizeof(standardHullSizes[0]);
+
+
+struct WorldRebuildJob;
+
 struct World
 {
 	MemoryArena memoryArena;
 
-	BSPNode* tree;
+	// compiler output, empty when the level was loaded precompiled
+	FlatBSPTree tree;
+
+	// what traces and PVS lookups run on, a view of either tree or the mapped bsp file
+	BSPCollisionModel collisionModel;
+
+	// overlay of tree, baked whenever tree is flattened. Edits only mark it stale,
+	// it is baked again when it is drawn, see UpdateWorldBSPDebugDraw
+	BSPDebugDraw bspDebugDraw;
+	bool bspDebugDrawStale;
+
+	// clip hulls for box sizes traced all the time. Edits patch them along with tree
+	BSPHull hulls[MAX_BSP_HULLS];
+	int numHulls;
+
+	// which structure BoxTrace goes through, see WorldBoxTrace
+	CollisionBackend collisionBackend;
+
+	// goes up whenever collisionModel or the hulls are rebuilt, brush indices from before are stale
+	int collisionVersion;
+
+	// when set, every WorldBoxTrace gets appended to it, for SPLIT_COST_PROFILE
+	TraceCorpus* traceRecording;
+
+	// dynamic AABB tree over brushes, the other collision backend. 
+	// brushProxies is the proxy of each brush, indexed by Brush::brushIndex.
+	// collisionBrushes maps a Brush::brushIndex to its brush in collisionModel, -1 if it has none
+	AABBTree brushTree;
+	std::vector<int> brushProxies;
+	std::vector<int> collisionBrushes;
+
+	// the compiler side tree and brushes, kept so single brushes can be edited without 
+	// a full rebuild. brushes is indexed by Brush::brushIndex, removed brushes have no polygons
+	BSPNode* bspRoot;
+	std::vector<Brush> brushes;
+	BSPEditState bspEditState;
+
+	// full rebuilds run on rebuildQueue and get swapped in when done, see UpdateWorldRebuild.
+	// Without a queue they run right away. rebuildEditedBrushes are the brushes edited since
+	// the running one took its copy of brushes
+	PlatformWorkQueue* rebuildQueue;
+	PlatformAddWorkQueueEntry addWorkQueueEntry;
+	WorldRebuildJob* rebuildJob;
+	std::vector<int> rebuildEditedBrushes;
 
 	Entity entities[1024];
 	int numEntities;
@@ -111,8 +200,8 @@ void initPlayerEntity(Entity* entity, glm::vec3 pos)
 {
 	entity->pos = pos;
 	entity->flag = EntityFlag::PLAYER;
-	entity->min = glm::vec3(-10, -10, -10);
-	entity->max = glm::vec3(10, 10, 10);
+	entity->min = PLAYER_MINS;
+	entity->max = PLAYER_MAXS;
 
 	entity->xAxis = glm::vec3(1.0, 0.0, 0.0);
 	entity->yAxis = glm::vec3(0.0, 1.0, 0.0);
@@ -372,6 +461,25 @@ std::vector<Face> CreateCubeFaceCentered(glm::vec3 pos, glm::vec3 dim)
 }
 
 
+// the centered cube turned around y, so none of its walls are axial
+std::vector<Face> CreateCubeFaceRotated(glm::vec3 pos, glm::vec3 dim, float degrees)
+{
+	std::vector<Face> result = CreateCubeFaceCentered(glm::vec3(0), dim);
+
+	float cosAngle = cos(degrees * Math::DEGREE_TO_RADIAN);
+	float sinAngle = sin(degrees * Math::DEGREE_TO_RADIAN);
+	for (int i = 0; i < result.size(); i++)
+	{
+		for (int j = 0; j < result[i].vertices.size(); j++)
+		{
+			glm::vec3 v = result[i].vertices[j];
+			result[i].vertices[j] = pos + glm::vec3(cosAngle * v.x + sinAngle * v.z, v.y, -sinAngle * v.x + cosAngle * v.z);
+		}
+	}
+	return result;
+}
+
+
 void AddPolygonToBrush(Brush* brush, std::vector<glm::vec3> verticesIn)
 {
 	const int arraySize = verticesIn.size();
@@ -422,10 +530,123 @@ Brush ConvertFaceToBrush(std::vector<Face> faces)
 		AddPolygonToBrush(&brush, faces[i].vertices);
 	}
 	std::cout << std::endl;
+
+	SnapBrush(brush);
 	return brush;
 }
 
 
+// remembers which entity renders the brush, so the CSG pass can write the visible faces back
+void AddEntityBrush(World* world, std::vector<Brush>& brushes, Entity* entity, std::vector<Face> faces)
+{
+	Brush brush = ConvertFaceToBrush(faces);
+	brush.entityIndex = entity - world->entities;
+	brushes.push_back(brush);
+}
+
+
+// replaces the models of brush entities with only the faces that survived CSG
+void ApplyVisibleFacesToEntities(World* world, std::vector<Brush>& brushes, std::vector<std::vector<BspPolygon>>& visibleFaces)
+{
+	for (int i = 0; i < brushes.size(); i++)
+	{
+		if (brushes[i].entityIndex == -1)
+		{
+			continue;
+		}
+
+		Entity* entity = &world->entities[brushes[i].entityIndex];
+		entity->model.clear();
+
+		for (int j = 0; j < visibleFaces[i].size(); j++)
+		{
+			Face face = { visibleFaces[i][j].vertices };
+			entity->model.push_back(face);
+		}
+	}
+}
+
+
+
+void LinkStaticEntityToLeaves(World* world, Entity* entity)
+{
+	BoundingBox bb = EmptyBoundingBox();
+	for (int i = 0; i < entity->model.size(); i++)
+	{
+		for (int j = 0; j < entity->model[i].vertices.size(); j++)
+		{
+			AddPointToBoundingBox(bb, entity->model[i].vertices[j]);
+		}
+	}
+
+	entity->leaves.clear();
+	if (!IsBoundingBoxEmpty(bb))
+	{
+		entity->leaves = BoxLeafs(&world->collisionModel, bb);
+	}
+}
+
+
+// called after the tree is built, static entities dont move so their leaves are fixed
+void LinkStaticEntitiesToLeaves(World* world)
+{
+	for (int i = 0; i < world->numEntities; i++)
+	{
+		if (world->entities[i].flag == EntityFlag::STATIC)
+		{
+			LinkStaticEntityToLeaves(world, &world->entities[i]);
+		}
+	}
+}
+
+
+// after a patch, only entities in leaves it changed and the entity of the edited brush move.
+// New leaves are inside changed ones, so anything that overlaps one was in a changed leaf
+void RelinkStaticEntitiesToLeaves(World* world, FlatBSPPatch* patch, int entityIndex)
+{
+	std::vector<int> changedLeaves = patch->changedLeaves;
+	std::sort(changedLeaves.begin(), changedLeaves.end());
+
+	for (int i = 0; i < world->numEntities; i++)
+	{
+		Entity* entity = &world->entities[i];
+		if (entity->flag != EntityFlag::STATIC)
+		{
+			continue;
+		}
+
+		bool relink = i == entityIndex;
+		for (int j = 0; j < entity->leaves.size() && !relink; j++)
+		{
+			relink = std::binary_search(changedLeaves.begin(), changedLeaves.end(), entity->leaves[j]);
+		}
+
+		if (relink)
+		{
+			LinkStaticEntityToLeaves(world, entity);
+		}
+	}
+}
+
+
+bool IsEntityPotentiallyVisible(World* world, int cameraLeaf, Entity* entity)
+{
+	// no vis data for where the camera is, or nothing to cull by
+	if (!HasPVS(&world->collisionModel, cameraLeaf) || entity->leaves.size() == 0)
+	{
+		return true;
+	}
+
+	for (int i = 0; i < entity->leaves.size(); i++)
+	{
+		if (IsLeafPotentiallyVisible(&world->collisionModel, cameraLeaf, entity->leaves[i]))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 
 std::vector<Face> PatternToFaces(Pattern* pattern)
 {
@@ -475,7 +696,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, 0, 0);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 	
 	
@@ -485,7 +706,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, 100, 25);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 	
 
@@ -496,7 +717,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(-200, 100, 0);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -507,7 +728,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(201, 100, 0);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -519,7 +740,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(-100, 100, -200);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 	
 
@@ -532,7 +753,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, 0, -200);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 		
 
@@ -543,7 +764,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(0, 0, -200);
 
 	faces = CreateRampMinMax(min, max, POS_Z);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 	
@@ -554,7 +775,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(1, 0, -200);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -566,7 +787,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, 0, -400);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -578,7 +799,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, -50, -400);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -593,7 +814,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(-100, 100, -200);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -607,7 +828,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(201, 100, -200);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -620,7 +841,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(0, 100, -600);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -630,7 +851,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, 100, -600);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 	
@@ -640,7 +861,7 @@ void CreateAreaA(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(100, 100, -600);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 	*/
 
@@ -683,7 +904,7 @@ void CreateAreaB(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, 25, 200);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 	// bottom wall
@@ -694,7 +915,7 @@ void CreateAreaB(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, 100, -175);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -707,7 +928,7 @@ void CreateAreaB(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(-175, 100, 200);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -721,7 +942,7 @@ void CreateAreaB(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, 100, 200);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -736,7 +957,7 @@ void CreateAreaB(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(200, 100, 200);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 
 
@@ -750,7 +971,28 @@ void CreateAreaB(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(50, 50, 50);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
+	initEntity(entity, pos, faces);
+
+
+	// ramp up to the right wall, a sloped face for the round traces to slide on
+	entity = &world->entities[world->numEntities++];
+	pos = glm::vec3(0, 0, 0);
+
+	min = glm::vec3(75, 25, -150);
+	max = glm::vec3(175, 75, -75);
+
+	faces = CreateRampMinMax(min, max, POS_X);
+	AddEntityBrush(world, brushes, entity, faces);
+	initEntity(entity, pos, faces);
+
+
+	// crate turned on the floor, its walls and edges arent axial
+	entity = &world->entities[world->numEntities++];
+	pos = glm::vec3(0, 0, 0);
+
+	faces = CreateCubeFaceRotated(glm::vec3(-100, 45, 100), glm::vec3(20, 20, 20), 30);
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 }
 
@@ -781,7 +1023,7 @@ void CreateAreaC(World* world, std::vector<Brush>& brushes)
 	max = glm::vec3(50, 50, 50);
 
 	faces = CreateCubeFaceMinMax(min, max);
-	brushes.push_back(ConvertFaceToBrush(faces));
+	AddEntityBrush(world, brushes, entity, faces);
 	initEntity(entity, pos, faces);
 }
 
@@ -807,12 +1049,29 @@ struct TraceSetupInfo
 	glm::vec3 maxs;
 	glm::vec3 traceExtends;
 	bool isTraceBoxAPoint;	// does min == max;
+
+	// capsule standing along y instead of a box, mins and maxs are its bounds. 0 halfHeight for a sphere
+	bool isRound;
+	float radius;
+	float halfHeight;
+
+	// the box swept from start to end, grown by DIST_EPSILON. Brushes outside it cant be hit
+	BoundingBox sweptBounds;
+
+	// this trace's row of the brush mailbox and its stamp, see BeginTraceMailbox
+	unsigned int* brushStamps;
+	unsigned int mailboxStamp;
+
+#ifdef TRACE_STATS
+	TraceStats stats;
+#endif
 };
 
 
-void CheckBrush(Brush* brush, glm::vec3 start, glm::vec3 end, TraceResult* result, TraceSetupInfo* setupInfo)
+// sides are the planes of a convex brush, normals pointing out
+void CheckBrush(Plane* sides, int numSides, glm::vec3 start, glm::vec3 end, TraceResult* result, TraceSetupInfo* setupInfo)
 {
-	if (brush->polygons.size() == 0)
+	if (numSides == 0)
 	{
 		return;
 	}
@@ -825,10 +1084,10 @@ void CheckBrush(Brush* brush, glm::vec3 start, glm::vec3 end, TraceResult* resul
 
 	glm::vec3 offsets;
 //	std::cout << ">>>>>>> CheckBrush" << std::endl;
-	for (int i = 0; i < brush->polygons.size(); i++)
+	for (int i = 0; i < numSides; i++)
 	{
-		BspPolygon polygon = brush->polygons[i];
-		Plane plane = polygon.plane;
+		Plane& plane = sides[i];
+		TRACE_STAT(setupInfo, TRACE_STAT_PLANES);
 
 		float startToPlaneDist = 0;
 		float endToPlaneDist = 0;
@@ -886,6 +1145,7 @@ void CheckBrush(Brush* brush, glm::vec3 start, glm::vec3 end, TraceResult* resul
 		// makesure the trace isn't completely 
 		if (startToPlaneDist > 0 && endToPlaneDist > 0)
 		{
+			TRACE_STAT(setupInfo, TRACE_STAT_EARLY_OUTS);
 			return;
 		}
 
@@ -973,252 +1233,2419 @@ void CheckBrush(Brush* brush, glm::vec3 start, glm::vec3 end, TraceResult* resul
 
 }
 
-void TraceToLeafNode(BSPNode* node, glm::vec3 start, glm::vec3 end, TraceResult* result, TraceSetupInfo* setupInfo)
+const int MAX_BRUSH_SIDES = 64;
+
+void CheckBrush(Brush* brush, glm::vec3 start, glm::vec3 end, TraceResult* result, TraceSetupInfo* setupInfo)
 {
-	if (node->brushes.size() == 0)
-	{
-		return;
-	}
+	assert(brush->polygons.size() <= MAX_BRUSH_SIDES);
 
-	if (node->IsLeafNode())
+	Plane sides[MAX_BRUSH_SIDES];
+	for (int i = 0; i < brush->polygons.size(); i++)
 	{
-		for (int i = 0; i < node->brushes.size(); i++)
-		{
-			CheckBrush(&node->brushes[i], start, end, result, setupInfo);
-		
-			if (result->timeFraction == 0)
-				return;
-		}
+		sides[i] = brush->polygons[i].plane;
 	}
+	CheckBrush(sides, brush->polygons.size(), start, end, result, setupInfo);
 }
 
 
+// a in the lanes where mask is set, b everywhere else
+inline __m128 SelectLanes(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
 
 
-
-void RecursiveHullCheck(BSPNode* node, float startFraction, float endFraction,
-	glm::vec3 start, glm::vec3 end,
-	glm::vec3 traceStart, glm::vec3 traceEnd,
-	TraceResult* result, TraceSetupInfo* setupInfo, bool print = false)
+// How far in front of each plane of the block the corner of the box at point nearest to it is.
+// Same float operations in the same order as the scalar CheckBrush
+inline __m128 GetBrushSideBlockDistances(BrushSideBlock* block, __m128 point[3], __m128 mins[3], __m128 maxs[3])
 {
+	__m128 zero = _mm_setzero_ps();
+	__m128 normals[3] = { _mm_loadu_ps(block->normalX), _mm_loadu_ps(block->normalY), _mm_loadu_ps(block->normalZ) };
 
-
-	if (print)
+	__m128 distance;
+	for (int i = 0; i < 3; i++)
 	{
-		std::cout << "visiting node " << node->id << std::endl;
+		__m128 offset = SelectLanes(_mm_cmplt_ps(normals[i], zero), maxs[i], mins[i]);
+		__m128 term = _mm_mul_ps(_mm_add_ps(point[i], offset), normals[i]);
+		distance = i == 0 ? term : _mm_add_ps(distance, term);
 	}
+	return _mm_sub_ps(distance, _mm_loadu_ps(block->distance));
+}
 
-	// already hit something nearer
-	if (result->timeFraction <= startFraction)
+
+// Same as CheckBrush on sides, with BRUSH_SIDE_BLOCK_SIZE sides tested at a time from the 
+// brush's side blocks, the hit plane is looked up through its side indices.
+// Every float operation happens in the same order as in the scalar version and the
+// epsilon math is done in double like there, so the results are exactly the same
+void CheckBrush(BSPCollisionModel* model, FlatBSPBrush* brush, glm::vec3 start, glm::vec3 end, TraceResult* result, TraceSetupInfo* setupInfo)
+{
+	int numSides = brush->numSides;
+	if (numSides == 0)
 	{
 		return;
 	}
 
-//	std::cout << "visiting node " << node->id << std::endl;
-//	std::cout << "startFraction " << startFraction << ", endFraction " << endFraction << std::endl;
+	BrushSideBlock* blocks = &model->brushSideBlocks[brush->firstSideBlock];
 
-	if (node->IsLeafNode())
+	__m128 starts[3], ends[3], mins[3], maxs[3];
+	for (int i = 0; i < 3; i++)
 	{
-		TraceToLeafNode(node, traceStart, traceEnd, result, setupInfo);
-		return;
+		starts[i] = _mm_set1_ps(start[i]);
+		ends[i] = _mm_set1_ps(end[i]);
+		mins[i] = _mm_set1_ps(setupInfo->mins[i]);
+		maxs[i] = _mm_set1_ps(setupInfo->maxs[i]);
 	}
 
-	Plane plane = node->splitPlane;
-//	std::cout << "		plane " << plane.normal << std::endl;
+	__m128 zero = _mm_setzero_ps();
+	__m128 startsOutAny = zero;
+	__m128 endsOutAny = zero;
 
-	float startDist, endDist, offset;
-	if (IsAxialPlane(plane))
-	{
-		// optimize this
-		startDist = glm::dot(start, plane.normal) - plane.distance;
-		endDist = glm::dot(end, plane.normal) - plane.distance;
-		offset = fabs(setupInfo->traceExtends[0] * plane.normal[0]) +
-			fabs(setupInfo->traceExtends[1] * plane.normal[1]) +
-			fabs(setupInfo->traceExtends[2] * plane.normal[2]);
-	}
-	else
+	// per lane, the latest enter and the side it came from, and the earliest leave.
+	// Only the earliest side in a lane replaces the enter, so ties go to the first side like in the scalar loop
+	__m128 laneStartFractions = _mm_set1_ps(-1);
+	__m128i laneClipSides = _mm_set1_epi32(-1);
+	__m128 laneEndFractions = _mm_set1_ps(1);
+	__m128i blockSides = _mm_set_epi32(3, 2, 1, 0);
+
+	int numBlocks = GetNumBrushSideBlocks(numSides);
+	for (int b = 0; b < numBlocks; b++)
 	{
-		// optimize this
-		startDist = glm::dot(start, plane.normal) - plane.distance;
-		endDist = glm::dot(end, plane.normal) - plane.distance;
-		offset = glm::dot(plane.normal, setupInfo->traceExtends);
-		
-		if (setupInfo->isTraceBoxAPoint)
-		{
-			offset = 0;
-		}
-		else
+		BrushSideBlock* block = &blocks[b];
+		TRACE_STAT_ADD(setupInfo, TRACE_STAT_PLANES, std::min(BRUSH_SIDE_BLOCK_SIZE, numSides - b * BRUSH_SIDE_BLOCK_SIZE));
+
+		__m128 startToPlaneDist = GetBrushSideBlockDistances(block, starts, mins, maxs);
+		__m128 endToPlaneDist = GetBrushSideBlockDistances(block, ends, mins, maxs);
+
+		__m128 startsOut = _mm_cmpgt_ps(startToPlaneDist, zero);
+		__m128 endsOut = _mm_cmpgt_ps(endToPlaneDist, zero);
+
+		// completely in front of one of the planes
+		if (_mm_movemask_ps(_mm_and_ps(startsOut, endsOut)))
 		{
-			// similar to 5.2.3 Testing Box Against Plane
-			offset = fabs(setupInfo->traceExtends[0] * plane.normal[0]) +
-				fabs(setupInfo->traceExtends[1] * plane.normal[1]) +
-				fabs(setupInfo->traceExtends[2] * plane.normal[2]);
+			TRACE_STAT(setupInfo, TRACE_STAT_EARLY_OUTS);
+			return;
 		}
+		startsOutAny = _mm_or_ps(startsOutAny, startsOut);
+		endsOutAny = _mm_or_ps(endsOutAny, endsOut);
+
+		// the planes the line crosses, the others are behind and get clipped by another one
+		__m128 crosses = _mm_or_ps(startsOut, endsOut);
+		__m128 entering = _mm_and_ps(crosses, _mm_cmpgt_ps(startToPlaneDist, endToPlaneDist));
+		__m128 leaving = _mm_andnot_ps(entering, crosses);
+
+		// (startToPlaneDist - DIST_EPSILON) / (startToPlaneDist - endToPlaneDist) for the planes the 
+		// line enters, + DIST_EPSILON for the ones it leaves
+		__m128 signedEpsilon = SelectLanes(entering, _mm_set1_ps(-DIST_EPSILON), _mm_set1_ps(DIST_EPSILON));
+		__m128 denominator = _mm_sub_ps(startToPlaneDist, endToPlaneDist);
+		__m128d low = _mm_div_pd(_mm_add_pd(_mm_cvtps_pd(startToPlaneDist), _mm_cvtps_pd(signedEpsilon)), 
+			_mm_cvtps_pd(denominator));
+		__m128d high = _mm_div_pd(_mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(startToPlaneDist, startToPlaneDist)), 
+			_mm_cvtps_pd(_mm_movehl_ps(signedEpsilon, signedEpsilon))), _mm_cvtps_pd(_mm_movehl_ps(denominator, denominator)));
+		__m128 fractions = _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+
+		__m128 later = _mm_and_ps(entering, _mm_cmpgt_ps(fractions, laneStartFractions));
+		laneStartFractions = SelectLanes(later, fractions, laneStartFractions);
+		laneClipSides = _mm_castps_si128(SelectLanes(later, _mm_castsi128_ps(blockSides), _mm_castsi128_ps(laneClipSides)));
+
+		__m128 earlier = _mm_and_ps(leaving, _mm_cmplt_ps(fractions, laneEndFractions));
+		laneEndFractions = SelectLanes(earlier, fractions, laneEndFractions);
+
+		blockSides = _mm_add_epi32(blockSides, _mm_set1_epi32(BRUSH_SIDE_BLOCK_SIZE));
 	}
 
-	if (print && node->id == 7)
+	if (_mm_movemask_ps(startsOutAny) == 0)
 	{
-		std::cout << "visiting node " << node->id << std::endl;
+		result->outputStartsOut = false;
+		if (_mm_movemask_ps(endsOutAny) == 0)
+		{
+			result->outputAllSolid = true;
+		}
+		return;
 	}
 
-	if (startDist >= offset && endDist >= offset)
+	float startFractions[BRUSH_SIDE_BLOCK_SIZE], endFractions[BRUSH_SIDE_BLOCK_SIZE];
+	int clipSides[BRUSH_SIDE_BLOCK_SIZE];
+	_mm_storeu_ps(startFractions, laneStartFractions);
+	_mm_storeu_ps(endFractions, laneEndFractions);
+	_mm_storeu_si128((__m128i*)clipSides, laneClipSides);
+
+	float startFraction = -1;
+	float endFraction = 1;
+	int clipSide = -1;
+	for (int i = 0; i < BRUSH_SIDE_BLOCK_SIZE; i++)
 	{
-		RecursiveHullCheck(node->children[0], startFraction, endFraction, start, end, 
-			traceStart, traceEnd, result, setupInfo, print);
-		return;
+		if (clipSides[i] != -1 && (startFractions[i] > startFraction || (startFractions[i] == startFraction && clipSides[i] < clipSide)))
+		{
+			startFraction = startFractions[i];
+			clipSide = clipSides[i];
+		}
+		if (endFractions[i] < endFraction)
+		{
+			endFraction = endFractions[i];
+		}
 	}
-	if (startDist < -offset && endDist < -offset)
+
+	if (startFraction < endFraction)
 	{
-		RecursiveHullCheck(node->children[1], startFraction, endFraction, start, end, 
-			traceStart, traceEnd, result, setupInfo, print);
-		return;
+		if (startFraction > -1 && startFraction < result->timeFraction)
+		{
+			if (startFraction < 0)
+				startFraction = 0;
+			result->timeFraction = startFraction;
+			result->plane = model->planes[model->brushSides[brush->firstSide + clipSide]];
+		}
 	}
-
-	// the side that the start is on. 
-	int side;
-	float fraction1, fraction2, middleFraction;
-	glm::vec3 middlePoint;
-	// 1/32 epsilon to keep floating point happy
+}
 
 
-	/*
-	the case where endDist > startDist
+/*
+	Round traces, a capsule standing along y swept from start to end. A sphere is a capsule
+	with no halfHeight.
 
-				      plane
-						
-			front side	|  back side
-						|
-				end		|    start
-			<-----------|
-						|
-						|
+	The capsule touches a brush when its center is in the brush grown by the capsule. Growing
+	by a box just pushes the planes out, growing by a capsule also rounds off the edges and
+	corners, which is why a round trace slides past a corner a box would catch on.
 
+			 _______					 ___________
+			|		|	 + capsule		/  _______  \
+			| brush |	  ---->		   |  |		  |  |
+			|_______|				   |  |_______|  |
+										\___________/
 
-	the case where startDist > endDist
+	A capsule is a sphere swept along its axis, so the grown brush is the brush stretched
+	along y by halfHeight, then grown by radius. What the trace can run into is
+		- the faces of the brush, pushed out by radius and moved halfHeight up or down
+		- each edge halfHeight above and below, as cylinders, and the band between those two
+		- each corner, as a capsule of its own
+	and it enters the grown brush where it first enters any of them.
+*/
 
-					  plane
+// which part of the grown brush stopped a round trace
+struct RoundTraceHit
+{
+	float fraction;
+	glm::vec3 normal;
+	int side;		// the brush side for a face, -1 for an edge or a corner
+};
 
-			front side	|  back side
-						|
-				start	|    end
-			<-----------|
-						|
-						|
 
-	*/
-	if (startDist < endDist)
-	{
-		side = 1;	// start is on the back of the plane
-		float inverseDistance = 1.0f / (startDist - endDist);
-		fraction1 = (startDist - offset + DIST_EPSILON) * inverseDistance;
-		fraction2 = (startDist + offset + DIST_EPSILON) * inverseDistance;
-	}
-	else if (startDist > endDist)
+// Whether point + s * (0, 1, 0) is on the brush for some s in [minS, maxS]. With a side, 
+// only the other sides are checked, so it says if the point is over the face of that side
+bool IsOverBrush(BSPCollisionModel* model, FlatBSPBrush* brush, int side, glm::vec3 point, float minS, float maxS)
+{
+	for (int i = 0; i < brush->numSides; i++)
 	{
-		side = 0;	// start is on the front side of the plane
-		float inverseDistance = 1.0f / (startDist - endDist);
-		fraction1 = (startDist + offset + DIST_EPSILON) * inverseDistance;
-		fraction2 = (startDist - offset - DIST_EPSILON) * inverseDistance;
+		if (i == side)
+		{
+			continue;
+		}
 
-	//	std::cout << "fraction1 " << fraction1 << std::endl;
-	//	std::cout << "fraction2 " << fraction2 << std::endl;
-	}
-	else
-	{
-		side = 0;
-		fraction1 = 1.0f;
-		fraction2 = 0.0f;
-	}
+		// point + s * up is behind the plane while dist + s * normal.y <= 0
+		Plane* plane = &model->planes[model->brushSides[brush->firstSide + i]];
+		float dist = glm::dot(plane->normal, point) - plane->distance;
+		if (plane->normal.y > 0)
+		{
+			maxS = std::min(maxS, -dist / plane->normal.y);
+		}
+		else if (plane->normal.y < 0)
+		{
+			minS = std::max(minS, -dist / plane->normal.y);
+		}
+		else if (dist > 0)
+		{
+			return false;
+		}
 
-	// examine [start  middle]
-	if (fraction1 < 0) { fraction1 = 0;	}
-	else if (fraction1 > 1) { fraction1 = 1; }
+		if (minS > maxS)
+		{
+			return false;
+		}
+	}
+	return true;
+}
 
-	middleFraction = startFraction + (endFraction - startFraction) * fraction1;
-	middlePoint = start + fraction1 * (end - start);
 
-	RecursiveHullCheck(node->children[side], startFraction, middleFraction, 
-												start, middlePoint, traceStart, traceEnd, 
-												result, setupInfo, print);
+// the face of a side on the stretched brush is moved up for sides facing up, down for the 
+// ones facing down, and stretched for the ones standing straight
+inline void GetStretchedFaceRange(Plane* plane, float halfHeight, float* minS, float* maxS)
+{
+	*minS = plane->normal.y < 0 ? halfHeight : -halfHeight;
+	*maxS = plane->normal.y > 0 ? -halfHeight : halfHeight;
+}
 
-	// examine [middle	end]
-	if (fraction2 < 0) { fraction2 = 0; }
-	else if (fraction2 > 1) { fraction2 = 1; }
 
-	middleFraction = startFraction + (endFraction - startFraction) * fraction2;
-	middlePoint = start + fraction2 * (end - start);
+// position of point on the band an edge sweeps from halfHeight below to halfHeight above it,
+// as edge and height. False for a vertical edge, which doesnt sweep a band
+inline bool GetEdgeBandPosition(glm::vec3 a, glm::vec3 b, glm::vec3 point, float* u, float* w)
+{
+	glm::vec3 edge = b - a;
+	float determinant = glm::dot(edge, edge) - edge.y * edge.y;
+	if (determinant < NORMAL_SNAP_EPSILON)
+	{
+		return false;
+	}
 
-	RecursiveHullCheck(node->children[!side], middleFraction, endFraction, 
-												middlePoint, end, traceStart, 
-												traceEnd, result, setupInfo, print);
+	glm::vec3 toPoint = point - a;
+	float alongEdge = glm::dot(toPoint, edge);
+	*u = (alongEdge - edge.y * toPoint.y) / determinant;
+	*w = (glm::dot(edge, edge) * toPoint.y - edge.y * alongEdge) / determinant;
+	return true;
 }
 
 
+inline glm::vec3 ClosestPointOnSegment(glm::vec3 point, glm::vec3 a, glm::vec3 b)
+{
+	glm::vec3 ab = b - a;
+	float lengthSquared = glm::dot(ab, ab);
+	if (lengthSquared == 0)
+	{
+		return a;
+	}
+	float t = glm::clamp(glm::dot(point - a, ab) / lengthSquared, 0.0f, 1.0f);
+	return a + t * ab;
+}
+
+
+// distance from point to the brush stretched along y by halfHeight, 0 inside it
+float GetStretchedBrushDistance(BSPCollisionModel* model, FlatBSPBrush* brush, glm::vec3 point, float halfHeight)
+{
+	if (IsOverBrush(model, brush, -1, point, -halfHeight, halfHeight))
+	{
+		return 0;
+	}
+
+	glm::vec3 up = glm::vec3(0, 1, 0);
+	float distance = FLT_MAX;
+	for (int i = 0; i < brush->numSides; i++)
+	{
+		Plane* plane = &model->planes[model->brushSides[brush->firstSide + i]];
+		float dist = glm::dot(plane->normal, point) - plane->distance - halfHeight * fabs(plane->normal.y);
+		
+		float minS, maxS;
+		GetStretchedFaceRange(plane, halfHeight, &minS, &maxS);
+		if (dist > 0 && dist < distance && IsOverBrush(model, brush, i, point - dist * plane->normal, minS, maxS))
+		{
+			distance = dist;
+		}
+	}
+
+	FlatBSPBrushFeatures* features = &model->brushFeatures[brush - model->brushes];
+	for (int i = 0; i < features->numEdges; i++)
+	{
+		BrushEdge* edge = &model->brushEdges[features->firstEdge + i];
+		glm::vec3 a = model->brushVertices[edge->vertices[0]];
+		glm::vec3 b = model->brushVertices[edge->vertices[1]];
+
+		distance = std::min(distance, glm::distance(point, ClosestPointOnSegment(point, a - halfHeight * up, b - halfHeight * up)));
+		distance = std::min(distance, glm::distance(point, ClosestPointOnSegment(point, a + halfHeight * up, b + halfHeight * up)));
+
+		float u, w;
+		if (halfHeight > 0 && GetEdgeBandPosition(a, b, point, &u, &w) && u >= 0 && u <= 1 && fabs(w) <= halfHeight)
+		{
+			distance = std::min(distance, glm::distance(point, a + u * (b - a) + w * up));
+		}
+	}
+
+	for (int i = 0; i < features->numVertices; i++)
+	{
+		glm::vec3 vertex = model->brushVertices[features->firstVertex + i];
+		distance = std::min(distance, glm::distance(point, ClosestPointOnSegment(point, vertex - halfHeight * up, vertex + halfHeight * up)));
+	}
+	return distance;
+}
+
+
+// Where start + fraction * delta first gets within radius of center, FLT_MAX if it doesnt 
+// by fraction 1. A start already within radius only counts when it moves closer, like a 
+// box trace that starts on a plane
+inline float GetSphereEntryFraction(glm::vec3 start, glm::vec3 delta, glm::vec3 center, float radius)
+{
+	glm::vec3 toStart = start - center;
+	float b = glm::dot(toStart, delta);
+	float c = glm::dot(toStart, toStart) - radius * radius;
+	if (b >= 0)
+	{
+		return FLT_MAX;
+	}
+	if (c <= 0)
+	{
+		return 0;
+	}
+
+	float a = glm::dot(delta, delta);
+	float discriminant = b * b - a * c;
+	if (discriminant < 0)
+	{
+		return FLT_MAX;
+	}
+
+	float fraction = (-b - sqrt(discriminant)) / a;
+	return fraction <= 1 ? fraction : FLT_MAX;
+}
+
+
+// the same for the cylinder of radius around p to q, without its end caps
+inline float GetCylinderEntryFraction(glm::vec3 start, glm::vec3 delta, glm::vec3 p, glm::vec3 q, float radius)
+{
+	glm::vec3 axis = q - p;
+	float axisLengthSquared = glm::dot(axis, axis);
+	if (axisLengthSquared == 0)
+	{
+		return FLT_MAX;
+	}
+
+	// across the axis the cylinder is a circle
+	glm::vec3 toStart = start - p;
+	glm::vec3 startAcross = toStart - axis * (glm::dot(toStart, axis) / axisLengthSquared);
+	glm::vec3 deltaAcross = delta - axis * (glm::dot(delta, axis) / axisLengthSquared);
+
+	float a = glm::dot(deltaAcross, deltaAcross);
+	float b = glm::dot(startAcross, deltaAcross);
+	float c = glm::dot(startAcross, startAcross) - radius * radius;
+	if (b >= 0)
+	{
+		return FLT_MAX;
+	}
+
+	float fraction = 0;
+	if (c > 0)
+	{
+		float discriminant = b * b - a * c;
+		if (discriminant < 0)
+		{
+			return FLT_MAX;
+		}
+
+		fraction = (-b - sqrt(discriminant)) / a;
+		if (fraction > 1)
+		{
+			return FLT_MAX;
+		}
+	}
+
+	float alongAxis = glm::dot(toStart + fraction * delta, axis);
+	if (alongAxis < 0 || alongAxis > axisLengthSquared)
+	{
+		return FLT_MAX;
+	}
+	return fraction;
+}
+
+
+// the same for the plane the center touches the face of a side at, distance out from it
+inline float GetPlaneEntryFraction(glm::vec3 start, glm::vec3 delta, glm::vec3 normal, float distance)
+{
+	float startDist = glm::dot(normal, start) - distance;
+	float speed = glm::dot(normal, delta);
+	if (speed >= 0)
+	{
+		return FLT_MAX;
+	}
+	if (startDist <= 0)
+	{
+		return 0;
+	}
+
+	float fraction = startDist / -speed;
+	return fraction <= 1 ? fraction : FLT_MAX;
+}
+
+
+inline void UpdateRoundTraceHit(RoundTraceHit* hit, float fraction, glm::vec3 normal, int side)
+{
+	if (fraction < hit->fraction)
+	{
+		hit->fraction = fraction;
+		hit->normal = normal;
+		hit->side = side;
+	}
+}
+
+
+// the axis point the center is closest to, for the normal off a cylinder or a sphere
+inline glm::vec3 GetRoundHitNormal(glm::vec3 point, glm::vec3 p, glm::vec3 q)
+{
+	return glm::normalize(point - ClosestPointOnSegment(point, p, q));
+}
+
+
+// first time the capsule center runs into the brush grown by radius, see the comment above
+RoundTraceHit GetRoundBrushHit(BSPCollisionModel* model, FlatBSPBrush* brush, glm::vec3 start, glm::vec3 delta, float radius, float halfHeight)
+{
+	RoundTraceHit hit;
+	hit.fraction = FLT_MAX;
+	hit.side = -1;
+
+	glm::vec3 up = glm::vec3(0, 1, 0);
+	for (int i = 0; i < brush->numSides; i++)
+	{
+		Plane* plane = &model->planes[model->brushSides[brush->firstSide + i]];
+		float offset = radius + halfHeight * fabs(plane->normal.y);
+		float fraction = GetPlaneEntryFraction(start, delta, plane->normal, plane->distance + offset);
+		if (fraction >= hit.fraction)
+		{
+			continue;
+		}
+
+		float minS, maxS;
+		GetStretchedFaceRange(plane, halfHeight, &minS, &maxS);
+		glm::vec3 onFace = start + fraction * delta - radius * plane->normal;
+		if (IsOverBrush(model, brush, i, onFace, minS, maxS))
+		{
+			UpdateRoundTraceHit(&hit, fraction, plane->normal, i);
+		}
+	}
+
+	FlatBSPBrushFeatures* features = &model->brushFeatures[brush - model->brushes];
+	for (int i = 0; i < features->numEdges; i++)
+	{
+		BrushEdge* edge = &model->brushEdges[features->firstEdge + i];
+		glm::vec3 a = model->brushVertices[edge->vertices[0]];
+		glm::vec3 b = model->brushVertices[edge->vertices[1]];
+
+		for (int j = 0; j < (halfHeight > 0 ? 2 : 1); j++)
+		{
+			glm::vec3 shift = (j == 0 ? -halfHeight : halfHeight) * up;
+			float fraction = GetCylinderEntryFraction(start, delta, a + shift, b + shift, radius);
+			if (fraction < hit.fraction)
+			{
+				UpdateRoundTraceHit(&hit, fraction, GetRoundHitNormal(start + fraction * delta, a + shift, b + shift), -1);
+			}
+		}
+
+		glm::vec3 bandNormal = glm::cross(b - a, up);
+		if (halfHeight == 0 || glm::length(bandNormal) < NORMAL_SNAP_EPSILON)
+		{
+			continue;
+		}
+		bandNormal = glm::normalize(bandNormal);
+
+		for (int j = 0; j < 2; j++)
+		{
+			glm::vec3 normal = j == 0 ? bandNormal : -bandNormal;
+			float fraction = GetPlaneEntryFraction(start, delta, normal, glm::dot(normal, a) + radius);
+			
+			float u, w;
+			if (fraction < hit.fraction && GetEdgeBandPosition(a, b, start + fraction * delta - radius * normal, &u, &w) &&
+				u >= 0 && u <= 1 && fabs(w) <= halfHeight)
+			{
+				UpdateRoundTraceHit(&hit, fraction, normal, -1);
+			}
+		}
+	}
+
+	for (int i = 0; i < features->numVertices; i++)
+	{
+		glm::vec3 bottom = model->brushVertices[features->firstVertex + i] - halfHeight * up;
+		glm::vec3 top = bottom + 2 * halfHeight * up;
+
+		float fraction = std::min(GetSphereEntryFraction(start, delta, bottom, radius), GetSphereEntryFraction(start, delta, top, radius));
+		if (halfHeight > 0)
+		{
+			fraction = std::min(fraction, GetCylinderEntryFraction(start, delta, bottom, top, radius));
+		}
+		if (fraction < hit.fraction)
+		{
+			UpdateRoundTraceHit(&hit, fraction, GetRoundHitNormal(start + fraction * delta, bottom, top), -1);
+		}
+	}
+	return hit;
+}
+
+
+// CheckBrush for round traces. The planes pushed out by the capsule are all outside the grown
+// brush, so they throw out what they can before the rounded parts are looked at
+void CheckRoundBrush(BSPCollisionModel* model, FlatBSPBrush* brush, glm::vec3 start, glm::vec3 end, TraceResult* result, TraceSetupInfo* setupInfo)
+{
+	if (brush->numSides == 0)
+	{
+		return;
+	}
+
+	float radius = setupInfo->radius;
+	float halfHeight = setupInfo->halfHeight;
+
+	bool startsOut = false;
+	bool endsOut = false;
+	for (int i = 0; i < brush->numSides; i++)
+	{
+		Plane* plane = &model->planes[model->brushSides[brush->firstSide + i]];
+		TRACE_STAT(setupInfo, TRACE_STAT_PLANES);
+
+		float offset = radius + halfHeight * fabs(plane->normal.y);
+		float startToPlaneDist = glm::dot(start, plane->normal) - plane->distance - offset;
+		float endToPlaneDist = glm::dot(end, plane->normal) - plane->distance - offset;
+
+		if (startToPlaneDist > DIST_EPSILON && endToPlaneDist > DIST_EPSILON)
+		{
+			TRACE_STAT(setupInfo, TRACE_STAT_EARLY_OUTS);
+			return;
+		}
+
+		startsOut = startsOut || startToPlaneDist > 0;
+		endsOut = endsOut || endToPlaneDist > 0;
+	}
+
+	// inside the pushed out planes can still be outside a rounded corner
+	if (!startsOut && GetStretchedBrushDistance(model, brush, start, halfHeight) <= radius)
+	{
+		result->outputStartsOut = false;
+		if (!endsOut && GetStretchedBrushDistance(model, brush, end, halfHeight) <= radius)
+		{
+			result->outputAllSolid = true;
+		}
+		return;
+	}
+
+	// stop DIST_EPSILON short, like the box traces do
+	RoundTraceHit hit = GetRoundBrushHit(model, brush, start, end - start, radius + DIST_EPSILON, halfHeight);
+	if (hit.fraction < result->timeFraction)
+	{
+		result->timeFraction = hit.fraction;
+		if (hit.side >= 0)
+		{
+			result->plane = model->planes[model->brushSides[brush->firstSide + hit.side]];
+		}
+		else
+		{
+			// the plane that touches the brush at the edge or corner that was hit
+			float distance = -FLT_MAX;
+			FlatBSPBrushFeatures* features = &model->brushFeatures[brush - model->brushes];
+			for (int i = 0; i < features->numVertices; i++)
+			{
+				distance = std::max(distance, glm::dot(hit.normal, model->brushVertices[features->firstVertex + i]));
+			}
+			result->plane.normal = hit.normal;
+			result->plane.distance = distance;
+		}
+	}
+}
+
+
+// the bounds test is a handful of compares, most brushes in a leaf are nowhere near the trace
+inline bool TraceCanHitBrush(FlatBSPBrush* brush, TraceSetupInfo* setupInfo)
+{
+	return (brush->contents & BRUSH_CONTENTS_SOLID) && BoundingBoxesOverlap(setupInfo->sweptBounds, brush->bounds);
+}
+
+
+void TraceToLeafNode(BSPCollisionModel* model, int leafIndex, glm::vec3 start, glm::vec3 end, TraceResult* result, TraceSetupInfo* setupInfo)
+{
+	FlatBSPLeaf* leaf = &model->leaves[leafIndex];
+
+	for (int i = 0; i < leaf->numLeafBrushes; i++)
+	{
+		int brushIndex = model->leafBrushes[leaf->firstLeafBrush + i];
+
+		// already tested in another leaf of this trace
+		if (setupInfo->brushStamps[brushIndex] == setupInfo->mailboxStamp)
+		{
+			TRACE_STAT(setupInfo, TRACE_STAT_EARLY_OUTS);
+			continue;
+		}
+		setupInfo->brushStamps[brushIndex] = setupInfo->mailboxStamp;
+
+		FlatBSPBrush* brush = &model->brushes[brushIndex];
+		if (!TraceCanHitBrush(brush, setupInfo))
+		{
+			TRACE_STAT(setupInfo, TRACE_STAT_EARLY_OUTS);
+			continue;
+		}
+
+		TRACE_STAT(setupInfo, TRACE_STAT_BRUSHES);
+
+		if (setupInfo->isRound)
+		{
+			CheckRoundBrush(model, brush, start, end, result, setupInfo);
+		}
+		else
+		{
+			CheckBrush(model, brush, start, end, result, setupInfo);
+		}
+	
+		if (result->timeFraction == 0)
+			return;
+	}
+}
+
+
+
+
+
+// Distances of start and end to the plane, and how far the box reaches towards it.
+// An axial plane faces +axis (see PlaneType), so its distance is a single coordinate
+// and the box reaches exactly its extent along that axis
+template <PlaneType planeType>
+inline void GetHullCheckDistances(Plane* plane, glm::vec3 start, glm::vec3 end, TraceSetupInfo* setupInfo,
+	float* startDist, float* endDist, float* offset)
+{
+	*startDist = start[planeType] - plane->distance;
+	*endDist = end[planeType] - plane->distance;
+	*offset = setupInfo->traceExtends[planeType];
+}
+
+template <>
+inline void GetHullCheckDistances<PLANE_NON_AXIAL>(Plane* plane, glm::vec3 start, glm::vec3 end, TraceSetupInfo* setupInfo,
+	float* startDist, float* endDist, float* offset)
+{
+	*startDist = glm::dot(start, plane->normal) - plane->distance;
+	*endDist = glm::dot(end, plane->normal) - plane->distance;
+
+	if (setupInfo->isTraceBoxAPoint)
+	{
+		*offset = 0;
+	}
+	else if (setupInfo->isRound)
+	{
+		*offset = setupInfo->radius + setupInfo->halfHeight * fabs(plane->normal[1]);
+	}
+	else
+	{
+		// similar to 5.2.3 Testing Box Against Plane
+		*offset = fabs(setupInfo->traceExtends[0] * plane->normal[0]) +
+			fabs(setupInfo->traceExtends[1] * plane->normal[1]) +
+			fabs(setupInfo->traceExtends[2] * plane->normal[2]);
+	}
+}
+
+
+// Splits a segment that isnt completely on one side of the plane. Returns the side start is on,
+// [0, fraction1] of the segment goes down that side and [fraction2, 1] down the other.
+// 1/32 epsilon to keep floating point happy
+inline int GetHullCheckSplitFractions(float startDist, float endDist, float offset, float* fraction1, float* fraction2)
+{
+	/*
+	the case where endDist > startDist
+
+				      plane
+						
+			front side	|  back side
+						|
+				end		|    start
+			<-----------|
+						|
+						|
+
+
+	the case where startDist > endDist
+
+					  plane
+
+			front side	|  back side
+						|
+				start	|    end
+			<-----------|
+						|
+						|
+
+	*/
+	int side;
+	if (startDist < endDist)
+	{
+		side = 1;	// start is on the back of the plane
+		float inverseDistance = 1.0f / (startDist - endDist);
+		*fraction1 = (startDist - offset + DIST_EPSILON) * inverseDistance;
+		*fraction2 = (startDist + offset + DIST_EPSILON) * inverseDistance;
+	}
+	else if (startDist > endDist)
+	{
+		side = 0;	// start is on the front side of the plane
+		float inverseDistance = 1.0f / (startDist - endDist);
+		*fraction1 = (startDist + offset + DIST_EPSILON) * inverseDistance;
+		*fraction2 = (startDist - offset - DIST_EPSILON) * inverseDistance;
+	}
+	else
+	{
+		side = 0;
+		*fraction1 = 1.0f;
+		*fraction2 = 0.0f;
+	}
+
+	if (*fraction1 < 0) { *fraction1 = 0;	}
+	else if (*fraction1 > 1) { *fraction1 = 1; }
+	if (*fraction2 < 0) { *fraction2 = 0; }
+	else if (*fraction2 > 1) { *fraction2 = 1; }
+	return side;
+}
+
+
+// child uses the FlatBSPNode::children encoding, so it can be either a node or a leaf
+void RecursiveHullCheck(BSPCollisionModel* model, int child, float startFraction, float endFraction,
+	glm::vec3 start, glm::vec3 end,
+	glm::vec3 traceStart, glm::vec3 traceEnd,
+	TraceResult* result, TraceSetupInfo* setupInfo, bool print = false)
+{
+	// already hit something nearer
+	if (result->timeFraction <= startFraction)
+	{
+		TRACE_STAT(setupInfo, TRACE_STAT_EARLY_OUTS);
+		return;
+	}
+
+//	std::cout << "startFraction " << startFraction << ", endFraction " << endFraction << std::endl;
+
+	// nothing in this subtree can be touched by the box swept from start to end
+	BoundingBox sweptBox;
+	sweptBox.min = glm::min(start, end) + setupInfo->mins - glm::vec3(DIST_EPSILON);
+	sweptBox.max = glm::max(start, end) + setupInfo->maxs + glm::vec3(DIST_EPSILON);
+	if (!BoundingBoxesOverlap(sweptBox, *GetBSPModelBounds(model, child)))
+	{
+		TRACE_STAT(setupInfo, TRACE_STAT_EARLY_OUTS);
+		return;
+	}
+
+	if (IsFlatBSPLeaf(child))
+	{
+		TRACE_STAT(setupInfo, TRACE_STAT_LEAVES);
+		TraceToLeafNode(model, FlatBSPLeafIndex(child), traceStart, traceEnd, result, setupInfo);
+		return;
+	}
+
+	FlatBSPNode* node = &model->nodes[child];
+	TRACE_STAT(setupInfo, TRACE_STAT_NODES);
+	TRACE_STAT(setupInfo, TRACE_STAT_PLANES);
+
+	if (print)
+	{
+		std::cout << "visiting node " << child << std::endl;
+	}
+
+	Plane* plane = &model->planes[node->planeIndex];
+//	std::cout << "		plane " << plane->normal << std::endl;
+
+	float startDist, endDist, offset;
+	switch (node->planeType)
+	{
+	case PLANE_X:
+		GetHullCheckDistances<PLANE_X>(plane, start, end, setupInfo, &startDist, &endDist, &offset);
+		break;
+	case PLANE_Y:
+		GetHullCheckDistances<PLANE_Y>(plane, start, end, setupInfo, &startDist, &endDist, &offset);
+		break;
+	case PLANE_Z:
+		GetHullCheckDistances<PLANE_Z>(plane, start, end, setupInfo, &startDist, &endDist, &offset);
+		break;
+	default:
+		GetHullCheckDistances<PLANE_NON_AXIAL>(plane, start, end, setupInfo, &startDist, &endDist, &offset);
+		break;
+	}
+
+	if (startDist >= offset && endDist >= offset)
+	{
+		RecursiveHullCheck(model, node->children[0], startFraction, endFraction, start, end, 
+			traceStart, traceEnd, result, setupInfo, print);
+		return;
+	}
+	if (startDist < -offset && endDist < -offset)
+	{
+		RecursiveHullCheck(model, node->children[1], startFraction, endFraction, start, end, 
+			traceStart, traceEnd, result, setupInfo, print);
+		return;
+	}
+
+	float fraction1, fraction2, middleFraction;
+	glm::vec3 middlePoint;
+
+	// the side that the start is on. 
+	int side = GetHullCheckSplitFractions(startDist, endDist, offset, &fraction1, &fraction2);
+
+	// examine [start  middle]
+	middleFraction = startFraction + (endFraction - startFraction) * fraction1;
+	middlePoint = start + fraction1 * (end - start);
+
+	RecursiveHullCheck(model, node->children[side], startFraction, middleFraction, 
+												start, middlePoint, traceStart, traceEnd, 
+												result, setupInfo, print);
+
+	// examine [middle	end]
+	middleFraction = startFraction + (endFraction - startFraction) * fraction2;
+	middlePoint = start + fraction2 * (end - start);
+
+	RecursiveHullCheck(model, node->children[!side], middleFraction, endFraction, 
+												middlePoint, end, traceStart, 
+												traceEnd, result, setupInfo, print);
+}
+
+
+
+
+// shared by all the collision backends
+void BeginBoxTrace(glm::vec3 start, glm::vec3 end, glm::vec3 mins, glm::vec3 maxs, TraceResult* result, TraceSetupInfo* setup)
+{
+	*result = {};
+	result->outputStartsOut = true;
+	result->outputAllSolid = false;
+	result->plane = NULL_PLANE;
+
+	*setup = {};
+
+	result->timeFraction = 1;
+
+	setup->mins = mins;
+	setup->maxs = maxs;
+
+	setup->sweptBounds.min = glm::min(start, end) + mins - glm::vec3(DIST_EPSILON);
+	setup->sweptBounds.max = glm::max(start, end) + maxs + glm::vec3(DIST_EPSILON);
+
+	if (start == end)
+	{
+
+	}
+
+	if (mins == maxs)
+	{
+		setup->isTraceBoxAPoint = true;
+	}
+	else
+	{
+		setup->isTraceBoxAPoint = false;
+
+		// getting the largest dimension in of min or max
+		// essentially we are comparing -min[i] and max[i]
+		setup->traceExtends[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+		setup->traceExtends[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+		setup->traceExtends[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+	}
+}
+
+// a round trace is a box trace with the capsule's bounds as far as the tree is concerned
+void BeginRoundTrace(glm::vec3 start, glm::vec3 end, float radius, float halfHeight, TraceResult* result, TraceSetupInfo* setup)
+{
+	glm::vec3 extents = glm::vec3(radius, radius + halfHeight, radius);
+	BeginBoxTrace(start, end, -extents, extents, result, setup);
+
+	setup->isRound = true;
+	setup->radius = radius;
+	setup->halfHeight = halfHeight;
+}
+
+void EndBoxTrace(glm::vec3 start, glm::vec3 end, TraceResult* result)
+{
+	if (result->timeFraction == 1)
+	{
+		result->endPos = end;
+	}
+	else
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			result->endPos[i] = start[i] + result->timeFraction * (end[i] - start[i]);
+		}
+	}
+}
+
+
+/*
+	Brush mailboxes, quake's checkcount. A brush that spans several leaves is in the list of 
+	each of them, so a trace through those leaves would test it again in every one. Each trace 
+	gets a new stamp instead, and a brush is only tested if its stamp isnt the trace's yet.
+
+	Quake keeps the stamp in the brush. Here the brushes can be in a read only mapped file, 
+	and several threads can be tracing at once, so every thread has stamps of its own that 
+	nobody else writes. There is a row of them per packet lane, since the traces of a packet 
+	take turns in the leaves and would keep overwriting each other's stamps in a shared row.
+*/
+const int TRACE_MAILBOX_ROWS = 4;		// one per lane of a TracePacket
+
+struct TraceMailbox
+{
+	unsigned int stamp;
+	int rowLength;		// the most brushes of any model traced on this thread so far
+	std::vector<unsigned int> brushStamps;
+};
+
+thread_local TraceMailbox traceMailbox;
+
+
+// row is the packet lane, single traces use row 0. Stamps are shared by all models, a trace 
+// only ever sees its own model's brushes and a new stamp is newer than any of them
+void BeginTraceMailbox(BSPCollisionModel* model, int row, unsigned int** brushStamps, unsigned int* stamp)
+{
+	assert(row < TRACE_MAILBOX_ROWS);
+
+	TraceMailbox* mailbox = &traceMailbox;
+	if (mailbox->rowLength < model->numBrushes)
+	{
+		mailbox->rowLength = model->numBrushes;
+		mailbox->brushStamps.assign(TRACE_MAILBOX_ROWS * mailbox->rowLength, 0);
+		mailbox->stamp = 0;
+	}
+
+	// start over when the stamp wraps around, so an old stamp never looks new
+	mailbox->stamp++;
+	if (mailbox->stamp == 0)
+	{
+		std::fill(mailbox->brushStamps.begin(), mailbox->brushStamps.end(), 0);
+		mailbox->stamp = 1;
+	}
+
+	*brushStamps = mailbox->brushStamps.data() + row * mailbox->rowLength;
+	*stamp = mailbox->stamp;
+}
+
+
+/*
+	Contents queries, what a point or a box is touching without tracing anything. They go down 
+	the tree like BoxLeafs, only into the sides the box reaches, and test the brushes of the 
+	leaves they end up in against the planes. No fractions, no segments to split.
+
+	A box touches a brush when its nearest corner is behind or on every plane of the brush, the 
+	same test that makes a zero length BoxTrace start solid. Like that one it only looks at the 
+	brush's own planes, so a box just off an edge of a brush can count as touching it.
+*/
+
+// the box at origin is behind or on every plane of the brush
+bool BoxTouchesBrush(BSPCollisionModel* model, FlatBSPBrush* brush, glm::vec3 origin, glm::vec3 mins, glm::vec3 maxs)
+{
+	if (brush->numSides == 0)
+	{
+		return false;
+	}
+
+	__m128 origins[3], boxMins[3], boxMaxs[3];
+	for (int i = 0; i < 3; i++)
+	{
+		origins[i] = _mm_set1_ps(origin[i]);
+		boxMins[i] = _mm_set1_ps(mins[i]);
+		boxMaxs[i] = _mm_set1_ps(maxs[i]);
+	}
+
+	BrushSideBlock* blocks = &model->brushSideBlocks[brush->firstSideBlock];
+	for (int b = 0; b < GetNumBrushSideBlocks(brush->numSides); b++)
+	{
+		__m128 distances = GetBrushSideBlockDistances(&blocks[b], origins, boxMins, boxMaxs);
+		if (_mm_movemask_ps(_mm_cmpgt_ps(distances, _mm_setzero_ps())))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+struct ContentsQuery
+{
+	glm::vec3 origin;
+	glm::vec3 mins;
+	glm::vec3 maxs;
+	BoundingBox bounds;		// of the box, grown by DIST_EPSILON
+
+	// a brush in several leaves is only tested once, see BeginTraceMailbox
+	unsigned int* brushStamps;
+	unsigned int mailboxStamp;
+
+	int contents;
+	std::vector<int>* brushes;	// can be NULL
+};
+
+
+const int ALL_BRUSH_CONTENTS = BRUSH_CONTENTS_SOLID;
+
+// once every flag is in and nobody wants the brushes, the rest cant change the answer
+inline bool IsContentsQueryDone(ContentsQuery* query)
+{
+	return query->brushes == NULL && query->contents == ALL_BRUSH_CONTENTS;
+}
+
+
+void ContentsToLeafNode(BSPCollisionModel* model, int leafIndex, ContentsQuery* query)
+{
+	FlatBSPLeaf* leaf = &model->leaves[leafIndex];
+	for (int i = 0; i < leaf->numLeafBrushes && !IsContentsQueryDone(query); i++)
+	{
+		int brushIndex = model->leafBrushes[leaf->firstLeafBrush + i];
+		if (query->brushStamps[brushIndex] == query->mailboxStamp)
+		{
+			continue;
+		}
+		query->brushStamps[brushIndex] = query->mailboxStamp;
+
+		FlatBSPBrush* brush = &model->brushes[brushIndex];
+		if (brush->contents == 0 || !BoundingBoxesOverlap(query->bounds, brush->bounds) ||
+			!BoxTouchesBrush(model, brush, query->origin, query->mins, query->maxs))
+		{
+			continue;
+		}
+
+		query->contents |= brush->contents;
+		if (query->brushes)
+		{
+			query->brushes->push_back(brushIndex);
+		}
+	}
+}
+
+
+void BoxContents_r(BSPCollisionModel* model, int child, ContentsQuery* query)
+{
+	glm::vec3 center = query->origin + (query->mins + query->maxs) * 0.5f;
+	glm::vec3 extents = (query->maxs - query->mins) * 0.5f;
+
+	while (true)
+	{
+		// nothing in this subtree near the box
+		if (!BoundingBoxesOverlap(query->bounds, *GetBSPModelBounds(model, child)))
+		{
+			return;
+		}
+
+		if (IsFlatBSPLeaf(child))
+		{
+			break;
+		}
+
+		FlatBSPNode* node = &model->nodes[child];
+		Plane* plane = &model->planes[node->planeIndex];
+
+		// distance range of the box to the plane, a box touching the plane goes down both sides
+		float centerDist, radius;
+		if (node->planeType < PLANE_NON_AXIAL)
+		{
+			centerDist = center[node->planeType] - plane->distance;
+			radius = extents[node->planeType];
+		}
+		else
+		{
+			centerDist = glm::dot(plane->normal, center) - plane->distance;
+			radius = glm::dot(glm::abs(plane->normal), extents);
+		}
+
+		bool front = centerDist + radius >= -DIST_EPSILON;
+		bool back = centerDist - radius <= DIST_EPSILON;
+
+		if (front && back)
+		{
+			BoxContents_r(model, node->children[1], query);
+			if (IsContentsQueryDone(query))
+			{
+				return;
+			}
+		}
+		child = front ? node->children[0] : node->children[1];
+	}
+
+	ContentsToLeafNode(model, FlatBSPLeafIndex(child), query);
+}
+
+
+// BrushContents flags of every brush the box at origin touches, 0 when it is in the open.
+// brushes gets the index of each of them when it isnt NULL
+int BoxContents(BSPCollisionModel* model, glm::vec3 origin, glm::vec3 mins, glm::vec3 maxs, std::vector<int>* brushes = NULL)
+{
+	ContentsQuery query;
+	query.origin = origin;
+	query.mins = mins;
+	query.maxs = maxs;
+	query.bounds.min = origin + mins - glm::vec3(DIST_EPSILON);
+	query.bounds.max = origin + maxs + glm::vec3(DIST_EPSILON);
+	query.contents = 0;
+	query.brushes = brushes;
+	BeginTraceMailbox(model, 0, &query.brushStamps, &query.mailboxStamp);
+
+	BoxContents_r(model, model->root, &query);
+	return query.contents;
+}
+
+
+// a point is a box with no size, it only goes down both sides of the planes it is on
+int PointContents(BSPCollisionModel* model, glm::vec3 point, std::vector<int>* brushes = NULL)
+{
+	return BoxContents(model, point, glm::vec3(0), glm::vec3(0), brushes);
+}
+
+
+/*
+	A trace stops looking at brushes once one of them stops it dead at its start, quake does
+	the same. A point in a brush is in every leaf the trace goes through, so it was seen before
+	that. A box isnt, it can stand on a brush that stops it in one leaf and reach into a taller
+	one that is only in the next:
+
+			 ____|____
+			|	 |	  |  taller
+			| box|____|
+			|____|	  |  stood on
+				 |
+
+	so a dead stopped box trace still looks for a brush it is in at both ends.
+*/
+
+inline bool IsBoxTraceStoppedDead(glm::vec3 mins, glm::vec3 maxs, TraceResult* result)
+{
+	return result->timeFraction == 0 && !result->outputAllSolid && mins != maxs;
+}
+
+
+// brushes are candidates, the trace is all solid in any of them the box touches at start and end
+void CheckStoppedTraceBrushes(BSPCollisionModel* model, int* brushes, int numBrushes, glm::vec3 start, glm::vec3 end,
+	glm::vec3 mins, glm::vec3 maxs, TraceResult* result)
+{
+	for (int i = 0; i < numBrushes; i++)
+	{
+		FlatBSPBrush* brush = &model->brushes[brushes[i]];
+		if (brush->contents != 0 && BoxTouchesBrush(model, brush, start, mins, maxs) &&
+			BoxTouchesBrush(model, brush, end, mins, maxs))
+		{
+			result->outputStartsOut = false;
+			result->outputAllSolid = true;
+			return;
+		}
+	}
+}
+
+
+// uses mailbox row 0, so only once the traversal is done with its stamps
+void CheckStoppedTraceSolid(BSPCollisionModel* model, glm::vec3 start, glm::vec3 end, glm::vec3 mins, glm::vec3 maxs,
+	TraceResult* result)
+{
+	if (!IsBoxTraceStoppedDead(mins, maxs, result))
+	{
+		return;
+	}
+
+	thread_local std::vector<int> brushes;
+	brushes.clear();
+	BoxContents(model, start, mins, maxs, &brushes);
+	CheckStoppedTraceBrushes(model, brushes.data(), brushes.size(), start, end, mins, maxs, result);
+}
 
 
 // Cloning cmodel.c
-TraceResult BoxTrace(glm::vec3 start, glm::vec3 end, glm::vec3 mins, glm::vec3 maxs, BSPNode* tree, bool print = false)
+TraceResult BoxTrace(glm::vec3 start, glm::vec3 end, glm::vec3 mins, glm::vec3 maxs, BSPCollisionModel* model, bool print = false)
+{
+	TraceResult result;
+	TraceSetupInfo setup;
+	BeginBoxTrace(start, end, mins, maxs, &result, &setup);
+	BeginTraceMailbox(model, 0, &setup.brushStamps, &setup.mailboxStamp);
+
+	RecursiveHullCheck(model, model->root, 0, 1, start, end, start, end, &result, &setup, print);
+	END_TRACE_STATS(&setup);
+
+	CheckStoppedTraceSolid(model, start, end, mins, maxs, &result);
+	EndBoxTrace(start, end, &result);
+	return result;
+}
+
+
+// capsule from start - halfHeight to start + halfHeight along y, grown by radius
+TraceResult CapsuleTrace(glm::vec3 start, glm::vec3 end, float radius, float halfHeight, BSPCollisionModel* model)
+{
+	TraceResult result;
+	TraceSetupInfo setup;
+	BeginRoundTrace(start, end, radius, halfHeight, &result, &setup);
+	BeginTraceMailbox(model, 0, &setup.brushStamps, &setup.mailboxStamp);
+
+	RecursiveHullCheck(model, model->root, 0, 1, start, end, start, end, &result, &setup);
+	END_TRACE_STATS(&setup);
+
+	EndBoxTrace(start, end, &result);
+	return result;
+}
+
+
+TraceResult SphereTrace(glm::vec3 start, glm::vec3 end, float radius, BSPCollisionModel* model)
+{
+	return CapsuleTrace(start, end, radius, 0, model);
+}
+
+
+const int AABB_TRACE_STACK_SIZE = 64;
+
+// Same trace against the dynamic AABB tree. Leaves hold a Brush::brushIndex, modelBrushes 
+// maps that to the brush in model->brushes
+TraceResult BoxTrace(glm::vec3 start, glm::vec3 end, glm::vec3 mins, glm::vec3 maxs, AABBTree* tree, 
+	BSPCollisionModel* model, std::vector<int>* modelBrushes)
+{
+	TraceResult result;
+	TraceSetupInfo setup;
+	BeginBoxTrace(start, end, mins, maxs, &result, &setup);
+
+	if (tree->root == AABB_NULL_NODE)
+	{
+		EndBoxTrace(start, end, &result);
+		return result;
+	}
+
+	// grow the node boxes by the trace box instead of sweeping the box. 
+	// The padding covers CheckBrush's DIST_EPSILON
+	const float PADDING = 1.0f;
+	glm::vec3 boxMins = mins - glm::vec3(PADDING);
+	glm::vec3 boxMaxs = maxs + glm::vec3(PADDING);
+	glm::vec3 delta = end - start;
+
+	// a node comes off before its two children go on, so the stack never holds more than
+	// one node per level plus one. The tree is kept balanced, 64 levels is far more than it gets
+	int stack[AABB_TRACE_STACK_SIZE];
+	int stackSize = 0;
+	assert(tree->nodes[tree->root].height < AABB_TRACE_STACK_SIZE);
+
+	stack[stackSize++] = tree->root;
+	while (stackSize > 0)
+	{
+		int nodeId = stack[--stackSize];
+
+		AABBTreeNode* node = &tree->nodes[nodeId];
+		BoundingBox box = { node->box.min - boxMaxs, node->box.max - boxMins };
+
+		// anything that starts past the current hit cant change the result
+		if (!SegmentOverlapsBoundingBox(start, delta, box, result.timeFraction))
+		{
+			TRACE_STAT(&setup, TRACE_STAT_EARLY_OUTS);
+			continue;
+		}
+
+		if (node->IsLeaf())
+		{
+			TRACE_STAT(&setup, TRACE_STAT_LEAVES);
+
+			assert(node->userData >= 0 && node->userData < modelBrushes->size());
+			int brushIndex = (*modelBrushes)[node->userData];
+			assert(brushIndex < model->numBrushes);
+			if (brushIndex < 0)
+			{
+				continue;
+			}
+
+			TRACE_STAT(&setup, TRACE_STAT_BRUSHES);
+			CheckBrush(model, &model->brushes[brushIndex], start, end, &result, &setup);
+		}
+		else
+		{
+			TRACE_STAT(&setup, TRACE_STAT_NODES);
+			stack[stackSize++] = node->children[1];
+			stack[stackSize++] = node->children[0];
+		}
+	}
+	END_TRACE_STATS(&setup);
+
+	EndBoxTrace(start, end, &result);
+	return result;
+}
+
+
+/*
+	Packet traces. BoxTraceBatch sends TRACE_PACKET_SIZE traces down the tree together, the
+	plane and bounds tests run on all of them at once with SSE. A packet only splits where
+	its traces want to go down different children first:
+
+			 node				lanes 0 1 2 3
+			/    \
+		  c0      c1			0, 1 are in front, 2 crosses starting in front, 3 is behind
+								-> c0 gets 0 1 2, then c1 gets 2
+								-> c1 gets 3
+
+	Every lane still visits the same leaves in the same order as its own RecursiveHullCheck
+	would, and does the same float operations in the same order, so the results are bit for
+	bit the ones BoxTrace returns. A packet down to one lane just carries on as a scalar trace.
+	Packets help when the traces are close together, line of sight checks from one eye or the
+	pellets of one shot, so callers should keep those next to each other in the batch.
+*/
+const int TRACE_PACKET_SIZE = 4;
+const int TRACE_PACKET_ALL_LANES = (1 << TRACE_PACKET_SIZE) - 1;
+
+// per lane values are stored component major, so one component of all the lanes is one __m128
+struct TracePacket
+{
+	glm::vec3* traceStarts;
+	glm::vec3* traceEnds;
+	TraceResult results[TRACE_PACKET_SIZE];
+	TraceSetupInfo setups[TRACE_PACKET_SIZE];
+
+	float mins[3][TRACE_PACKET_SIZE];
+	float maxs[3][TRACE_PACKET_SIZE];
+	float traceExtends[3][TRACE_PACKET_SIZE];
+};
+
+// what is left of each lane's trace at a node, what RecursiveHullCheck passes down
+struct TracePacketSegment
+{
+	float startFraction[TRACE_PACKET_SIZE];
+	float endFraction[TRACE_PACKET_SIZE];
+	float start[3][TRACE_PACKET_SIZE];
+	float end[3][TRACE_PACKET_SIZE];
+};
+
+
+inline glm::vec3 GetTracePacketLane(float values[3][TRACE_PACKET_SIZE], int lane)
+{
+	return glm::vec3(values[0][lane], values[1][lane], values[2][lane]);
+}
+
+
+inline void SetTracePacketLane(float values[3][TRACE_PACKET_SIZE], int lane, glm::vec3 value)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		values[i][lane] = value[i];
+	}
+}
+
+
+// lanes whose swept box overlaps bb, same test as in RecursiveHullCheck
+inline int GetTracePacketOverlapMask(TracePacket* packet, TracePacketSegment* segment, BoundingBox* bb)
+{
+	__m128 epsilon = _mm_set1_ps(DIST_EPSILON);
+	__m128 overlaps = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	for (int i = 0; i < 3; i++)
+	{
+		__m128 start = _mm_loadu_ps(segment->start[i]);
+		__m128 end = _mm_loadu_ps(segment->end[i]);
+		__m128 sweptMin = _mm_sub_ps(_mm_add_ps(_mm_min_ps(start, end), _mm_loadu_ps(packet->mins[i])), epsilon);
+		__m128 sweptMax = _mm_add_ps(_mm_add_ps(_mm_max_ps(start, end), _mm_loadu_ps(packet->maxs[i])), epsilon);
+
+		overlaps = _mm_and_ps(overlaps, _mm_cmple_ps(sweptMin, _mm_set1_ps(bb->max[i])));
+		overlaps = _mm_and_ps(overlaps, _mm_cmple_ps(_mm_set1_ps(bb->min[i]), sweptMax));
+	}
+	return _mm_movemask_ps(overlaps);
+}
+
+
+// GetHullCheckDistances for all the lanes, the operations are done in the same order
+// so every lane gets exactly the floats the scalar version would
+inline void GetTracePacketHullCheckDistances(Plane* plane, PlaneType planeType, TracePacket* packet, TracePacketSegment* segment,
+	__m128* startDist, __m128* endDist, __m128* offset)
+{
+	__m128 distance = _mm_set1_ps(plane->distance);
+	if (planeType != PLANE_NON_AXIAL)
+	{
+		*startDist = _mm_sub_ps(_mm_loadu_ps(segment->start[planeType]), distance);
+		*endDist = _mm_sub_ps(_mm_loadu_ps(segment->end[planeType]), distance);
+		*offset = _mm_loadu_ps(packet->traceExtends[planeType]);
+		return;
+	}
+
+	__m128 startDot = _mm_setzero_ps();
+	__m128 endDot = _mm_setzero_ps();
+	*offset = _mm_setzero_ps();
+
+	// clears the sign bit
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	for (int i = 0; i < 3; i++)
+	{
+		__m128 normal = _mm_set1_ps(plane->normal[i]);
+		__m128 startTerm = _mm_mul_ps(_mm_loadu_ps(segment->start[i]), normal);
+		__m128 endTerm = _mm_mul_ps(_mm_loadu_ps(segment->end[i]), normal);
+		__m128 offsetTerm = _mm_and_ps(_mm_mul_ps(_mm_loadu_ps(packet->traceExtends[i]), normal), absMask);
+
+		// the first term is assigned, not added to 0, -0 + 0 would be +0
+		startDot = i == 0 ? startTerm : _mm_add_ps(startDot, startTerm);
+		endDot = i == 0 ? endTerm : _mm_add_ps(endDot, endTerm);
+		*offset = i == 0 ? offsetTerm : _mm_add_ps(*offset, offsetTerm);
+	}
+
+	*startDist = _mm_sub_ps(startDot, distance);
+	*endDist = _mm_sub_ps(endDot, distance);
+}
+
+
+// all ones in the lanes that are set in laneMask
+inline __m128 GetTracePacketLaneMask(int laneMask)
+{
+	__m128i bits = _mm_set_epi32(8, 4, 2, 1);
+	return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(laneMask), bits), bits));
+}
+
+
+// (x + epsilon) * scale. DIST_EPSILON is a double, so in the scalar code the add and the
+// multiply happen in double and only the result is rounded to float, this does the same
+inline __m128 AddEpsilonAndScale(__m128 x, double epsilon, __m128 scale)
+{
+	__m128d epsilons = _mm_set1_pd(epsilon);
+	__m128d low = _mm_mul_pd(_mm_add_pd(_mm_cvtps_pd(x), epsilons), _mm_cvtps_pd(scale));
+	__m128d high = _mm_mul_pd(_mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), epsilons), _mm_cvtps_pd(_mm_movehl_ps(scale, scale)));
+	return _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+}
+
+
+// GetHullCheckSplitFractions for all the lanes, returns the mask of lanes that start behind the plane
+inline int GetTracePacketSplitFractions(__m128 startDist, __m128 endDist, __m128 offset, __m128* fraction1, __m128* fraction2)
+{
+	__m128 startsBehind = _mm_cmplt_ps(startDist, endDist);
+	__m128 startsInFront = _mm_cmpgt_ps(startDist, endDist);
+
+	__m128 inverseDistance = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sub_ps(startDist, endDist));
+	__m128 startMinusOffset = _mm_sub_ps(startDist, offset);
+	__m128 startPlusOffset = _mm_add_ps(startDist, offset);
+
+	__m128 behind1 = AddEpsilonAndScale(startMinusOffset, DIST_EPSILON, inverseDistance);
+	__m128 behind2 = AddEpsilonAndScale(startPlusOffset, DIST_EPSILON, inverseDistance);
+	__m128 inFront1 = AddEpsilonAndScale(startPlusOffset, DIST_EPSILON, inverseDistance);
+	__m128 inFront2 = AddEpsilonAndScale(startMinusOffset, -DIST_EPSILON, inverseDistance);
+
+	// start and end at the same distance, fractions are 1 and 0
+	*fraction1 = SelectLanes(startsBehind, behind1, SelectLanes(startsInFront, inFront1, _mm_set1_ps(1.0f)));
+	*fraction2 = SelectLanes(startsBehind, behind2, SelectLanes(startsInFront, inFront2, _mm_setzero_ps()));
+
+	// compare and select rather than min and max, so a NaN stays a NaN like in the scalar version
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	*fraction1 = SelectLanes(_mm_cmplt_ps(*fraction1, zero), zero, *fraction1);
+	*fraction1 = SelectLanes(_mm_cmpgt_ps(*fraction1, one), one, *fraction1);
+	*fraction2 = SelectLanes(_mm_cmplt_ps(*fraction2, zero), zero, *fraction2);
+	*fraction2 = SelectLanes(_mm_cmpgt_ps(*fraction2, one), one, *fraction2);
+
+	return _mm_movemask_ps(startsBehind);
+}
+
+
+// Cuts the lanes in laneMask of segment down to [0, fraction] of what is left of them,
+// or to [fraction, 1] when toEnd. Same math as RecursiveHullCheck's middle points
+inline void CutTracePacketLanes(TracePacketSegment* segment, TracePacketSegment* cut, int laneMask, __m128 fraction, bool toEnd)
+{
+	__m128 mask = GetTracePacketLaneMask(laneMask);
+
+	__m128 startFraction = _mm_loadu_ps(segment->startFraction);
+	__m128 endFraction = _mm_loadu_ps(segment->endFraction);
+	__m128 middleFraction = _mm_add_ps(startFraction, _mm_mul_ps(_mm_sub_ps(endFraction, startFraction), fraction));
+	_mm_storeu_ps(cut->startFraction, toEnd ? SelectLanes(mask, middleFraction, startFraction) : startFraction);
+	_mm_storeu_ps(cut->endFraction, toEnd ? endFraction : SelectLanes(mask, middleFraction, endFraction));
+
+	for (int i = 0; i < 3; i++)
+	{
+		__m128 start = _mm_loadu_ps(segment->start[i]);
+		__m128 end = _mm_loadu_ps(segment->end[i]);
+		__m128 middlePoint = _mm_add_ps(start, _mm_mul_ps(fraction, _mm_sub_ps(end, start)));
+		_mm_storeu_ps(cut->start[i], toEnd ? SelectLanes(mask, middlePoint, start) : start);
+		_mm_storeu_ps(cut->end[i], toEnd ? end : SelectLanes(mask, middlePoint, end));
+	}
+}
+
+
+// TRACE_STAT for each lane in laneMask
+inline void TracePacketStat(TracePacket* packet, int laneMask, TraceStatType type)
+{
+#ifdef TRACE_STATS
+	for (int i = 0; i < TRACE_PACKET_SIZE; i++)
+	{
+		if (laneMask & (1 << i))
+		{
+			TRACE_STAT(&packet->setups[i], type);
+		}
+	}
+#else
+	(void)packet;
+	(void)laneMask;
+	(void)type;
+#endif
+}
+
+
+void RecursiveHullCheckPacket(BSPCollisionModel* model, int child, TracePacket* packet, TracePacketSegment* segment, int laneMask)
+{
+	// lanes that already hit something nearer
+	TraceResult* results = packet->results;
+	__m128 hitFraction = _mm_setr_ps(results[0].timeFraction, results[1].timeFraction, results[2].timeFraction, results[3].timeFraction);
+	int nearerMask = laneMask;
+	laneMask &= _mm_movemask_ps(_mm_cmpnle_ps(hitFraction, _mm_loadu_ps(segment->startFraction)));
+	TracePacketStat(packet, nearerMask & ~laneMask, TRACE_STAT_EARLY_OUTS);
+
+	// a packet down to one lane is just a scalar trace, carry on with that
+	if (laneMask != 0 && (laneMask & (laneMask - 1)) == 0)
+	{
+		int i = 0;
+		while ((laneMask & (1 << i)) == 0)
+		{
+			i++;
+		}
+		RecursiveHullCheck(model, child, segment->startFraction[i], segment->endFraction[i],
+			GetTracePacketLane(segment->start, i), GetTracePacketLane(segment->end, i),
+			packet->traceStarts[i], packet->traceEnds[i], &packet->results[i], &packet->setups[i]);
+		return;
+	}
+
+	int overlapMask = laneMask & GetTracePacketOverlapMask(packet, segment, GetBSPModelBounds(model, child));
+	TracePacketStat(packet, laneMask & ~overlapMask, TRACE_STAT_EARLY_OUTS);
+	laneMask = overlapMask;
+	if (laneMask == 0)
+	{
+		return;
+	}
+
+	if (IsFlatBSPLeaf(child))
+	{
+		TracePacketStat(packet, laneMask, TRACE_STAT_LEAVES);
+		for (int i = 0; i < TRACE_PACKET_SIZE; i++)
+		{
+			if (laneMask & (1 << i))
+			{
+				TraceToLeafNode(model, FlatBSPLeafIndex(child), packet->traceStarts[i], packet->traceEnds[i], 
+					&packet->results[i], &packet->setups[i]);
+			}
+		}
+		return;
+	}
+
+	FlatBSPNode* node = &model->nodes[child];
+	Plane* plane = &model->planes[node->planeIndex];
+	TracePacketStat(packet, laneMask, TRACE_STAT_NODES);
+	TracePacketStat(packet, laneMask, TRACE_STAT_PLANES);
+
+	__m128 startDist, endDist, offset;
+	GetTracePacketHullCheckDistances(plane, (PlaneType)node->planeType, packet, segment, &startDist, &endDist, &offset);
+	__m128 negativeOffset = _mm_xor_ps(offset, _mm_set1_ps(-0.0f));
+
+	int frontMask = laneMask & _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(startDist, offset), _mm_cmpge_ps(endDist, offset)));
+	int backMask = laneMask & ~frontMask &
+		_mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(startDist, negativeOffset), _mm_cmplt_ps(endDist, negativeOffset)));
+	int crossMask = laneMask & ~frontMask & ~backMask;
+
+	// nothing to split, the lanes go down one side or the other as they are
+	if (crossMask == 0)
+	{
+		if (frontMask)
+		{
+			RecursiveHullCheckPacket(model, node->children[0], packet, segment, frontMask);
+		}
+		if (backMask)
+		{
+			RecursiveHullCheckPacket(model, node->children[1], packet, segment, backMask);
+		}
+		return;
+	}
+
+	__m128 fraction1, fraction2;
+	int startsBehindMask = GetTracePacketSplitFractions(startDist, endDist, offset, &fraction1, &fraction2);
+
+	// indexed by the side a lane goes down first
+	int crossMasks[2] = { crossMask & ~startsBehindMask, crossMask & startsBehindMask };
+	int firstMasks[2] = { frontMask | crossMasks[0], backMask | crossMasks[1] };
+
+	for (int side = 0; side < 2; side++)
+	{
+		if (crossMasks[side] == 0)
+		{
+			if (firstMasks[side])
+			{
+				RecursiveHullCheckPacket(model, node->children[side], packet, segment, firstMasks[side]);
+			}
+			continue;
+		}
+
+		// examine [start  middle] of the crossing lanes, together with the lanes that dont cross
+		TracePacketSegment cut;
+		CutTracePacketLanes(segment, &cut, crossMasks[side], fraction1, false);
+		RecursiveHullCheckPacket(model, node->children[side], packet, &cut, firstMasks[side]);
+
+		// examine [middle	end]
+		CutTracePacketLanes(segment, &cut, crossMasks[side], fraction2, true);
+		RecursiveHullCheckPacket(model, node->children[!side], packet, &cut, crossMasks[side]);
+	}
+}
+
+
+// Traces numTraces boxes, results[i] is what BoxTrace would return for trace i
+void BoxTraceBatch(glm::vec3* starts, glm::vec3* ends, glm::vec3* mins, glm::vec3* maxs, int numTraces,
+	BSPCollisionModel* model, TraceResult* results)
+{
+	for (int first = 0; first < numTraces; first += TRACE_PACKET_SIZE)
+	{
+		int numLanes = std::min(TRACE_PACKET_SIZE, numTraces - first);
+
+		TracePacket packet = {};
+		packet.traceStarts = &starts[first];
+		packet.traceEnds = &ends[first];
+
+		TracePacketSegment segment = {};
+		for (int i = 0; i < numLanes; i++)
+		{
+			BeginBoxTrace(starts[first + i], ends[first + i], mins[first + i], maxs[first + i], &packet.results[i], &packet.setups[i]);
+			BeginTraceMailbox(model, i, &packet.setups[i].brushStamps, &packet.setups[i].mailboxStamp);
+			SetTracePacketLane(packet.mins, i, mins[first + i]);
+			SetTracePacketLane(packet.maxs, i, maxs[first + i]);
+			SetTracePacketLane(packet.traceExtends, i, packet.setups[i].traceExtends);
+
+			segment.startFraction[i] = 0;
+			segment.endFraction[i] = 1;
+			SetTracePacketLane(segment.start, i, starts[first + i]);
+			SetTracePacketLane(segment.end, i, ends[first + i]);
+		}
+
+		RecursiveHullCheckPacket(model, model->root, &packet, &segment, TRACE_PACKET_ALL_LANES >> (TRACE_PACKET_SIZE - numLanes));
+
+		for (int i = 0; i < numLanes; i++)
+		{
+			END_TRACE_STATS(&packet.setups[i]);
+			CheckStoppedTraceSolid(model, starts[first + i], ends[first + i], mins[first + i], maxs[first + i], &packet.results[i]);
+			EndBoxTrace(starts[first + i], ends[first + i], &packet.results[i]);
+			results[first + i] = packet.results[i];
+		}
+	}
+}
+
+
+// NULL if theres no hull for this box
+BSPHull* FindWorldHull(World* world, glm::vec3 mins, glm::vec3 maxs)
+{
+	for (int i = 0; i < world->numHulls; i++)
+	{
+		if (IsHullSize(world->hulls[i].size, mins, maxs))
+		{
+			return &world->hulls[i];
+		}
+	}
+	return NULL;
+}
+
+
+// The model a box of this size is traced against. With hulls that is the hull of the size, 
+// where the box becomes a point, so mins and maxs are changed to the box to trace with there
+BSPCollisionModel* GetWorldTraceModel(World* world, glm::vec3* mins, glm::vec3* maxs)
+{
+	if (world->collisionBackend == COLLISION_BACKEND_BSP_HULLS)
+	{
+		BSPHull* hull = FindWorldHull(world, *mins, *maxs);
+		if (hull)
+		{
+			*mins = glm::vec3(0);
+			*maxs = glm::vec3(0);
+			return &hull->model;
+		}
+	}
+	return &world->collisionModel;
+}
+
+
+// set on a worker thread while it moves entities, so each job records its traces on 
+// the side and they can be appended to world->traceRecording in a fixed order
+thread_local TraceCorpus* threadTraceRecording;
+
+TraceCorpus* GetTraceRecording(World* world)
+{
+	if (world->traceRecording && threadTraceRecording)
+	{
+		return threadTraceRecording;
+	}
+	return world->traceRecording;
+}
+
+
+TraceResult WorldBoxTrace(World* world, glm::vec3 start, glm::vec3 end, glm::vec3 mins, glm::vec3 maxs, bool print = false)
+{
+	if (world->traceRecording)
+	{
+		RecordTrace(GetTraceRecording(world), start, end, mins, maxs);
+	}
+
+	if (world->collisionBackend == COLLISION_BACKEND_AABB_TREE)
+	{
+		return BoxTrace(start, end, mins, maxs, &world->brushTree, &world->collisionModel, &world->collisionBrushes);
+	}
+
+	BSPCollisionModel* model = GetWorldTraceModel(world, &mins, &maxs);
+	return BoxTrace(start, end, mins, maxs, model, print);
+}
+
+
+// traces of one model waiting to be packet traced together, traces[i] is the index of lane i in the batch
+struct WorldTraceGroup
+{
+	glm::vec3 starts[TRACE_PACKET_SIZE];
+	glm::vec3 ends[TRACE_PACKET_SIZE];
+	glm::vec3 mins[TRACE_PACKET_SIZE];
+	glm::vec3 maxs[TRACE_PACKET_SIZE];
+	int traces[TRACE_PACKET_SIZE];
+	int numTraces;
+};
+
+
+void FlushWorldTraceGroup(WorldTraceGroup* group, BSPCollisionModel* model, TraceResult* results)
+{
+	TraceResult groupResults[TRACE_PACKET_SIZE];
+	BoxTraceBatch(group->starts, group->ends, group->mins, group->maxs, group->numTraces, model, groupResults);
+	for (int i = 0; i < group->numTraces; i++)
+	{
+		results[group->traces[i]] = groupResults[i];
+	}
+	group->numTraces = 0;
+}
+
+
+// WorldBoxTrace for many traces at once. The traces are sorted by the model GetWorldTraceModel
+// picks for them and packet traced model by model, against a hull they are packets of point traces
+void WorldBoxTraceBatch(World* world, glm::vec3* starts, glm::vec3* ends, glm::vec3* mins, glm::vec3* maxs, int numTraces, TraceResult* results)
+{
+	if (world->collisionBackend == COLLISION_BACKEND_AABB_TREE)
+	{
+		for (int i = 0; i < numTraces; i++)
+		{
+			results[i] = WorldBoxTrace(world, starts[i], ends[i], mins[i], maxs[i]);
+		}
+		return;
+	}
+
+	if (world->traceRecording)
+	{
+		for (int i = 0; i < numTraces; i++)
+		{
+			RecordTrace(GetTraceRecording(world), starts[i], ends[i], mins[i], maxs[i]);
+		}
+	}
+
+	BSPCollisionModel* models[MAX_BSP_HULLS + 1];
+	int numModels = 0;
+	models[numModels++] = &world->collisionModel;
+	if (world->collisionBackend == COLLISION_BACKEND_BSP_HULLS)
+	{
+		for (int i = 0; i < world->numHulls; i++)
+		{
+			models[numModels++] = &world->hulls[i].model;
+		}
+	}
+
+	for (int i = 0; i < numModels; i++)
+	{
+		WorldTraceGroup group;
+		group.numTraces = 0;
+
+		for (int j = 0; j < numTraces; j++)
+		{
+			glm::vec3 traceMins = mins[j];
+			glm::vec3 traceMaxs = maxs[j];
+			if (GetWorldTraceModel(world, &traceMins, &traceMaxs) != models[i])
+			{
+				continue;
+			}
+
+			int lane = group.numTraces++;
+			group.starts[lane] = starts[j];
+			group.ends[lane] = ends[j];
+			group.mins[lane] = traceMins;
+			group.maxs[lane] = traceMaxs;
+			group.traces[lane] = j;
+
+			if (group.numTraces == TRACE_PACKET_SIZE)
+			{
+				FlushWorldTraceGroup(&group, models[i], results);
+			}
+		}
+
+		if (group.numTraces > 0)
+		{
+			FlushWorldTraceGroup(&group, models[i], results);
+		}
+	}
+}
+
+
+// Always against the tree of the level, the hulls are grown by boxes. Not recorded, the 
+// trace corpus only holds box traces
+TraceResult WorldCapsuleTrace(World* world, glm::vec3 start, glm::vec3 end, float radius, float halfHeight)
+{
+	return CapsuleTrace(start, end, radius, halfHeight, &world->collisionModel);
+}
+
+
+TraceResult WorldSphereTrace(World* world, glm::vec3 start, glm::vec3 end, float radius)
+{
+	return SphereTrace(start, end, radius, &world->collisionModel);
+}
+
+
+// BoxContents in the model WorldBoxTrace would trace the box against
+int WorldBoxContents(World* world, glm::vec3 origin, glm::vec3 mins, glm::vec3 maxs, std::vector<int>* brushes = NULL)
+{
+	BSPCollisionModel* model = GetWorldTraceModel(world, &mins, &maxs);
+	return BoxContents(model, origin, mins, maxs, brushes);
+}
+
+
+int WorldPointContents(World* world, glm::vec3 point, std::vector<int>* brushes = NULL)
+{
+	return PointContents(&world->collisionModel, point, brushes);
+}
+
+
+/*
+	Temporal coherence for the traces an entity repeats every frame, like CatagorizePosition's
+	short trace down. A full trace also gathers every brush near the entity, and as long as 
+	the next traces stay inside that neighbourhood they only test those brushes, no tree walk.
+
+		 _____________________
+		|  region             |		brushes = every brush touching region.
+		|       _____         |		A trace whose swept box is inside region
+		|      | box |        |		cant touch any other brush
+		|      |_____|        |
+		|_____________________|
+
+	It caches a region instead of the leaf the entity was in, a box usually sits in several 
+	leaves. When two brushes are hit at exactly the same fraction, the plane can be the other 
+	one than the full trace returns, that one tests brushes in leaf order.
+*/
+const float TRACE_CACHE_MARGIN = 32.0f;
+
+// only the brushes, from first to last
+TraceResult BoxTraceBrushes(glm::vec3 start, glm::vec3 end, glm::vec3 mins, glm::vec3 maxs, BSPCollisionModel* model,
+	int* brushes, int numBrushes)
+{
+	TraceResult result;
+	TraceSetupInfo setup;
+	BeginBoxTrace(start, end, mins, maxs, &result, &setup);
+
+	for (int i = 0; i < numBrushes; i++)
+	{
+		FlatBSPBrush* brush = &model->brushes[brushes[i]];
+		if (!TraceCanHitBrush(brush, &setup))
+		{
+			TRACE_STAT(&setup, TRACE_STAT_EARLY_OUTS);
+			continue;
+		}
+
+		TRACE_STAT(&setup, TRACE_STAT_BRUSHES);
+		CheckBrush(model, brush, start, end, &result, &setup);
+		if (result.timeFraction == 0)
+		{
+			break;
+		}
+	}
+	END_TRACE_STATS(&setup);
+
+	if (IsBoxTraceStoppedDead(mins, maxs, &result))
+	{
+		CheckStoppedTraceBrushes(model, brushes, numBrushes, start, end, mins, maxs, &result);
+	}
+	EndBoxTrace(start, end, &result);
+	return result;
+}
+
+
+void FillTraceCache(TraceCache* cache, BSPCollisionModel* model, int collisionVersion, BoundingBox region)
 {
-	TraceResult result = {};
-	result.outputStartsOut = true;
-	result.outputAllSolid = false;
-	result.plane = NULL_PLANE;
+	cache->model = model;
+	cache->collisionVersion = collisionVersion;
+	cache->region = region;
+	cache->brushes.clear();
+
+	std::vector<int> leaves = BoxLeafs(model, region);
+	for (int i = 0; i < leaves.size(); i++)
+	{
+		FlatBSPLeaf* leaf = &model->leaves[leaves[i]];
+		for (int j = 0; j < leaf->numLeafBrushes; j++)
+		{
+			int brushIndex = model->leafBrushes[leaf->firstLeafBrush + j];
+			if (BoundingBoxesOverlap(model->brushes[brushIndex].bounds, region) &&
+				std::find(cache->brushes.begin(), cache->brushes.end(), brushIndex) == cache->brushes.end())
+			{
+				cache->brushes.push_back(brushIndex);
+			}
+		}
+	}
+}
 
-	TraceSetupInfo setup = {};
 
-	result.timeFraction = 1;
+// WorldBoxTrace, through the brushes in cache while the trace stays in its region. 
+// A trace that leaves it is a full one and fills the cache for a region around it
+TraceResult WorldBoxTraceCached(World* world, TraceCache* cache, glm::vec3 start, glm::vec3 end, glm::vec3 mins, glm::vec3 maxs)
+{
+	glm::vec3 traceMins = mins;
+	glm::vec3 traceMaxs = maxs;
+	BSPCollisionModel* model = GetWorldTraceModel(world, &traceMins, &traceMaxs);
 
-	setup.mins = mins;
-	setup.maxs = maxs;
+	BoundingBox sweptBox;
+	sweptBox.min = glm::min(start, end) + traceMins - glm::vec3(DIST_EPSILON);
+	sweptBox.max = glm::max(start, end) + traceMaxs + glm::vec3(DIST_EPSILON);
 
-	if (start == end)
+	if (cache->model != model || cache->collisionVersion != world->collisionVersion ||
+		!ContainsBoundingBox(cache->region, sweptBox))
 	{
+		FillTraceCache(cache, model, world->collisionVersion, FattenBoundingBox(sweptBox, TRACE_CACHE_MARGIN));
+		return WorldBoxTrace(world, start, end, mins, maxs);
+	}
 
+	if (world->traceRecording)
+	{
+		RecordTrace(GetTraceRecording(world), start, end, mins, maxs);
 	}
 
-	if (mins == maxs)
+	return BoxTraceBrushes(start, end, traceMins, traceMaxs, model, cache->brushes.data(), cache->brushes.size());
+}
+
+
+// FlattenBSPTree puts the source brushes first, in brushIndex order, so a compiled model 
+// maps one to one. A mapped bsp file only does when it was compiled from the same brushes, 
+// a file with fewer brushes leaves the rest unmapped instead of reading past its end
+void MapWorldBrushesToCollisionModel(World* world)
+{
+	BSPCollisionModel* model = &world->collisionModel;
+	world->collisionBrushes.assign(world->brushes.size(), -1);
+
+	int numUnmapped = 0;
+	for (int i = 0; i < world->brushes.size(); i++)
 	{
-		setup.isTraceBoxAPoint = true;
+		if (i < model->numBrushes)
+		{
+			world->collisionBrushes[i] = i;
+		}
+		else
+		{
+			numUnmapped += world->brushes[i].polygons.size() > 0;
+		}
 	}
-	else
+
+	if (numUnmapped > 0)
 	{
-		setup.isTraceBoxAPoint = false;
+		std::cout << "collision model is missing " << numUnmapped << " world brushes" << std::endl;
+	}
+}
 
-		// getting the largest dimension in of min or max
-		// essentially we are comparing -min[i] and max[i]
-		setup.traceExtends[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-		setup.traceExtends[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-		setup.traceExtends[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+
+// one proxy per live brush in world->brushes
+void BuildWorldBrushTree(World* world)
+{
+	InitAABBTree(&world->brushTree);
+	world->brushProxies.assign(world->brushes.size(), AABB_NULL_NODE);
+
+	for (int i = 0; i < world->brushes.size(); i++)
+	{
+		if (world->brushes[i].polygons.size() > 0)
+		{
+			world->brushProxies[i] = CreateAABBProxy(&world->brushTree, world->brushes[i].GetBoundingBox(), i);
+		}
+	}
+	MapWorldBrushesToCollisionModel(world);
+}
+
+
+
+
+
+
+
+
+
+
+// lots of small crates scattered over a floor, the case the AABB tree backend is for
+void CreateScatteredCrates(World* world, std::vector<Brush>& brushes)
+{
+	const int NUM_CRATES = 200;
+	const float AREA_SIZE = 1000;
+
+	Entity* entity = &world->entities[world->numEntities++];
+	glm::vec3 pos = glm::vec3(0);
+	std::vector<Face> faces = CreateCubeFaceMinMax(glm::vec3(-AREA_SIZE / 2, -10, -AREA_SIZE / 2), glm::vec3(AREA_SIZE / 2, 0, AREA_SIZE / 2));
+	AddEntityBrush(world, brushes, entity, faces);
+	initEntity(entity, pos, faces);
+
+	// fixed seed so the level is the same every time
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> position(-AREA_SIZE / 2, AREA_SIZE / 2);
+	std::uniform_real_distribution<float> size(4, 24);
+
+	for (int i = 0; i < NUM_CRATES; i++)
+	{
+		glm::vec3 min = glm::vec3(std::floor(position(rng)), 0, std::floor(position(rng)));
+		glm::vec3 max = min + glm::vec3(std::floor(size(rng)), std::floor(size(rng)), std::floor(size(rng)));
+
+		entity = &world->entities[world->numEntities++];
+		faces = CreateCubeFaceMinMax(min, max);
+		AddEntityBrush(world, brushes, entity, faces);
+		initEntity(entity, pos, faces);
 	}
+}
 
-	RecursiveHullCheck(tree, 0, 1, start, end, start, end, &result, &setup, print);
 
-	if (result.timeFraction == 1)
+enum LevelId
+{
+	LEVEL_AREA_A,
+	LEVEL_AREA_B,
+	LEVEL_AREA_C,
+	LEVEL_SCATTERED_CRATES,
+	NUM_LEVELS
+};
+
+const char* levelNames[NUM_LEVELS] = { "area_a", "area_b", "area_c", "scattered_crates" };
+
+void CreateLevel(World* world, LevelId level, std::vector<Brush>& brushes)
+{
+	switch (level)
 	{
-		result.endPos = end;
+		case LEVEL_AREA_A:	CreateAreaA(world, brushes);	break;
+		case LEVEL_AREA_B:	CreateAreaB(world, brushes);	break;
+		case LEVEL_AREA_C:	CreateAreaC(world, brushes);	break;
+		case LEVEL_SCATTERED_CRATES:	CreateScatteredCrates(world, brushes);	break;
+		default:	assert(false);	break;
 	}
-	else
+}
+
+
+// one trace per line, start end mins maxs
+bool WriteTraceCorpus(const char* filename, TraceCorpus* corpus)
+{
+	std::ofstream file(filename);
+	if (!file.is_open())
 	{
-		for (int i = 0; i < 3; i++)
+		return false;
+	}
+
+	for (int i = 0; i < corpus->traces.size(); i++)
+	{
+		RecordedTrace& trace = corpus->traces[i];
+		glm::vec3 values[4] = { trace.start, trace.end, trace.mins, trace.maxs };
+		for (int j = 0; j < 4; j++)
 		{
-			result.endPos[i] = start[i] + result.timeFraction * (end[i] - start[i]);
+			file << values[j].x << " " << values[j].y << " " << values[j].z << (j < 3 ? " " : "\n");
 		}
 	}
+	return file.good();
+}
 
-	return result;
+
+bool ReadTraceCorpus(const char* filename, TraceCorpus* corpus)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	RecordedTrace trace;
+	while (file >> trace.start.x >> trace.start.y >> trace.start.z >> trace.end.x >> trace.end.y >> trace.end.z >>
+		trace.mins.x >> trace.mins.y >> trace.mins.z >> trace.maxs.x >> trace.maxs.y >> trace.maxs.z)
+	{
+		corpus->traces.push_back(trace);
+	}
+	return true;
+}
+
+
+int GetNumLiveWorldBrushes(World* world)
+{
+	int count = 0;
+	for (int i = 0; i < world->brushes.size(); i++)
+	{
+		count += world->brushes[i].polygons.size() > 0;
+	}
+	return count;
+}
+
+
+// takes ownership of root, brushes is the list it was compiled from. root is NULL when 
+// the level was loaded precompiled, the first edit starts a rebuild for it then
+void InitWorldBrushEditing(World* world, BSPNode* root, std::vector<Brush>& brushes)
+{
+	world->bspRoot = root;
+	world->brushes = brushes;
+	for (int i = 0; i < world->brushes.size(); i++)
+	{
+		world->brushes[i].brushIndex = i;
+		ResetBrushUsedFlags(world->brushes[i]);
+	}
+
+	world->bspEditState.settings = BSPBuildSettings();
+	world->bspEditState.settings.verbose = false;
+	world->bspEditState.numLiveBrushes = GetNumLiveWorldBrushes(world);
+	if (root)
+	{
+		ResetBSPEditState(&world->bspEditState, &world->tree, world->bspEditState.numLiveBrushes);
+	}
+
+	world->bspDebugDrawStale = false;
+	world->rebuildQueue = NULL;
+	world->addWorkQueueEntry = NULL;
+	world->rebuildJob = NULL;
+	world->rebuildEditedBrushes.clear();
+
+	BuildWorldBrushTree(world);
+}
+
+
+// one hull per standard size, from world->brushes
+void CompileWorldHulls(World* world)
+{
+	world->collisionVersion++;
+	for (int i = 0; i < world->numHulls; i++)
+	{
+		FreeBSPHullTree(&world->hulls[i]);
+	}
+
+	world->numHulls = 0;
+	for (int i = 0; i < NUM_STANDARD_HULLS && i < MAX_BSP_HULLS; i++)
+	{
+		CompileBSPHull(world->brushes, standardHullSizes[i], world->bspEditState.settings, &world->hulls[world->numHulls++]);
+	}
+}
+
+
+// an edited brush shows all of its faces, CSG only runs on full rebuilds
+void SetEntityModelToBrush(World* world, Brush& brush)
+{
+	if (brush.entityIndex == -1)
+	{
+		return;
+	}
+
+	Entity* entity = &world->entities[brush.entityIndex];
+	entity->model.clear();
+	for (int i = 0; i < brush.polygons.size(); i++)
+	{
+		Face face = { brush.polygons[i].vertices };
+		entity->model.push_back(face);
+	}
+}
+
+
+// the overlay is only marked stale by edits, it gets baked again here before it is drawn
+void UpdateWorldBSPDebugDraw(World* world)
+{
+	if (world->bspDebugDrawStale)
+	{
+		BuildBSPDebugDraw(&world->bspDebugDraw, &world->tree);
+		world->bspDebugDrawStale = false;
+	}
+}
+
+
+// patches everything built from world->brushes for brush going in at brush.brushIndex:
+// the tree and its PVS, the hulls, and the entities in the leaves that changed
+void PatchWorldBrush(World* world, Brush brush)
+{
+	int brushIndex = brush.brushIndex;
+	bool wasLive = brushIndex < world->brushes.size() && world->brushes[brushIndex].polygons.size() > 0;
+
+	BSPEditState* state = &world->bspEditState;
+	state->numLiveBrushes += (brush.polygons.size() > 0) - wasLive;
+	state->numEditsSinceRebuild++;
+
+	FlatBSPPatch patch;
+	ReplaceBSPTreeBrush(&world->bspRoot, world->brushes, &world->tree, brush, state->settings, &patch);
+	world->collisionModel = GetBSPCollisionModel(&world->tree);
+
+	for (int i = 0; i < world->numHulls; i++)
+	{
+		// hulls loaded from a file only go with a precompiled tree, which has no bspRoot
+		BSPHull* hull = &world->hulls[i];
+		assert(hull->root != NULL);
+
+		FlatBSPPatch hullPatch;
+		ReplaceBSPTreeBrush(&hull->root, hull->brushes, &hull->tree, ExpandBrushForHull(brush, hull->size), state->settings, &hullPatch);
+		hull->model = GetBSPCollisionModel(&hull->tree);
+	}
+
+	world->collisionVersion++;
+	world->collisionBrushes.resize(world->brushes.size(), -1);
+	world->collisionBrushes[brushIndex] = brushIndex;
+	world->bspDebugDrawStale = true;
+
+	SetEntityModelToBrush(world, brush);
+	RelinkStaticEntitiesToLeaves(world, &patch, brush.entityIndex);
+}
+
+
+/*
+	A full build from a copy of world->brushes, run on World::rebuildQueue so CSG, vis and
+	the hulls dont stall the frame. The game keeps tracing and patching the trees it has until
+	it is done, then FinishWorldRebuild swaps the new ones in and patches the brushes edited
+	in the meantime on top.
+*/
+struct WorldRebuildJob
+{
+	// copied when the job starts, the job never touches the world
+	std::vector<Brush> brushes;
+	BSPBuildSettings settings;
+
+	BSPNode* root;
+	FlatBSPTree tree;
+	std::vector<std::vector<BspPolygon>> visibleFaces;
+	BSPDebugDraw debugDraw;
+	BSPHull hulls[MAX_BSP_HULLS];
+	int numHulls;
+
+	std::atomic<bool> done;
+};
+
+
+void DoWorldRebuildJob(PlatformWorkQueue* queue, void* data)
+{
+	WorldRebuildJob* job = (WorldRebuildJob*)data;
+
+	// CSG marks faces as used, job->brushes stays clean for patching edits on top
+	std::vector<Brush> brushes = job->brushes;
+	job->root = CompileBSP(brushes, job->settings, &job->tree, &job->visibleFaces, NULL);
+	BuildBSPDebugDraw(&job->debugDraw, &job->tree);
+
+	job->numHulls = 0;
+	for (int i = 0; i < NUM_STANDARD_HULLS && i < MAX_BSP_HULLS; i++)
+	{
+		CompileBSPHull(job->brushes, standardHullSizes[i], job->settings, &job->hulls[job->numHulls++]);
+	}
+
+	job->done = true;
+}
+
+
+void FinishWorldRebuild(World* world)
+{
+	WorldRebuildJob* job = world->rebuildJob;
+	world->rebuildJob = NULL;
+
+	FreeBSPTree(world->bspRoot);
+	world->bspRoot = job->root;
+	world->tree = std::move(job->tree);
+	world->collisionModel = GetBSPCollisionModel(&world->tree);
+	world->bspDebugDraw = std::move(job->debugDraw);
+	world->bspDebugDrawStale = false;
+
+	for (int i = 0; i < world->numHulls; i++)
+	{
+		FreeBSPHullTree(&world->hulls[i]);
+	}
+
+	world->numHulls = job->numHulls;
+	for (int i = 0; i < job->numHulls; i++)
+	{
+		world->hulls[i] = std::move(job->hulls[i]);
+		world->hulls[i].model = GetBSPCollisionModel(&world->hulls[i].tree);
+	}
+
+	// the new trees have the brushes from when the job started
+	std::vector<Brush> brushes = std::move(world->brushes);
+	world->brushes = std::move(job->brushes);
+	ApplyVisibleFacesToEntities(world, world->brushes, job->visibleFaces);
+	ResetBSPEditState(&world->bspEditState, &world->tree, GetNumLiveWorldBrushes(world));
+
+	world->collisionVersion++;
+	MapWorldBrushesToCollisionModel(world);
+	LinkStaticEntitiesToLeaves(world);
+
+	// in index order, so brushes added since go in one after the other
+	std::vector<int>& edited = world->rebuildEditedBrushes;
+	std::sort(edited.begin(), edited.end());
+	edited.erase(std::unique(edited.begin(), edited.end()), edited.end());
+	for (int i = 0; i < edited.size(); i++)
+	{
+		PatchWorldBrush(world, brushes[edited[i]]);
+	}
+	assert(world->brushes.size() == brushes.size());
+
+	edited.clear();
+	delete job;
+}
+
+
+// without a rebuildQueue the rebuild is done and swapped in before this returns
+void StartWorldRebuild(World* world)
+{
+	if (world->rebuildJob)
+	{
+		return;
+	}
+
+	WorldRebuildJob* job = new WorldRebuildJob();
+	job->brushes = world->brushes;
+	job->settings = world->bspEditState.settings;
+	job->done = false;
+
+	world->rebuildJob = job;
+	world->rebuildEditedBrushes.clear();
+
+	if (world->rebuildQueue == NULL)
+	{
+		DoWorldRebuildJob(NULL, job);
+		FinishWorldRebuild(world);
+		return;
+	}
+	world->addWorkQueueEntry(world->rebuildQueue, DoWorldRebuildJob, job);
+}
+
+
+// called once a frame, swaps a rebuild in once its job is done
+void UpdateWorldRebuild(World* world)
+{
+	if (world->rebuildJob && world->rebuildJob->done)
+	{
+		FinishWorldRebuild(world);
+	}
 }
 
 
+// puts brush into world->brushes at brush.brushIndex, one past the end adds it
+void SetWorldBrush(World* world, Brush brush)
+{
+	int brushIndex = brush.brushIndex;
+	bool isLive = brush.polygons.size() > 0;
+
+	if (brushIndex == world->brushProxies.size())
+	{
+		world->brushProxies.push_back(AABB_NULL_NODE);
+	}
+
+	int* proxy = &world->brushProxies[brushIndex];
+	if (*proxy != AABB_NULL_NODE && !isLive)
+	{
+		DestroyAABBProxy(&world->brushTree, *proxy);
+		*proxy = AABB_NULL_NODE;
+	}
+	else if (*proxy != AABB_NULL_NODE)
+	{
+		MoveAABBProxy(&world->brushTree, *proxy, brush.GetBoundingBox());
+	}
+	else if (isLive)
+	{
+		*proxy = CreateAABBProxy(&world->brushTree, brush.GetBoundingBox(), brushIndex);
+	}
+
+	// a rebuild that is running has the brushes from before this edit
+	if (world->rebuildJob)
+	{
+		world->rebuildEditedBrushes.push_back(brushIndex);
+	}
+
+	if (world->bspRoot)
+	{
+		PatchWorldBrush(world, brush);
+		if (NeedsFullRebuild(&world->bspEditState, &world->tree))
+		{
+			StartWorldRebuild(world);
+		}
+		return;
+	}
+
+	// loaded precompiled, there is nothing to patch until the first rebuild is in.
+	// Traces go through the mapped model without the edit until then
+	ResetBrushUsedFlags(brush);
+	if (brushIndex == world->brushes.size())
+	{
+		world->brushes.push_back(brush);
+	}
+	else
+	{
+		world->brushes[brushIndex] = brush;
+	}
+
+	world->collisionBrushes.resize(world->brushes.size(), -1);
+	SetEntityModelToBrush(world, brush);
+	StartWorldRebuild(world);
+}
 
 
+// returns the index of the new brush
+int AddWorldBrush(World* world, Brush brush)
+{
+	brush.brushIndex = world->brushes.size();
+	SetWorldBrush(world, brush);
+	return brush.brushIndex;
+}
 
 
+void RemoveWorldBrush(World* world, int brushIndex)
+{
+	Brush brush = world->brushes[brushIndex];
+	brush.polygons.clear();
+	brush.used.clear();
+	SetWorldBrush(world, brush);
+}
 
 
+void MoveWorldBrush(World* world, int brushIndex, glm::vec3 offset)
+{
+	Brush brush = world->brushes[brushIndex];
+	TranslateBrush(brush, offset);
+	SetWorldBrush(world, brush);
+}
 
 
-// Essentially recreating a simplified version of dust2
-void initWorld(World* world)
+// Essentially recreating a simplified version of dust2.
+// bspFile is the mapped, precompiled bsp of the level, memory is NULL if there isnt one
+// hullFiles are the precompiled clip hulls that go with bspFile
+void initWorld(World* world, PlatformMappedFile* bspFile, PlatformMappedFile* hullFiles, int numHullFiles)
 {
 	// initlaize the game state  
 	world->numEntities = 0;
@@ -1240,20 +3667,76 @@ void initWorld(World* world)
 
 	float wallHeight = 50;
 
-	CreateAreaA(world, brushes);
-	// CreateAreaC(world, brushes);
+	CreateLevel(world, LEVEL_AREA_A, brushes);
+	// CreateLevel(world, LEVEL_AREA_C, brushes);
 
 	// glm::vec3 siteBSize = glm::vec3(200, wallHeight, 200);
 	//CreateAreaB(world, glm::vec3(500, 0, 0), siteBSize, brushes);
 	
 
 
-	std::cout << "############# BuildBSPTree" << std::endl;
-	world->tree = BuildBSPTree(brushes, 0);
+	// a file compiled from other brushes than these is stale and gets compiled over
+	BSPFileStamp stamp = GetBSPFileStamp(LEVEL_AREA_A, brushes);
+
+	BSPNode* tree = NULL;
+	BSPFilePolygons polygons;
+	if (LoadBSPFile(bspFile->memory, bspFile->size, stamp, &world->collisionModel, NULL, &polygons))
+	{
+		std::cout << "############# loaded precompiled " << levelNames[LEVEL_AREA_A] << std::endl;
+
+		// what the compile below would have made of the level
+		std::vector<BspPolygon*> splitPolygons;
+		for (int i = 0; i < polygons.splitPolygons.size(); i++)
+		{
+			splitPolygons.push_back(&polygons.splitPolygons[i]);
+		}
+		BuildBSPDebugDraw(&world->bspDebugDraw, &world->collisionModel, splitPolygons);
+		ApplyVisibleFacesToEntities(world, brushes, polygons.visibleFaces);
+	}
+	else
+	{
+		if (bspFile->memory)
+		{
+			std::cout << "############# precompiled " << levelNames[LEVEL_AREA_A] << " is stale or broken, compiling it" << std::endl;
+		}
+
+		std::vector<std::vector<BspPolygon>> visibleFaces;
+		BSPBuildReport report = {};
+		report.levelName = levelNames[LEVEL_AREA_A];
+		tree = CompileBSP(brushes, BSPBuildSettings(), &world->tree, &visibleFaces, &report);
+		world->collisionModel = GetBSPCollisionModel(&world->tree);
+		BuildBSPDebugDraw(&world->bspDebugDraw, &world->tree);
+		ApplyVisibleFacesToEntities(world, brushes, visibleFaces);
+
+		std::cout << "############# PrintBSPTree" << std::endl;
+		PrintBSPTree(tree, 0);
+
+		std::cout << "############# BSP report" << std::endl;
+		WriteBSPReportJson(std::cout, &report);
+		std::cout << std::endl;
+	}
 
-	std::cout << "############# PrintBSPTree" << std::endl;
-	PrintBSPTree(world->tree, 0);
+	LinkStaticEntitiesToLeaves(world);
+	InitWorldBrushEditing(world, tree, brushes);
 
+	// hull files only go with a precompiled tree, and are stamped like it
+	world->numHulls = 0;
+	if (tree)
+	{
+		CompileWorldHulls(world);
+	}
+	else
+	{
+		for (int i = 0; i < numHullFiles && world->numHulls < MAX_BSP_HULLS; i++)
+		{
+			BSPHull* hull = &world->hulls[world->numHulls];
+			if (LoadBSPFile(hullFiles[i].memory, hullFiles[i].size, stamp, &hull->model, &hull->size))
+			{
+				world->numHulls++;
+			}
+		}
+	}
+	world->collisionBackend = COLLISION_BACKEND_BSP_HULLS;
 
 
 
@@ -66,6 +66,22 @@ typedef void*(*PlatformAllocateTexture)(uint32 width, uint32 height, void* data)
 
 typedef unsigned int(*PlatformAllocateTexture2)(uint32 width, uint32 height, void* data);
 
+// read only view of a whole file
+struct PlatformMappedFile
+{
+	void* memory;
+	uint64 size;
+};
+
+typedef bool(*PlatformMapReadOnlyFile)(const char* filename, PlatformMappedFile* file);
+
+// jobs run on the platform's worker threads, the main thread helps out in completeAllWork
+struct PlatformWorkQueue;
+typedef void(*PlatformWorkQueueCallback)(PlatformWorkQueue* queue, void* data);
+
+typedef void(*PlatformAddWorkQueueEntry)(PlatformWorkQueue* queue, PlatformWorkQueueCallback callback, void* data);
+typedef void(*PlatformCompleteAllWork)(PlatformWorkQueue* queue);
+
 
 
 inline bool AreStringsEqual(const char *A, const char *B)
@@ -142,6 +158,10 @@ struct PlatformAPI
 {
 	PlatformReadImageFile readImageFile;
 	PlatformAllocateTexture allocateTexture;
+	PlatformMapReadOnlyFile mapReadOnlyFile;
+
+	PlatformAddWorkQueueEntry addWorkQueueEntry;
+	PlatformCompleteAllWork completeAllWork;
 };
 
 struct DebugTable;
@@ -162,6 +182,9 @@ struct GameMemory
 
 	PlatformAPI platformAPI;
 	PlatformWorkQueue* workQueue;
+
+	// for jobs that can take longer than a frame, nobody waits on this one with completeAllWork
+	PlatformWorkQueue* lowPriorityQueue;
 };
 
 
@@ -56,13 +56,13 @@ struct DebugEvent
 #define GenerateGUID(a,b,c,d)  GenerateGUID_(a,b,c,d)
 #define DEBUG_NAME(name) GenerateGUID(__FILE__, __LINE__, __COUNTER__, name)
 
-#define BEGIN_BLOCK_(GUID)	{RecordDebugEvent(DebugEventType::BeginBlock, GUID);}
-#define END_BLOCK_(GUID)	{RecordDebugEvent(DebugEventType::EndBlock, GUID);}
+#define BEGIN_BLOCK_(GUID)	{RecordDebugEvent(globalDebugTable, DebugEventType::BeginBlock, GUID);}
+#define END_BLOCK_(GUID)	{RecordDebugEvent(globalDebugTable, DebugEventType::EndBlock, GUID);}
 
 #define BEGIN_BLOCK(blockName)	BEGIN_BLOCK_(DEBUG_NAME(blockName))
 #define END_BLOCK() END_BLOCK_(DEBUG_NAME("END_BLOCK_"))
 
-#define FRAME_MARKER(secondsElapsedInit)	{RecordDebugEvent(DebugEventType::FrameMarker, DEBUG_NAME("Frame Marker"));	\
+#define FRAME_MARKER(secondsElapsedInit)	{RecordDebugEvent(globalDebugTable, DebugEventType::FrameMarker, DEBUG_NAME("Frame Marker"));	\
 				Event->wallSecondsElapsed = secondsElapsedInit;}
 
 struct DebugTable
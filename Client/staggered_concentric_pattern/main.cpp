@@ -69,6 +69,45 @@ FILETIME SDLGetFileLastWriteTime(const char* filename)
 	return lastWriteTime;
 }
 
+// Also windows API. The view keeps the mapping alive by itself, so both handles are closed
+// right away. Never unmapped, the game keeps what it maps until it exits
+bool SDLMapReadOnlyFile(const char* filename, PlatformMappedFile* file)
+{
+	*file = {};
+
+	HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	// an empty file cant be mapped
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(fileHandle);
+		return false;
+	}
+
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(fileHandle);
+	if (mappingHandle == NULL)
+	{
+		return false;
+	}
+
+	void* memory = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mappingHandle);
+	if (memory == NULL)
+	{
+		return false;
+	}
+
+	file->memory = memory;
+	file->size = fileSize.QuadPart;
+	return true;
+}
+
 BitmapInfo SDLLoadPNGFile(char* filename)
 {
 	BitmapInfo result = {};
@@ -384,10 +423,12 @@ void debugInputs(GameInputState* new_input_state)
 
 
 PlatformWorkQueue workqueue;
+PlatformWorkQueue lowPriorityQueue;
 
 struct SDLThreadInfo
 {
 	int threadId;
+	PlatformWorkQueue* queue;
 };
 
 
@@ -400,7 +441,7 @@ bool TryDoWorkQueueJob(PlatformWorkQueue* workqueue, int threadId)
 		PlatformWorkQueue::Job* entry = workqueue->PopNextJob();
 		if (entry != nullptr)
 		{
-			printf("Thread id %d, %s\n", threadId, (char*)entry->data);
+			entry->callback(workqueue, entry->data);
 			workqueue->MarkJobCompleted();
 			didJob = true;
 		}
@@ -409,19 +450,44 @@ bool TryDoWorkQueueJob(PlatformWorkQueue* workqueue, int threadId)
 }
 
 
+void PrintWorkQueueString(PlatformWorkQueue* workqueue, void* data)
+{
+	printf("%s\n", (char*)data);
+}
+
+
+void SDLAddWorkQueueEntry(PlatformWorkQueue* workqueue, PlatformWorkQueueCallback callback, void* data)
+{
+	workqueue->AddJob(callback, data);
+}
+
+
+// the main thread is the 8th thread
+void SDLCompleteAllWork(PlatformWorkQueue* workqueue)
+{
+	while (!workqueue->AreAllJobsCompleted())
+	{
+		TryDoWorkQueueJob(workqueue, 7);
+	}
+
+	workqueue->targetCompletionGoal = 0;
+	workqueue->numCompletedTask = 0;
+}
+
+
 int ThreadProc(void* parameter)
 {
 	SDLThreadInfo* threadInfo = (SDLThreadInfo*)parameter;
 
 	while (true)
 	{
-		if (TryDoWorkQueueJob(&workqueue, threadInfo->threadId))
+		if (TryDoWorkQueueJob(threadInfo->queue, threadInfo->threadId))
 		{
 			//
 		}
 		else
 		{
-			SDL_SemWait(workqueue.semaphoreHandle);
+			SDL_SemWait(threadInfo->queue->semaphoreHandle);
 		}
 	}
 }
@@ -436,28 +502,32 @@ int main(int argc, char *argv[])
 	for (int i = 0; i < ArrayCount(info); i++)
 	{
 		info[i].threadId = i;
+		info[i].queue = &workqueue;
 
 		SDL_Thread* threadHandle = SDL_CreateThread(ThreadProc, 0, &info[i]);
 		SDL_DetachThread(threadHandle);
 	}
 
-	workqueue.AddJob("String 0");
-	workqueue.AddJob("String 1");
-	workqueue.AddJob("String 2");
-	workqueue.AddJob("String 3");
-	workqueue.AddJob("String 4");
-	workqueue.AddJob("String 5");
-	workqueue.AddJob("String 6");
-	workqueue.AddJob("String 7");
-	workqueue.AddJob("String 8");
-	workqueue.AddJob("String 9");
-	workqueue.AddJob("String 10");
-
-	while(!workqueue.AreAllJobsCompleted())
-	{
-		// our main thread is the 8th thread, so we pass in 7
-		TryDoWorkQueueJob(&workqueue, 7);
-	}
+	// one thread is enough for the jobs that go here, nobody waits on them
+	lowPriorityQueue.init();
+	SDLThreadInfo lowPriorityInfo = {};
+	lowPriorityInfo.threadId = ArrayCount(info) + 1;
+	lowPriorityInfo.queue = &lowPriorityQueue;
+	SDL_DetachThread(SDL_CreateThread(ThreadProc, 0, &lowPriorityInfo));
+
+	workqueue.AddJob(PrintWorkQueueString, "String 0");
+	workqueue.AddJob(PrintWorkQueueString, "String 1");
+	workqueue.AddJob(PrintWorkQueueString, "String 2");
+	workqueue.AddJob(PrintWorkQueueString, "String 3");
+	workqueue.AddJob(PrintWorkQueueString, "String 4");
+	workqueue.AddJob(PrintWorkQueueString, "String 5");
+	workqueue.AddJob(PrintWorkQueueString, "String 6");
+	workqueue.AddJob(PrintWorkQueueString, "String 7");
+	workqueue.AddJob(PrintWorkQueueString, "String 8");
+	workqueue.AddJob(PrintWorkQueueString, "String 9");
+	workqueue.AddJob(PrintWorkQueueString, "String 10");
+
+	SDLCompleteAllWork(&workqueue);
 
 
 
@@ -522,6 +592,7 @@ int main(int argc, char *argv[])
 
 		gameMemory.debugTable = globalDebugTable;
 		gameMemory.workQueue = &workqueue;
+		gameMemory.lowPriorityQueue = &lowPriorityQueue;
 
 		LPVOID baseAddress = 0;
 
@@ -534,6 +605,9 @@ int main(int argc, char *argv[])
 
 		gameMemory.platformAPI.readImageFile = (PlatformReadImageFile)SDLLoadPNGFile;
 		gameMemory.platformAPI.allocateTexture = (PlatformAllocateTexture)OpenGLAllocateTexture;
+		gameMemory.platformAPI.mapReadOnlyFile = (PlatformMapReadOnlyFile)SDLMapReadOnlyFile;
+		gameMemory.platformAPI.addWorkQueueEntry = (PlatformAddWorkQueueEntry)SDLAddWorkQueueEntry;
+		gameMemory.platformAPI.completeAllWork = (PlatformCompleteAllWork)SDLCompleteAllWork;
 		// gameMemory.platformAPI.allocateTexture2 = (PlatformAllocateTexture2)OpenGLAllocateTexture2;
 
 
@@ -636,7 +710,8 @@ int main(int argc, char *argv[])
 			uint64_t endCounter = SDLGetWallClock();
 			double measuredSecondsPerFrame = SDLGetSecondsElapsed(lastCounter, endCounter, globalPerfCountFrequency);
 			
-		//	FRAME_MARKER(measuredSecondsPerFrame);
+			// closes the frame DebugSystemUpdateAndRender collates next
+			FRAME_MARKER(measuredSecondsPerFrame);
 			lastCounter = endCounter;
 			frame++;
 		}
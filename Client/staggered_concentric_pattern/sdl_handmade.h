@@ -7,6 +7,8 @@ struct PlatformWorkQueue
 {
 	struct Job
 	{
+		PlatformWorkQueueCallback callback;
+
 		// User can put any data it wants
 		void* data;
 	};
@@ -42,13 +44,14 @@ struct PlatformWorkQueue
 		return nextEntryToRead != nextEntryToWrite;
 	}
 
-	void AddJob(void* userData)
+	void AddJob(PlatformWorkQueueCallback callback, void* userData)
 	{
 		// If its not full
 		uint32 newNextEntryToWrite = (nextEntryToWrite + 1) % ArrayCount(entries);
 		assert(newNextEntryToWrite != nextEntryToRead);
 
 		Job* entry = &entries[nextEntryToWrite];
+		entry->callback = callback;
 		entry->data = userData;
 		targetCompletionGoal++;
 		SDL_CompilerBarrier();